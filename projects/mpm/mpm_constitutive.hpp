@@ -0,0 +1,45 @@
+//
+// Created by metal on 5/17/21.
+//
+
+#ifndef METASIM_MPM_CONSTITUTIVE_HPP
+#define METASIM_MPM_CONSTITUTIVE_HPP
+
+#include "core/meta.hpp"
+#include <Eigen/Dense>
+#include <cmath>
+
+namespace MS {
+
+// compressible Neo-Hookean elasticity
+// psi(F) = mu/2 (tr(F^T F) - Dim) - mu log(J) + lambda/2 log(J)^2
+template<typename T, int Dim>
+struct NeoHookean {
+  using TM = Mat<Dim, Dim, T>;
+
+  T mu, lambda;
+
+  NeoHookean(T youngs_modulus, T poisson_ratio)
+    : mu(youngs_modulus / (2 * (1 + poisson_ratio)))
+    , lambda(youngs_modulus * poisson_ratio / ((1 + poisson_ratio) * (1 - 2 * poisson_ratio))) {}
+
+  // P = mu (F - F^-T) + lambda log(J) F^-T
+  TM first_piola(const TM& F) const {
+    TM F_inv_T = F.inverse().transpose();
+    T log_J = std::log(F.determinant());
+    return mu * (F - F_inv_T) + lambda * log_J * F_inv_T;
+  }
+
+  // dP = mu dF + (mu - lambda log(J)) F^-T dF^T F^-T + lambda tr(F^-1 dF) F^-T
+  TM first_piola_differential(const TM& F, const TM& dF) const {
+    TM F_inv = F.inverse();
+    TM F_inv_T = F_inv.transpose();
+    T log_J = std::log(F.determinant());
+    return mu * dF + (mu - lambda * log_J) * F_inv_T * dF.transpose() * F_inv_T +
+           lambda * (F_inv * dF).trace() * F_inv_T;
+  }
+};
+
+}   // namespace MS
+
+#endif   // METASIM_MPM_CONSTITUTIVE_HPP
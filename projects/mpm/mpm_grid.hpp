@@ -8,10 +8,11 @@
 #include "core/grid.hpp"
 
 
-template<class TGridData, int Dim>
-class MPMGrid : public Grid<TGridData, Dim> {
+// T: grid scalar, may be narrower than the particle scalar (see MixedPrecision)
+template<class TGridData, int Dim, typename TScalar = real>
+class MPMGrid : public Grid<TGridData, Dim, TScalar> {
 public:
-    using Base = Grid<TGridData, Dim>;
+    using Base = Grid<TGridData, Dim, TScalar>;
 
     using T = typename Base::T;
     using TV = typename Base::TV;
@@ -56,7 +57,8 @@ public:
 
     }
 
-    void TouchGridWithPositions(std::vector<Vec<Dim>>) {
+    template<typename TParticle>
+    void TouchGridWithPositions(const std::vector<Vec<Dim, TParticle>>& positions) {
 
     }
 
@@ -0,0 +1,336 @@
+//
+// Created by metal on 5/17/21.
+//
+
+#ifndef METASIM_MPM_IMPLICIT_SOLVER_HPP
+#define METASIM_MPM_IMPLICIT_SOLVER_HPP
+
+#include "Math/interpolation.hpp"
+#include "Utils/logger.hpp"
+#include "core/meta.hpp"
+#include "mpm_grid.hpp"
+#include <Eigen/Dense>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
+namespace MS {
+
+/*
+ * Backward Euler grid velocity solve over the active nodes of an MPMGrid
+ *
+ *   (M + dt^2 H) v = M v* + dt f(x^n)
+ *
+ * H is never assembled, H u is evaluated through the kernel gradients:
+ *   dF_p = (sum_i u_i grad_w_ip^T) F_p
+ *   (H u)_i = sum_p V_p dP(F_p; dF_p) F_p^T grad_w_ip
+ *
+ * All vectors are compact, indexed by the position in grid.ActiveIndices().
+ * Particle stencils and their node-to-particle transpose are built once per step,
+ * so every matrix-vector product is a lock-free gather per node.
+ */
+template<typename T, int Dim, typename TKernel>
+class MPMImplicitSolver {
+public:
+  using TV = Vec<Dim, T>;
+  using TVI = Vec<Dim, int>;
+  using TM = Mat<Dim, Dim, T>;
+
+  constexpr static int stencil_width = TKernel::order + 1;
+  constexpr static int stencil_size = Dim == 2 ? stencil_width * stencil_width
+                                               : stencil_width * stencil_width * stencil_width;
+
+  // None is plain conjugate gradient, the Jacobi variants use (blocks of) the diagonal of A
+  enum class Preconditioner { None, Jacobi, BlockJacobi };
+
+  struct Report {
+    int iterations{0};
+    T initial_residual{0};
+    T residual{0};
+    bool converged{false};
+  };
+
+  // relative residual tolerance and iteration cap of the conjugate gradient
+  T tolerance{1e-5};
+  int max_iterations{200};
+  Preconditioner preconditioner{Preconditioner::BlockJacobi};
+  bool write_log{true};
+
+  size_t num_nodes() const { return active_count_; }
+
+  /*
+   * build particle stencils in compact node indices
+   * grid.IterateAllGridWithCheck must have been called after P2G, all nodes touched by
+   * the particles are expected to be active
+   */
+  template<typename TGridData, typename TGridScalar, typename TPositions>
+  void build(MPMGrid<TGridData, Dim, TGridScalar>& grid, const TPositions& positions, T dx) {
+    auto& active = grid.ActiveIndices();
+    active_count_ = active.size();
+    num_particles_ = positions.size();
+    inv_dx_ = T(1) / dx;
+
+    // grid index -> compact index
+    compact_of_.assign(grid.TotalSize(), -1);
+    tbb::parallel_for(size_t(0), active.size(), [&](size_t i) { compact_of_[active[i]] = i; });
+
+    stencil_node_.resize(num_particles_ * stencil_size);
+    stencil_grad_.resize(num_particles_ * stencil_size);
+    tbb::parallel_for(size_t(0), num_particles_, [&](size_t p) {
+      auto [base_node, w, dw] = TKernel::calc_o_w_dw(TV(positions[p] * inv_dx_));
+      int s = 0;
+      for_each_offset([&](const TVI& offset) {
+        TV grad;
+        for (int d = 0; d < Dim; d++) {
+          T g = inv_dx_ * T(dw(offset(d), d));
+          for (int e = 0; e < Dim; e++) {
+            if (e != d) g *= T(w(offset(e), e));
+          }
+          grad(d) = g;
+        }
+        auto slot = p * stencil_size + s++;
+        stencil_node_[slot] = compact_of_[grid.Index(base_node + offset)];
+        stencil_grad_[slot] = grad;
+        META_ASSERT(stencil_node_[slot] >= 0, "particle {} touches an inactive node", p);
+      });
+    });
+
+    build_transpose();
+    dirichlet_.assign(active_count_, 0);
+  }
+
+  // mark nodes whose velocity is prescribed, op(grid_coord) -> bool
+  template<typename TGridData, typename TGridScalar, typename OP>
+  void mark_dirichlet(MPMGrid<TGridData, Dim, TGridScalar>& grid, OP is_fixed) {
+    auto& active = grid.ActiveIndices();
+    tbb::parallel_for(size_t(0), active.size(), [&](size_t i) {
+      dirichlet_[i] = is_fixed(grid.Coord(active[i])) ? 1 : 0;
+    });
+  }
+
+  /*
+   * masses: compact node masses
+   * v: in, velocities v* after external forces (also the initial guess)
+   *    out, v^{n+1}; dirichlet nodes keep their incoming value
+   * deformation: particle F, volumes: particle rest volumes
+   */
+  template<typename TModel, typename TDeformation, typename TVolumes>
+  Report solve(T dt, const std::vector<T>& masses, const TDeformation& deformation,
+               const TVolumes& volumes, const TModel& model, std::vector<TV>& v) {
+    auto n = active_count_;
+    Report report;
+
+    // particle stresses of x^n, also cached for the differential
+    particle_F_.resize(num_particles_);
+    particle_volume_.resize(num_particles_);
+    particle_stress_.resize(num_particles_);
+    tbb::parallel_for(size_t(0), num_particles_, [&](size_t p) {
+      particle_F_[p] = deformation[p];
+      particle_volume_[p] = volumes[p];
+      particle_stress_[p] =
+        particle_volume_[p] * model.first_piola(particle_F_[p]) * particle_F_[p].transpose();
+    });
+
+    // rhs = M v* + dt f
+    rhs_.resize(n);
+    tbb::parallel_for(size_t(0), n, [&](size_t i) {
+      TV f = TV::Zero();
+      for (auto k = node_begin_[i]; k < node_begin_[i + 1]; k++) {
+        auto slot = node_slots_[k];
+        f -= particle_stress_[slot / stencil_size] * stencil_grad_[slot];
+      }
+      rhs_[i] = dirichlet_[i] ? masses[i] * v[i] : TV(masses[i] * v[i] + dt * f);
+    });
+
+    build_preconditioner(dt, masses, model);
+
+    // preconditioned conjugate gradient on A v = rhs
+    residual_.resize(n);
+    z_.resize(n);
+    direction_.resize(n);
+    Ad_.resize(n);
+    apply(dt, masses, model, v, Ad_);
+    parallel_assign([&](size_t i) { residual_[i] = rhs_[i] - Ad_[i]; });
+    project(residual_);
+    apply_preconditioner(residual_, z_);
+    direction_ = z_;
+
+    T rz = dot(residual_, z_);
+    T rhs_norm = std::sqrt(dot(rhs_, rhs_));
+    report.initial_residual = std::sqrt(dot(residual_, residual_));
+    report.residual = report.initial_residual;
+    T threshold = tolerance * (rhs_norm > 0 ? rhs_norm : T(1));
+
+    while (report.residual > threshold && report.iterations < max_iterations) {
+      apply(dt, masses, model, direction_, Ad_);
+      project(Ad_);
+      T dAd = dot(direction_, Ad_);
+      if (dAd <= 0) {
+        META_WARN("implicit solve: non positive curvature {} at iteration {}", dAd,
+                  report.iterations);
+        break;
+      }
+      T alpha = rz / dAd;
+      parallel_assign([&](size_t i) {
+        v[i] += alpha * direction_[i];
+        residual_[i] -= alpha * Ad_[i];
+      });
+      apply_preconditioner(residual_, z_);
+      T rz_new = dot(residual_, z_);
+      T beta = rz_new / rz;
+      rz = rz_new;
+      parallel_assign([&](size_t i) { direction_[i] = z_[i] + beta * direction_[i]; });
+      report.residual = std::sqrt(dot(residual_, residual_));
+      report.iterations++;
+    }
+    report.converged = report.residual <= threshold;
+
+    if (write_log) {
+      META_INFO("implicit solve: {} nodes, {} iterations, residual {:.3e} -> {:.3e}{}",
+                n,
+                report.iterations,
+                report.initial_residual,
+                report.residual,
+                report.converged ? "" : " (not converged)");
+    }
+    return report;
+  }
+
+  // out = M u + dt^2 H u
+  template<typename TModel>
+  void apply(T dt, const std::vector<T>& masses, const TModel& model, const std::vector<TV>& u,
+             std::vector<TV>& out) {
+    // gather dF_p and scale by the stress differential
+    particle_dstress_.resize(num_particles_);
+    tbb::parallel_for(size_t(0), num_particles_, [&](size_t p) {
+      TM grad_u = TM::Zero();
+      for (int s = 0; s < stencil_size; s++) {
+        auto slot = p * stencil_size + s;
+        grad_u += u[stencil_node_[slot]] * stencil_grad_[slot].transpose();
+      }
+      const TM& F = particle_F_[p];
+      TM dP = model.first_piola_differential(F, TM(grad_u * F));
+      particle_dstress_[p] = particle_volume_[p] * dP * F.transpose();
+    });
+
+    T dt2 = dt * dt;
+    tbb::parallel_for(size_t(0), active_count_, [&](size_t i) {
+      TV Hu = TV::Zero();
+      for (auto k = node_begin_[i]; k < node_begin_[i + 1]; k++) {
+        auto slot = node_slots_[k];
+        Hu += particle_dstress_[slot / stencil_size] * stencil_grad_[slot];
+      }
+      out[i] = masses[i] * u[i] + dt2 * Hu;
+    });
+  }
+
+private:
+  template<typename OP>
+  static void for_each_offset(OP op) {
+    if constexpr (Dim == 2) {
+      for (int i = 0; i < stencil_width; i++)
+        for (int j = 0; j < stencil_width; j++) op(TVI(i, j));
+    } else {
+      for (int i = 0; i < stencil_width; i++)
+        for (int j = 0; j < stencil_width; j++)
+          for (int k = 0; k < stencil_width; k++) op(TVI(i, j, k));
+    }
+  }
+
+  // counting sort of stencil slots by node, node_slots_[node_begin_[i], node_begin_[i + 1])
+  void build_transpose() {
+    node_begin_.assign(active_count_ + 1, 0);
+    for (auto node : stencil_node_) node_begin_[node + 1]++;
+    for (size_t i = 0; i < active_count_; i++) node_begin_[i + 1] += node_begin_[i];
+    node_slots_.resize(stencil_node_.size());
+    std::vector<size_t> cursor(node_begin_.begin(), node_begin_.end() - 1);
+    for (size_t slot = 0; slot < stencil_node_.size(); slot++) {
+      node_slots_[cursor[stencil_node_[slot]]++] = slot;
+    }
+  }
+
+  // diagonal blocks of M + dt^2 H, H_ii = sum_p V_p dP(F; e_d grad_w^T F) F^T grad_w
+  template<typename TModel>
+  void build_preconditioner(T dt, const std::vector<T>& masses, const TModel& model) {
+    if (preconditioner == Preconditioner::None) return;
+    diag_inv_.resize(active_count_);
+    T dt2 = dt * dt;
+    tbb::parallel_for(size_t(0), active_count_, [&](size_t i) {
+      TM block = masses[i] * TM::Identity();
+      for (auto k = node_begin_[i]; k < node_begin_[i + 1]; k++) {
+        auto slot = node_slots_[k];
+        auto p = slot / stencil_size;
+        const TM& F = particle_F_[p];
+        const TV& grad = stencil_grad_[slot];
+        TV FTg = F.transpose() * grad;
+        for (int d = 0; d < Dim; d++) {
+          TM dF = TV::Unit(d) * FTg.transpose();
+          block.col(d) += dt2 * particle_volume_[p] * model.first_piola_differential(F, dF) * FTg;
+        }
+      }
+      if (preconditioner == Preconditioner::BlockJacobi) {
+        diag_inv_[i] = block.inverse();
+      } else {
+        diag_inv_[i] = block.diagonal().cwiseInverse().asDiagonal();
+      }
+      if (dirichlet_[i] || !diag_inv_[i].allFinite()) diag_inv_[i].setZero();
+    });
+  }
+
+  // r is projected already, so without a preconditioner z = r
+  void apply_preconditioner(const std::vector<TV>& r, std::vector<TV>& z) {
+    if (preconditioner == Preconditioner::None) {
+      parallel_assign([&](size_t i) { z[i] = r[i]; });
+    } else {
+      parallel_assign([&](size_t i) { z[i] = diag_inv_[i] * r[i]; });
+    }
+  }
+
+  void project(std::vector<TV>& u) {
+    parallel_assign([&](size_t i) {
+      if (dirichlet_[i]) u[i].setZero();
+    });
+  }
+
+  template<typename OP>
+  void parallel_assign(OP op) {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, active_count_),
+                      [&](const tbb::blocked_range<size_t>& r) {
+                        for (auto i = r.begin(); i != r.end(); i++) op(i);
+                      });
+  }
+
+  T dot(const std::vector<TV>& a, const std::vector<TV>& b) const {
+    return tbb::parallel_reduce(
+      tbb::blocked_range<size_t>(0, active_count_),
+      T(0),
+      [&](const tbb::blocked_range<size_t>& r, T sum) {
+        for (auto i = r.begin(); i != r.end(); i++) sum += a[i].dot(b[i]);
+        return sum;
+      },
+      std::plus<T>());
+  }
+
+private:
+  size_t active_count_{0};
+  size_t num_particles_{0};
+  T inv_dx_{1};
+
+  std::vector<int> compact_of_;
+  // per particle stencil, indexed by p * stencil_size + s
+  std::vector<int> stencil_node_;
+  std::vector<TV> stencil_grad_;
+  // transpose of the stencils
+  std::vector<size_t> node_begin_;
+  std::vector<size_t> node_slots_;
+  std::vector<char> dirichlet_;
+
+  std::vector<TM> particle_F_, particle_stress_, particle_dstress_;
+  std::vector<T> particle_volume_;
+  std::vector<TM> diag_inv_;
+  std::vector<TV> rhs_, residual_, z_, direction_, Ad_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_MPM_IMPLICIT_SOLVER_HPP
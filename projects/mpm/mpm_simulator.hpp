@@ -5,17 +5,22 @@
 #ifndef METASIM_MPM_SIMULATOR_HPP
 #define METASIM_MPM_SIMULATOR_HPP
 
+#include "Math/mesh_collider.hpp"
 #include "core/meta.hpp"
 #include "core/simulator.hpp"
 #include "mpm_grid.hpp"
+#include "mpm_implicit_solver.hpp"
+#include <memory>
 
 namespace MS {
 
-template<typename T, int Dim>
+// T: particle scalar, TG: grid scalar used by transfers and kernel weights
+template<typename T, int Dim, typename TG = T>
 class MPMSimulator : public Simulator<T, Dim> {
 public:
   using TV = Vec<Dim, T>;
   using TVI = Vec<Dim, int>;
+  using TGV = Vec<Dim, TG>;
 
   using Base = Simulator<T, Dim>;
   using Base::dt;
@@ -24,11 +29,115 @@ public:
   virtual void advance_frame() override;
   virtual void advance_step() override;
 
+  /*
+   * grid velocity update of a step, after P2G and IterateAllGridWithCheck; velocities
+   * holds those of the active nodes. When implicit is set they are v* after external
+   * forces only and solved for backward Euler, elastic forces are part of the solve
+   * (explicit steps have applied them in P2G already). grid_colliders act on the result.
+   */
+  template<typename TGridData, typename TModel, typename TPositions, typename TDeformation,
+           typename TVolumes>
+  void update_grid_velocities(MPMGrid<TGridData, Dim, TG>& grid, T dx,
+                              const TPositions& positions, const TDeformation& deformation,
+                              const TVolumes& volumes, const TModel& model,
+                              const std::vector<T>& masses, std::vector<TV>& velocities);
+
+  /*
+   * grid update boundary conditions: nodes inside a collider take its velocity in the
+   * normal direction (or entirely when sticky), tangential slip is reduced by Coulomb
+   * friction, separating nodes are left untouched; colliders are searched for within
+   * collision_band * dx of the nodes only
+   */
+  template<typename TNodePositions, typename TVelocities>
+  void collide_grid(const TNodePositions& positions, TVelocities& velocities, T dx) const;
+
 public:
   T cfl;
+  // larger steps than the CFL limit of explicit elasticity allows, see update_grid_velocities
+  bool implicit{false};
+  MPMImplicitSolver<T, Dim, QuadraticKernel<Dim, TG>> implicit_solver;
+
+  struct GridCollider {
+    std::shared_ptr<MeshCollider<T>> collider;
+    T friction{0};
+    bool sticky{false};
+  };
+  std::vector<GridCollider> grid_colliders;
+  // in dx, nodes farther from every collider surface are not searched
+  T collision_band{3};
 
 public:
 };
+
+template<typename T, int Dim, typename TG>
+template<typename TGridData, typename TModel, typename TPositions, typename TDeformation,
+         typename TVolumes>
+void MPMSimulator<T, Dim, TG>::update_grid_velocities(MPMGrid<TGridData, Dim, TG>& grid, T dx,
+                                                      const TPositions& positions,
+                                                      const TDeformation& deformation,
+                                                      const TVolumes& volumes,
+                                                      const TModel& model,
+                                                      const std::vector<T>& masses,
+                                                      std::vector<TV>& velocities) {
+  if (implicit) {
+    META_PROFILE_SCOPE("implicit_solve");
+    implicit_solver.write_log = this->write_log;
+    implicit_solver.build(grid, positions, dx);
+    implicit_solver.solve(dt, masses, deformation, volumes, model, velocities);
+  }
+  if constexpr (Dim == 3) {
+    if (grid_colliders.empty()) return;
+    META_PROFILE_SCOPE("collide_grid");
+    auto& active = grid.ActiveIndices();
+    TransientVector<TV> nodes(active.size(), TV::Zero(), Allocator<TV>(this->step_arena));
+    tbb::parallel_for(size_t(0), active.size(), [&](size_t i) {
+      nodes[i] = grid.Coord(active[i]).template cast<T>() * dx;
+    });
+    collide_grid(nodes, velocities, dx);
+  }
+}
+
+template<typename T, int Dim, typename TG>
+template<typename TNodePositions, typename TVelocities>
+void MPMSimulator<T, Dim, TG>::collide_grid(const TNodePositions& positions,
+                                            TVelocities& velocities, T dx) const {
+  static_assert(Dim == 3, "mesh colliders need Dim == 3");
+  using Contact = typename MeshCollider<T>::Contact;
+  using TNodeV = typename TVelocities::value_type;
+  // buffers of this step on the step arena, steady state steps do not touch the heap
+  TransientVector<TV> x(positions.size(), TV::Zero(), Allocator<TV>(this->step_arena));
+  TransientVector<Contact> contacts(positions.size(), Contact(),
+                                    Allocator<Contact>(this->step_arena));
+  tbb::parallel_for(size_t(0), x.size(), [&](size_t i) {
+    x[i] = positions[i].template cast<T>();
+  });
+
+  for (auto& [collider, friction, sticky] : grid_colliders) {
+    collider->query(x.data(), x.size(), contacts.data(), collision_band * dx);
+    tbb::parallel_for(size_t(0), x.size(), [&, friction = friction, sticky = sticky](size_t i) {
+      const auto& contact = contacts[i];
+      if (contact.face < 0 || contact.phi > 0) return;
+      TV v_rel = velocities[i].template cast<T>() - contact.velocity;
+      TV v_new;
+      if (sticky) {
+        v_new = contact.velocity;
+      } else {
+        T vn = v_rel.dot(contact.normal);
+        if (vn >= 0) return;
+        TV vt = v_rel - vn * contact.normal;
+        T vt_norm = vt.norm();
+        if (vt_norm > 0) vt *= std::max(T(0), 1 + friction * vn / vt_norm);
+        v_new = contact.velocity + vt;
+      }
+      velocities[i] = v_new.template cast<typename TNodeV::Scalar>();
+    });
+  }
+}
+
+// MPMSimulator with scalar types taken from a Precision policy
+template<typename TPrecision, int Dim>
+using MPMSimulatorWith =
+  MPMSimulator<typename TPrecision::particle_type, Dim, typename TPrecision::grid_type>;
 }   // namespace MS
 
 #endif   // METASIM_MPM_SIMULATOR_HPP
@@ -0,0 +1,152 @@
+#ifndef METASIM_BATCH_RUNNER_HPP
+#define METASIM_BATCH_RUNNER_HPP
+
+#include "Core/pool_resource.hpp"
+#include "core/simulator.hpp"
+#include "Utils/logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Runs many small independent scenes (parameter sweeps, data generation)
+ *
+ * Each scene gets an isolated task_arena sized to its work (work_items() /
+ * items_per_thread threads), so a small scene no longer spreads tiny loops over the
+ * whole machine; scenes are spread over the threads largest first.
+ * In interleaved mode every scene advances one frame per round, the scenes finish
+ * together instead of one after another (e.g. for streaming training data).
+ * Scenes created with the runner's memory pool share storage with each other, see
+ * DataContainer::resource.
+ */
+template<typename T, int Dim>
+class BatchRunner {
+public:
+  using simulator_t = Simulator<T, Dim>;
+
+  enum class Mode { arenas, interleaved };
+
+  struct Statistics {
+    size_t scenes, frames, steps;
+    double seconds;
+    double scene_steps_per_second() const { return seconds > 0 ? steps / seconds : 0; }
+    double frames_per_second() const { return seconds > 0 ? frames / seconds : 0; }
+  };
+
+  Mode mode{Mode::arenas};
+  // particles (work_items) one thread of a scene's arena is sized for
+  size_t items_per_thread{16384};
+  int max_threads{tbb::this_task_arena::max_concurrency()};
+  bool write_log{true};
+  // pool for the DataContainers of the scenes
+  std::shared_ptr<PoolResource> memory{std::make_shared<PoolResource>()};
+
+  // scenes keep their output but record no profiler zones and write no profiler report,
+  // the runner logs its own statistics
+  void add(std::unique_ptr<simulator_t> scene, int frames) {
+    scene->set_timer = false;
+    scenes_.push_back({std::move(scene), frames});
+  }
+
+  size_t size() const { return scenes_.size(); }
+  simulator_t& scene(size_t i) { return *scenes_[i].simulator; }
+
+  // run every scene for its frames and drop them, the pool keeps their storage
+  Statistics run() {
+    auto begin = std::chrono::steady_clock::now();
+    // also when another simulator turned the profiler on, scenes would fill its buffers
+    bool profiling = Profiler::enabled();
+    Profiler::set_enabled(false);
+    std::vector<Scene*> order;
+    for (auto& scene : scenes_) {
+      size_t threads = (scene.simulator->work_items() + items_per_thread - 1) / items_per_thread;
+      scene.concurrency = int(std::clamp<size_t>(threads, 1, size_t(max_threads)));
+      scene.arena = std::make_unique<tbb::task_arena>(scene.concurrency);
+      scene.steps = scene.simulator->step_cnt;
+      order.push_back(&scene);
+    }
+    std::stable_sort(order.begin(), order.end(), [](auto a, auto b) {
+      return a->simulator->work_items() > b->simulator->work_items();
+    });
+
+    auto advance = [](Scene& scene, int frames) {
+      scene.arena->execute([&] {
+        for (int f = 0; f < frames; f++) scene.simulator->simulate_frame();
+      });
+      scene.done += frames;
+    };
+    tbb::task_arena arena(max_threads);
+    arena.execute([&] {
+      if (mode == Mode::arenas) {
+        tbb::parallel_for(
+          tbb::blocked_range<size_t>(0, order.size(), 1),
+          [&](const auto& range) {
+            for (auto i = range.begin(); i < range.end(); i++) {
+              advance(*order[i], order[i]->frames);
+            }
+          },
+          tbb::simple_partitioner());
+      } else {
+        for (bool pending = true; pending;) {
+          std::vector<Scene*> round;
+          for (auto scene : order) {
+            if (scene->done < scene->frames) round.push_back(scene);
+          }
+          pending = !round.empty();
+          tbb::parallel_for(
+            tbb::blocked_range<size_t>(0, round.size(), 1),
+            [&](const auto& range) {
+              for (auto i = range.begin(); i < range.end(); i++) advance(*round[i], 1);
+            },
+            tbb::simple_partitioner());
+        }
+      }
+    });
+
+    Statistics statistics{scenes_.size(), 0, 0, 0};
+    for (auto& scene : scenes_) {
+      statistics.frames += scene.done;
+      statistics.steps += scene.simulator->step_cnt - scene.steps;
+    }
+    scenes_.clear();
+    Profiler::set_enabled(profiling);
+    statistics.seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    if (write_log) {
+      auto pool = memory->statistics();
+      META_INFO("batch: {} scenes, {} frames, {} steps in {:.3f} s, {:.1f} scene-steps/s, "
+                "pool {:.1f} MB, {} hits, {} misses",
+                statistics.scenes,
+                statistics.frames,
+                statistics.steps,
+                statistics.seconds,
+                statistics.scene_steps_per_second(),
+                pool.bytes_pooled / 1e6,
+                pool.hits,
+                pool.misses);
+    }
+    return statistics;
+  }
+
+private:
+  struct Scene {
+    std::unique_ptr<simulator_t> simulator;
+    int frames;
+    int done{0};
+    int concurrency{1};
+    int steps{0};
+    std::unique_ptr<tbb::task_arena> arena;
+  };
+
+  std::vector<Scene> scenes_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_BATCH_RUNNER_HPP
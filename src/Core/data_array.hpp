@@ -1,14 +1,54 @@
 #ifndef METASIM_DATA_ARRAY_HPP
 #define METASIM_DATA_ARRAY_HPP
 
+#include "Core/memory_resource.hpp"
 #include "Core/range_set.hpp"
 #include "Utils/logger.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <memory>
 #include <string>
 #include <type_traits>
 #include <vector>
 
 namespace MS {
+
+// portable element type description, e.g. "f4", "i4", "f8x3", "f4x3x3", "b24" for opaque bytes
+template<typename Type>
+struct ElementType {
+  static std::string name() {
+    if constexpr (std::is_floating_point_v<Type>) {
+      return "f" + std::to_string(sizeof(Type));
+    } else if constexpr (std::is_integral_v<Type> && std::is_signed_v<Type>) {
+      return "i" + std::to_string(sizeof(Type));
+    } else if constexpr (std::is_integral_v<Type>) {
+      return "u" + std::to_string(sizeof(Type));
+    } else {
+      return "b" + std::to_string(sizeof(Type));
+    }
+  }
+};
+
+template<typename Scalar, int Rows, int Cols, int Options, int MaxRows, int MaxCols>
+struct ElementType<Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows, MaxCols>> {
+  static std::string name() {
+    static_assert(Rows > 0 && Cols > 0, "only fixed size matrices are stored inline");
+    auto result = ElementType<Scalar>::name() + "x" + std::to_string(Rows);
+    return Cols == 1 ? result : result + "x" + std::to_string(Cols);
+  }
+};
+
+/*
+ * storage of an array holding uniform ranges: entries of ranges[i] start at
+ * data[offsets[i]], a uniform range keeps a single value for all its entries
+ */
+struct RangeLayout {
+  std::vector<size_t> offsets;
+  std::vector<uint8_t> uniform;
+};
+
 class DataArrayBase {
 public:
   std::string name;
@@ -16,12 +56,59 @@ public:
   DataArrayBase(const std::string& name, const RangeSet& ranges)
     : name(name)
     , ranges(ranges) {}
+  virtual ~DataArrayBase() = default;
+
+  // type erased storage, for consumers that only move bytes (file io, checkpoints), dense
+  // (uniform ranges are materialized); the mutable overload counts as a write
+  virtual const void* raw_data() const = 0;
+  virtual void* raw_data() = 0;
+  virtual void raw_resize(size_t element_count) = 0;
+  virtual size_t element_size() const = 0;
+  virtual size_t element_count() const = 0;
+  virtual std::string element_type() const = 0;
+  size_t raw_bytes() const { return element_size() * element_count(); }
+  // storage actually held (uniform ranges keep one entry) and allocated, with the ranges
+  virtual size_t bytes_used() const = 0;
+  virtual size_t bytes_reserved() const = 0;
+  // move the storage to resource (null for the heap), e.g. a cold attribute to a
+  // SpillResource; data pointers taken before are invalid
+  virtual void relocate(std::shared_ptr<MemoryResource> resource) = 0;
+
+  // storage as held, uniform ranges once each, never materialized: for read only
+  // consumers that don't need entries (placement reports, paging hints, snapshots)
+  virtual const void* stored_data() const = 0;
+  virtual size_t stored_count() const = 0;
+  size_t stored_bytes() const { return element_size() * stored_count(); }
+  // null for dense storage
+  virtual const RangeLayout* stored_layout() const = 0;
+  // storage for count stored entries laid out by layout (null for dense) over ranges, for
+  // the caller to fill, e.g. restoring a snapshot; kept entries keep their values
+  virtual void* assign_storage(const RangeSet& ranges, const RangeLayout* layout,
+                               size_t count) = 0;
+
+  // bumped by writes through DataArray and DataContainer (append, Subset, mutable
+  // raw_data() and begin(), ...), not by reads; code writing through a kept reference to
+  // data should touch() the array once per modification pass
+  uint64_t version{0};
+  void touch() { version++; }
+
+  // stamp of the current ranges, unique over all arrays, so cached subsets (see
+  // DataContainer::common_ranges) notice new ranges; code assigning ranges directly
+  // calls ranges_changed()
+  uint64_t ranges_version{next_ranges_version()};
+  void ranges_changed() { ranges_version = next_ranges_version(); }
+
+private:
+  static uint64_t next_ranges_version() {
+    static std::atomic<uint64_t> counter{0};
+    return ++counter;
+  }
 };
 
 template<typename Type>
 class DataArrayIterator;
 
-template<typename Type, typename A = std::allocator<Type>>
+template<typename Type, typename A = Allocator<Type>>
 class DataArray : public DataArrayBase {
 public:
   // using iterator = DataArrayIterator<Type>;
@@ -34,35 +121,200 @@ public:
   using size_type = size_t;
 
   using iterator = DataArrayIterator<Type>;
-  using const_iterator = DataArrayIterator<Type>;
+  using const_iterator = DataArrayIterator<const Type>;
 
   using DataArrayBase::name;
   using DataArrayBase::ranges;
   std::vector<Type, A> data;
 
-  DataArray(const std::string& name, const RangeSet& ranges, std::vector<Type>&& array)
+  DataArray(const std::string& name, const RangeSet& ranges, std::vector<Type, A>&& array)
     : DataArrayBase(name, ranges)
     , data(std::move(array)) {}
 
+  template<typename OtherA, typename = std::enable_if_t<!std::is_same_v<OtherA, A>>>
+  DataArray(const std::string& name, const RangeSet& ranges, std::vector<Type, OtherA>&& array)
+    : DataArrayBase(name, ranges)
+    , data(std::make_move_iterator(array.begin()), std::make_move_iterator(array.end())) {}
+
+  // adopt count entries handed out by resource as they are, e.g. a mapped file section
+  DataArray(const std::string& name, const RangeSet& ranges,
+            std::shared_ptr<MemoryResource> resource, size_t count)
+    : DataArrayBase(name, ranges)
+    , data(A(std::move(resource))) {
+    static_assert(std::is_trivially_destructible_v<Type>, "adopted storage must be plain bytes");
+    data.resize(count);
+  }
+
+  // raw bytes are dense, so byte consumers (file output, checkpoints) materialize
+  // uniform ranges; arrays are never const objects, the const overload may do so too
+  const void* raw_data() const override {
+    if (layout) const_cast<DataArray*>(this)->materialize();
+    return data.data();
+  }
+  void* raw_data() override {
+    touch();
+    if (layout) materialize();
+    return data.data();
+  }
+  void raw_resize(size_t count) override {
+    touch();
+    if (layout) materialize();
+    data.resize(count);
+  }
+  size_t element_size() const override { return sizeof(Type); }
+  size_t element_count() const override { return layout ? size_t(ranges.length()) : data.size(); }
+  std::string element_type() const override { return ElementType<Type>::name(); }
+  size_t bytes_used() const override {
+    size_t bytes = data.size() * sizeof(Type) + ranges.ranges.size() * sizeof(Range);
+    if (layout) bytes += layout->offsets.size() * (sizeof(size_t) + sizeof(uint8_t));
+    return bytes;
+  }
+  size_t bytes_reserved() const override {
+    size_t bytes = data.capacity() * sizeof(Type) + ranges.ranges.capacity() * sizeof(Range);
+    if (layout) bytes += layout->offsets.capacity() * sizeof(size_t) + layout->uniform.capacity();
+    return bytes;
+  }
+  void relocate(std::shared_ptr<MemoryResource> resource) override {
+    if constexpr (std::is_constructible_v<A, std::shared_ptr<MemoryResource>>) {
+      touch();
+      std::vector<Type, A> moved(A(std::move(resource)));
+      moved.assign(std::make_move_iterator(data.begin()), std::make_move_iterator(data.end()));
+      data = std::move(moved);
+    } else {
+      META_ERROR("{}: the allocator of this array takes no memory resource", name);
+    }
+  }
+  const void* stored_data() const override { return data.data(); }
+  size_t stored_count() const override { return data.size(); }
+  const RangeLayout* stored_layout() const override { return layout.get(); }
+  void* assign_storage(const RangeSet& new_ranges, const RangeLayout* new_layout,
+                       size_t count) override {
+    touch();
+    data.resize(count);
+    if (!new_layout) {
+      layout.reset();
+    } else if (!layout || layout->offsets != new_layout->offsets ||
+               layout->uniform != new_layout->uniform) {
+      layout = std::make_unique<RangeLayout>(*new_layout);
+    }
+    if (ranges.ranges != new_ranges.ranges) {
+      ranges = new_ranges;
+      ranges_changed();
+    }
+    return data.data();
+  }
+
   // auto cbegin() const { return const_iterator(data0, 0); }
   // auto cend() const { return const_iterator(*this, -1); }
-  auto begin() { return iterator(data.begin(), ranges.begin(), 0); }
+  // mutable iteration counts as a write, uniform ranges get their own storage; read
+  // through a const array to keep them
+  auto begin() {
+    touch();
+    if (layout) materialize();
+    return make_iterator(false);
+  }
   auto end() {
-    // auto prev_ranges_end = std::prev(ranges.end());
-    return iterator(data.end(), ranges.end(), 0);
+    if (layout) materialize();
+    return make_iterator(true);
+  }
+  auto begin() const { return make_iterator(false); }
+  auto end() const { return make_iterator(true); }
+  auto size() const { return element_count(); }
+
+  // uniform ranges, O(1) memory each until something writes to them
+  std::unique_ptr<RangeLayout> layout;
+
+  // iterators as the storage is, for subsets that materialized what they write
+  iterator make_iterator(bool at_end) { return iterator_at<Type>(data.data(), at_end); }
+  const_iterator make_iterator(bool at_end) const {
+    return iterator_at<const Type>(data.data(), at_end);
   }
-  auto begin() const { return const_iterator(data.begin(), ranges.begin(), 0); }
-  auto end() const {
-    // auto prev_ranges_end = std::prev(ranges.end());
-    return iterator(data.end(), ranges.end(), 0);
+
+  bool is_uniform() const { return layout != nullptr; }
+
+  // value of entry, also for uniform ranges
+  const Type& value(int entry) const {
+    if (!layout) return data[ranges.query_offset(entry)];
+    auto iter = std::upper_bound(ranges.begin(), ranges.end(), Range{entry, entry + 1});
+    size_t i = std::prev(iter) - ranges.begin();
+    return data[layout->offsets[i] + (layout->uniform[i] ? 0 : entry - ranges[i].lower)];
+  }
+
+  // a range whose entries all hold value, stored once; range must follow all others
+  void append_uniform(const Range& range, const Type& value) {
+    touch();
+    if (!layout) {
+      layout = std::make_unique<RangeLayout>();
+      size_t offset = 0;
+      for (auto& r : ranges) {
+        layout->offsets.push_back(offset);
+        layout->uniform.push_back(0);
+        offset += r.length();
+      }
+    }
+    ranges.merge(range);
+    ranges_changed();
+    META_ASSERT(ranges.ranges.size() == layout->offsets.size() + 1,
+                "uniform range {} overlaps {}",
+                range.lower,
+                name);
+    layout->offsets.push_back(data.size());
+    layout->uniform.push_back(1);
+    data.push_back(value);
+  }
+
+  // give every entry of the uniform ranges meeting sub_ranges its own storage
+  void materialize(const RangeSet& sub_ranges) {
+    materialize_if([&](const Range& range) { return (sub_ranges & range).length() > 0; });
+  }
+  void materialize() {
+    materialize_if([](const Range&) { return true; });
+  }
+
+  // a no-op (storage and pointers into it kept) unless a uniform range meets predicate
+  template<typename Predicate>
+  void materialize_if(Predicate&& predicate) {
+    if (!layout) return;
+    bool needed = false;
+    for (size_t i = 0; i < layout->uniform.size() && !needed; i++) {
+      needed = layout->uniform[i] && predicate(ranges[i]);
+    }
+    if (!needed) return;
+    std::vector<Type, A> dense(data.get_allocator());
+    std::vector<size_t> offsets;
+    std::vector<uint8_t> uniform;
+    bool any_uniform = false;
+    for (size_t i = 0; i < ranges.ranges.size(); i++) {
+      auto& range = ranges[i];
+      auto first = data.begin() + layout->offsets[i];
+      offsets.push_back(dense.size());
+      bool expand = layout->uniform[i] && predicate(range);
+      if (layout->uniform[i] && !expand) {
+        dense.push_back(*first);
+        any_uniform = true;
+      } else if (expand) {
+        dense.insert(dense.end(), range.length(), *first);
+      } else {
+        dense.insert(dense.end(), first, first + range.length());
+      }
+      uniform.push_back(layout->uniform[i] && !expand);
+    }
+    data.swap(dense);
+    if (any_uniform) {
+      layout->offsets.swap(offsets);
+      layout->uniform.swap(uniform);
+    } else {
+      layout.reset();
+    }
   }
-  auto size() const { return data.size(); }
 
   // update values in range by data
   auto update(const Range& range, std::vector<Type>&& array) {
     // erase_range(range);
     // insert_data(merge())
     // intersections need to remove, and it is contiguous
+    touch();
+    if (layout) materialize();
     auto inter_ranges = ranges & range;
     if (inter_ranges.length()) {
       // if intersections exists, then remove them
@@ -74,13 +326,44 @@ public:
 
     int p_insert = ranges.query_offset(range.lower);
     ranges.merge(range);
+    ranges_changed();
   }
 
   auto append(const Range& range, std::vector<Type>&& array) {
+    touch();
+    if (layout) {
+      layout->offsets.push_back(data.size());
+      layout->uniform.push_back(0);
+    }
     ranges.merge(range);
+    ranges_changed();
     data.insert(
       data.end(), std::make_move_iterator(array.begin()), std::make_move_iterator(array.end()));
   }
+
+  // grow by range and return the storage of its entries, for producers writing in place
+  Type* extend(const Range& range) {
+    touch();
+    if (layout) {
+      layout->offsets.push_back(data.size());
+      layout->uniform.push_back(0);
+    }
+    ranges.merge(range);
+    ranges_changed();
+    auto offset = data.size();
+    data.resize(offset + range.length());
+    return data.data() + offset;
+  }
+
+private:
+  template<typename T>
+  DataArrayIterator<T> iterator_at(T* base, bool at_end) const {
+    auto& all = const_cast<RangeSet&>(ranges);
+    DataArrayIterator<T> result(
+      at_end ? base + data.size() : base, at_end ? all.end() : all.begin(), 0);
+    result.attach_layout(layout.get(), base, all.begin());
+    return result;
+  }
 };
 
 template<class T>
@@ -88,23 +371,35 @@ class DataArrayIterator {
 public:
   // iterator_traits definitions
   using iterator_category = std::bidirectional_iterator_tag;
-  using value_type = T;
+  using value_type = std::remove_const_t<T>;
   using reference = T&;
   using pointer = T*;
   using difference_type = ptrdiff_t;
 
-  typename std::vector<T>::iterator data_iter;
+  T* data_iter;
   RangeSet::iterator range_iter;
   difference_type entry_offset;
+  // arrays with uniform ranges: per range storage, data_iter stays put in a uniform range
+  const RangeLayout* layout{nullptr};
+  T* data_begin{nullptr};
+  RangeSet::iterator first_range;
+  int stride{1};
 
   DataArrayIterator() = default;
   DataArrayIterator(const DataArrayIterator&) = default;
-  DataArrayIterator(typename std::vector<T>::iterator data_iter, RangeSet::iterator range_iter,
-                    difference_type entry_offset)
+  DataArrayIterator(T* data_iter, RangeSet::iterator range_iter, difference_type entry_offset)
     : data_iter(data_iter)
     , range_iter(range_iter)
     , entry_offset(entry_offset) {}
 
+  // iterate an array with uniform ranges, data_begin and first_range start its storage
+  void attach_layout(const RangeLayout* range_layout, T* begin, RangeSet::iterator first) {
+    layout = range_layout;
+    data_begin = begin;
+    first_range = first;
+    if (layout) _sync_layout();
+  }
+
   bool operator==(const DataArrayIterator<T>& other) {
     return other.range_iter ==
                range_iter /*for compare begins, ends cause they have no legal entry()*/
@@ -112,7 +407,7 @@ public:
              : false;
   }
   bool operator!=(const DataArrayIterator<T>& other) {
-    return !operator==(*this, other);   // need other!=*this?
+    return !(*this == other);
   }
 
   bool operator<(const DataArrayIterator<T>& other) { return data_iter < other.data_iter; }
@@ -175,6 +470,7 @@ private:
     data_iter += offset;
     --range_iter;
     entry_offset = -1;
+    if (layout) _sync_layout();
     return offset;
   }
 
@@ -186,13 +482,23 @@ private:
     data_iter += offset;
     ++range_iter;
     entry_offset = 0;
+    if (layout) _sync_layout();
     return offset;
   }
 
+  // point data_iter at entry() of range_iter through the layout
+  void _sync_layout() {
+    size_t i = range_iter - first_range;
+    if (i >= layout->offsets.size()) return;
+    stride = layout->uniform[i] ? 0 : 1;
+    data_iter = data_begin + layout->offsets[i];
+    if (stride) data_iter += entry_offset < 0 ? range_iter->length() + entry_offset : entry_offset;
+  }
+
   inline void _to_entry_in_range(int _target_entry) { _move_in_range(_target_entry - entry()); }
 
   inline void _move_in_range(int _offset) {
-    data_iter += _offset;
+    data_iter += _offset * stride;
     entry_offset += _offset;
   }
 
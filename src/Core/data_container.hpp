@@ -2,7 +2,9 @@
 #define METASIM_DATA_CONTAINER_HPP
 
 #include "Core/data_array.hpp"
+#include "Core/forward.hpp"
 #include "Utils/logger.hpp"
+#include <array>
 #include <functional>
 #include <set>
 #include <tuple>
@@ -24,8 +26,38 @@ struct TypeTag {
   TypeTag(const std::string& type_name)
     : type_name(type_name)
     , type_hash(std::hash<std::string>()(type_name)) {}
+
+  // the read only tag of an attribute, see read_only()
+  template<typename U, typename = std::enable_if_t<std::is_same_v<T, const U>>>
+  TypeTag(const TypeTag<U>& tag)
+    : type_name(tag.type_name)
+    , type_hash(tag.type_hash) {}
+};
+
+// attr_tag for reading only in DataContainer::Subset, e.g. Subset(x_tag, read_only(mass_tag)):
+// its uniform ranges are read as they are stored and its version stays
+template<typename T>
+TypeTag<const T> read_only(const TypeTag<T>& attr_tag) {
+  return TypeTag<const T>(attr_tag);
+}
+
+// attribute tags of particle states in the particle scalar of a Precision policy,
+// e.g. PrecisionTags<MixedPrecision, 3>::vector("x") is a TypeTag<Vec<3, double>>
+template<typename TPrecision, int Dim>
+struct PrecisionTags {
+  using Scalar = typename TPrecision::particle_type;
+
+  static TypeTag<Scalar> scalar(const char* name) { return name; }
+  static TypeTag<Vec<Dim, Scalar>> vector(const char* name) { return name; }
+  static TypeTag<Mat<Dim, Dim, Scalar>> matrix(const char* name) { return name; }
 };
 
+// array behind a subset element type, const Type for read only access
+template<typename Type>
+using subset_array_t = std::conditional_t<std::is_const_v<Type>,
+                                          const DataArray<std::remove_const_t<Type>>,
+                                          DataArray<Type>>;
+
 // template <typename... Types> class DataContainerIterator;
 template<typename... Types>
 class DataSubset;
@@ -33,12 +65,18 @@ class DataSubset;
 template<typename... Types>
 class DataSubsetIterator;
 
+// sub_ranges given to DataSubset are already common to its arrays
+struct SubsetRanges {};
+constexpr SubsetRanges subset_ranges{};
+
 // Dataset for manifolds attributes
 class DataContainer {
 public:
   // number of entry
-  int total_size;
+  int total_size{0};
   std::unordered_map<size_t, std::unique_ptr<DataArrayBase>> dataset;
+  // storage of arrays created from now on, null for the heap (e.g. a pool shared by scenes)
+  std::shared_ptr<MemoryResource> resource;
 
   template<typename Type>
   DataArray<Type>& append(const TypeTag<Type>& attr_tag, const Range& range,
@@ -47,12 +85,20 @@ public:
   }
 
   // TODO: return optional references
+  // getting an array is no write, writes through it bump its version (see
+  // DataArrayBase::version)
   template<typename Type>
   DataArray<Type>& get_array(const TypeTag<Type>& attr_tag) {
     auto iter = dataset.find(attr_tag.type_hash);
     return static_cast<DataArray<Type>&>(*iter->second);
   }
 
+  template<typename Type>
+  const DataArray<Type>& get_array(const TypeTag<Type>& attr_tag) const {
+    auto iter = dataset.find(attr_tag.type_hash);
+    return static_cast<const DataArray<Type>&>(*iter->second);
+  }
+
   template<typename Type>
   DataArray<Type>& append(const TypeTag<Type>& attr_tag, const Range& range,
                           std::vector<Type>&& array) {
@@ -61,10 +107,9 @@ public:
 
     if (iter == dataset.end()) {
       // if attribute array not found
-      auto ret = dataset.emplace(
-        attr_tag.type_hash,
-        std::make_unique<DataArray<Type>>(attr_tag.type_name, RangeSet{range}, std::move(array)));
-      return static_cast<DataArray<Type>&>(*ret.first->second);
+      auto& created = create(attr_tag);
+      created.append(range, std::move(array));
+      return created;
     } else {
       // update data_array with range
       auto& old = static_cast<DataArray<Type>&>(*iter->second);
@@ -74,21 +119,139 @@ public:
     }
   }
 
+  // range of attr_tag holding value in every entry, stored once until written through
+  // Subset or raw access, e.g. material parameters shared by a whole emitted body
+  template<typename Type>
+  DataArray<Type>& append_uniform(const TypeTag<Type>& attr_tag, const Range& range,
+                                  const Type& value) {
+    total_size = std::max(range.upper, total_size);
+    auto iter = dataset.find(attr_tag.type_hash);
+    auto& array = iter == dataset.end() ? create(attr_tag)
+                                        : static_cast<DataArray<Type>&>(*iter->second);
+    array.append_uniform(range, value);
+    return array;
+  }
+
+  // reserve range for attr_tag and return its storage, the caller fills range.length() values
+  template<typename Type>
+  Type* allocate(const TypeTag<Type>& attr_tag, const Range& range) {
+    total_size = std::max(range.upper, total_size);
+    auto iter = dataset.find(attr_tag.type_hash);
+    auto& array = iter == dataset.end() ? create(attr_tag)
+                                        : static_cast<DataArray<Type>&>(*iter->second);
+    return array.extend(range);
+  }
+
+  // put array under attr_tag, replacing any existing one, e.g. an array adopting file storage
+  template<typename Type>
+  DataArray<Type>& insert(const TypeTag<Type>& attr_tag, std::unique_ptr<DataArray<Type>> array) {
+    if (!array->ranges.empty()) total_size = std::max(array->ranges.back().upper, total_size);
+    auto& slot = dataset[attr_tag.type_hash];
+    slot = std::move(array);
+    return static_cast<DataArray<Type>&>(*slot);
+  }
+
+  // empty array of attr_tag on resource
+  template<typename Type>
+  DataArray<Type>& create(const TypeTag<Type>& attr_tag) {
+    auto& slot = dataset[attr_tag.type_hash];
+    slot = std::make_unique<DataArray<Type>>(
+      attr_tag.type_name, RangeSet{}, std::vector<Type, Allocator<Type>>(Allocator<Type>(resource)));
+    return static_cast<DataArray<Type>&>(*slot);
+  }
+
+  // move the storage of attr_tag to resource (null for the heap), e.g. a cold attribute to
+  // a SpillResource, false without such an array
+  template<typename Type>
+  bool relocate(const TypeTag<Type>& attr_tag, std::shared_ptr<MemoryResource> resource) {
+    auto iter = dataset.find(attr_tag.type_hash);
+    if (iter == dataset.end()) {
+      META_ERROR("no attribute {} to relocate", attr_tag.type_name);
+      return false;
+    }
+    iter->second->relocate(std::move(resource));
+    return true;
+  }
+
   //  template <typename... Types>
   //  DataContainerIterator<Types...>
   //  SubsetIterator(const TypeTag<Types> &...tags) {
   //    return DataContainerIterator<Types...>(get_array(tags)...);
   //  }
 
+  /*
+   * subsets write their arrays: uniform ranges they cover get their own storage and the
+   * versions move; arrays of read_only() tags are read as stored, a uniform range yields
+   * its one value for every entry
+   */
   template<typename... Types>
   DataSubset<Types...> Subset(const TypeTag<Types>&... tags) {
-    return {get_array(tags)...};
+    DataSubset<Types...> subset{subset_ranges, common_ranges(tags...), subset_array(tags)...};
+    subset.materialize();
+    return subset;
   }
 
   template<typename... Types>
   DataSubset<Types...> Subset(const RangeSet& sub_ranges, const TypeTag<Types>&... tags) {
-    return {sub_ranges, get_array(tags)...};
+    DataSubset<Types...> subset{
+      subset_ranges, RangeSet(sub_ranges, common_ranges(tags...)), subset_array(tags)...};
+    subset.materialize();
+    return subset;
+  }
+
+  // read only subset, leaves uniform ranges and versions as they are
+  template<typename... Types>
+  DataSubset<const Types...> View(const TypeTag<Types>&... tags) const {
+    return {subset_ranges, common_ranges(tags...), get_array(tags)...};
+  }
+
+  template<typename... Types>
+  DataSubset<const Types...> View(const RangeSet& sub_ranges,
+                                  const TypeTag<Types>&... tags) const {
+    return {subset_ranges, RangeSet(sub_ranges, common_ranges(tags...)), get_array(tags)...};
+  }
+
+  /*
+   * intersection of the ranges of the arrays of tags, memoized per tag combination
+   * until one of the arrays is replaced or its ranges_version moves (append, extend, ...)
+   * not thread-safe, like every other access of the container
+   */
+  template<typename... Types>
+  const RangeSet& common_ranges(const TypeTag<Types>&... tags) const {
+    size_t key = 0;
+    ((key ^= tags.type_hash + 0x9E3779B97F4A7C15ull + (key << 6) + (key >> 2)), ...);
+    std::array<const DataArrayBase*, sizeof...(Types)> arrays{
+      dataset.find(tags.type_hash)->second.get()...};
+
+    auto& entry = subset_cache_[key];
+    bool valid = entry.arrays.size() == arrays.size();
+    for (size_t i = 0; valid && i < arrays.size(); i++) {
+      valid = entry.arrays[i] == arrays[i] && entry.versions[i] == arrays[i]->ranges_version;
+    }
+    if (!valid) {
+      entry.arrays.assign(arrays.begin(), arrays.end());
+      entry.versions.clear();
+      entry.ranges = arrays[0]->ranges;
+      for (auto array : arrays) {
+        entry.versions.push_back(array->ranges_version);
+        if (array != arrays[0]) entry.ranges = RangeSet(entry.ranges, array->ranges);
+      }
+    }
+    return entry.ranges;
   }
+
+private:
+  template<typename Type>
+  subset_array_t<Type>& subset_array(const TypeTag<Type>& attr_tag) {
+    return static_cast<subset_array_t<Type>&>(*dataset.find(attr_tag.type_hash)->second);
+  }
+
+  struct SubsetCacheEntry {
+    std::vector<const DataArrayBase*> arrays;
+    std::vector<uint64_t> versions;
+    RangeSet ranges;
+  };
+  mutable std::unordered_map<size_t, SubsetCacheEntry> subset_cache_;
 };
 
 
@@ -96,8 +259,8 @@ public:
 template<typename... Types>
 class DataSubset {
 public:
-  using array_pack_reference = std::tuple<DataArray<Types>&...>;
-  using iterators_type = std::tuple<typename DataArray<Types>::iterator...>;
+  using array_pack_reference = std::tuple<subset_array_t<Types>&...>;
+  using iterators_type = std::tuple<DataArrayIterator<Types>...>;
   using size_type = std::size_t;
 
   using iterator = DataSubsetIterator<Types...>;
@@ -112,14 +275,18 @@ public:
 
   DataSubset() = default;
 
-  DataSubset(DataArray<Types>&... array_pack)
+  DataSubset(subset_array_t<Types>&... array_pack)
     : sub_ranges(array_pack.ranges...)
     , array_pack(array_pack...) {}
 
-  DataSubset(const RangeSet& sub_ranges, DataArray<Types>&... array_pack)
+  DataSubset(const RangeSet& sub_ranges, subset_array_t<Types>&... array_pack)
     : sub_ranges(sub_ranges, array_pack.ranges...)
     , array_pack(array_pack...) {}
 
+  DataSubset(SubsetRanges, const RangeSet& sub_ranges, subset_array_t<Types>&... array_pack)
+    : sub_ranges(sub_ranges)
+    , array_pack(array_pack...) {}
+
   // shrink
   DataSubset(const DataSubset& other) = default;
 
@@ -127,16 +294,24 @@ public:
     : sub_ranges(other.sub_ranges, tbb::split{})
     , array_pack(other.array_pack) {}
 
+  // expand the uniform ranges of the written arrays meeting sub_ranges
+  void materialize() {
+    std::apply([&](auto&... arrays) { (write(arrays), ...); }, array_pack);
+  }
+
   bool is_divisible() const { return sub_ranges.is_divisible(); }
   bool empty() const { return sub_ranges.empty(); }
   // split data_subset
   auto size() const { return sub_ranges.length(); }
 
+  // the arrays are already materialized where the subset writes
   auto array_pack_begins() {
-    return std::apply([](auto&&... args) { return iterators_type(args.begin()...); }, array_pack);
+    return std::apply([](auto&&... args) { return iterators_type(args.make_iterator(false)...); },
+                      array_pack);
   }
   auto array_pack_ends() {
-    return std::apply([](auto&&... args) { return iterators_type(args.end()...); }, array_pack);
+    return std::apply([](auto&&... args) { return iterators_type(args.make_iterator(true)...); },
+                      array_pack);
   }
 
 
@@ -155,10 +330,7 @@ public:
   // https://softwareengineering.stackexchange.com/questions/212344/is-it-bad-practice-to-make-an-iterator-that-is-aware-of-its-own-end
   template<class Op>
   void foreach_element(Op op) {
-    using iterators_type = std::tuple<typename DataArray<Types>::iterator...>;
-    using value_type = std::tuple<typename DataArray<Types>::reference...>;
-    iterators_type value_iters =
-      std::apply([](auto&&... args) { return iterators_type(args.begin()...); }, array_pack);
+    iterators_type value_iters = array_pack_begins();
 
     for (auto iter = sub_ranges.begin(); iter != sub_ranges.end(); ++iter) {
       for (auto entry = iter->lower; entry < iter->upper; ++entry) {
@@ -167,21 +339,30 @@ public:
       }
     }
   }
+
+private:
+  template<typename Type>
+  void write(DataArray<Type>& array) {
+    array.touch();
+    array.materialize(sub_ranges);
+  }
+  template<typename Type>
+  void write(const DataArray<Type>&) {}
 };
 
 template<typename... Types>
 class DataSubsetIterator {
 public:
-  using value_type = std::tuple<typename DataArray<Types>::value_type...>;
-  using reference = std::tuple<typename DataArray<Types>::reference...>;
-  using pointer = std::tuple<typename DataArray<Types>::pointer...>;
+  using value_type = std::tuple<std::remove_const_t<Types>...>;
+  using reference = std::tuple<Types&...>;
+  using pointer = std::tuple<Types*...>;
   using difference_type = ptrdiff_t;
   using iterator_category = std::bidirectional_iterator_tag;
 
   // for iterators' pack
   using size_type = size_t;
-  using arraies_pointer = typename std::tuple<DataArray<Types>&...>*;
-  using iterators_type = std::tuple<typename DataArray<Types>::iterator...>;
+  using arraies_pointer = typename std::tuple<subset_array_t<Types>&...>*;
+  using iterators_type = std::tuple<DataArrayIterator<Types>...>;
 
   difference_type entry_offset;
   RangeSet::iterator range_iter;
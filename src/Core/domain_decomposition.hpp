@@ -0,0 +1,333 @@
+#ifndef METASIM_DOMAIN_DECOMPOSITION_HPP
+#define METASIM_DOMAIN_DECOMPOSITION_HPP
+
+#include "Core/data_container.hpp"
+#include "Core/grid.hpp"
+#include "Utils/communicator.hpp"
+#include "Utils/logger.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Slabs of a grid over the ranks of a Communicator, for scenes above one node's memory
+ *
+ * The grid of shape nodes at lower + index * dx is cut into slabs of node planes along
+ * the first axis, the slowest in Grid::Index, so a plane is contiguous and halos move as
+ * single buffers. Every rank keeps its particles in its own DataContainer, and a local
+ * grid (local_shape()) of its planes plus halo planes on both sides. A particle belongs
+ * to the slab of the plane below it, halo must cover the planes its kernel reaches from
+ * there (2 for quadratic B-splines).
+ * A step runs: P2G into the local grid, accumulate_halos(), grid update of the owned
+ * planes, update_halos(), G2P and advection, redistribute(). redistribute() migrates
+ * particles that left the slab and every rebalance_interval-th call moves the slabs so
+ * the ranks hold about equal particle counts; the local grid has to be re-created when
+ * layout_version() changed.
+ * With a single rank all of it is a no-op, so the same step code runs unchanged.
+ */
+template<typename T, int Dim>
+class DomainDecomposition {
+public:
+  using TV = Vec<Dim, T>;
+
+  // rebalance on every rebalance_interval-th redistribute(), 0 for never
+  int rebalance_interval{0};
+  bool write_log{true};
+
+  DomainDecomposition(const TV& lower, T dx, const std::array<size_t, Dim>& shape, int halo = 2,
+                      Communicator& communicator = Communicator::world())
+    : communicator_(communicator)
+    , lower_(lower)
+    , dx_(dx)
+    , shape_(shape)
+    , halo_(halo) {
+    plane_nodes_ = 1;
+    for (int d = 1; d < Dim; d++) plane_nodes_ *= shape_[d];
+    int ranks = communicator_.size();
+    META_ASSERT(int(shape_[0]) >= ranks * halo_,
+                "{} planes can't give {} ranks {} planes each",
+                shape_[0],
+                ranks,
+                halo_);
+    // even slabs until the first rebalance
+    splits_.resize(ranks + 1);
+    for (int r = 0; r <= ranks; r++) splits_[r] = int(shape_[0] * r / ranks);
+  }
+
+  Communicator& communicator() { return communicator_; }
+  int rank() const { return communicator_.rank(); }
+  int size() const { return communicator_.size(); }
+
+  // planes owned by this rank
+  int begin() const { return splits_[rank()]; }
+  int end() const { return splits_[rank() + 1]; }
+  // planes of the local grid, the owned ones and the halos
+  int local_begin() const { return std::max(begin() - halo_, 0); }
+  int local_end() const { return std::min(end() + halo_, int(shape_[0])); }
+  std::array<size_t, Dim> local_shape() const {
+    auto shape = shape_;
+    shape[0] = local_end() - local_begin();
+    return shape;
+  }
+  // global node of the local node 0
+  int local_offset() const { return local_begin(); }
+  const std::vector<int>& splits() const { return splits_; }
+  int layout_version() const { return layout_version_; }
+
+  int plane(const TV& x) const {
+    return std::clamp(int(std::floor((x(0) - lower_(0)) / dx_)), 0, int(shape_[0]) - 1);
+  }
+  int owner(const TV& x) const {
+    return int(std::upper_bound(splits_.begin() + 1, splits_.end() - 1, plane(x)) -
+               (splits_.begin() + 1));
+  }
+  bool owns(const TV& x) const { return owner(x) == rank(); }
+
+  template<typename TGridData>
+  void initialize_grid(Grid<TGridData, Dim, T>& grid, const TGridData& init_value) const {
+    grid.InitializeGrid(local_shape(), init_value);
+  }
+
+  // after P2G: add what the halos received into the planes of their owners
+  template<typename Node, typename A>
+  void accumulate_halos(std::vector<Node, A>& nodes) {
+    if (!communicator_.distributed()) return;
+    auto [left, right] = neighbors();
+    std::vector<Node> received(halo_ * plane_nodes_);
+    size_t bytes = received.size() * sizeof(Node);
+    auto add = [&](int first_plane) {
+      auto target = planes(nodes, first_plane);
+      for (size_t i = 0; i < received.size(); i++) target[i] += received[i];
+    };
+    // left halo to the left neighbor, the right neighbor's into the last owned planes
+    communicator_.sendrecv(planes(nodes, local_begin()),
+                           left < 0 ? 0 : bytes,
+                           left,
+                           received.data(),
+                           right < 0 ? 0 : bytes,
+                           right);
+    if (right >= 0) add(end() - halo_);
+    communicator_.sendrecv(planes(nodes, end()),
+                           right < 0 ? 0 : bytes,
+                           right,
+                           received.data(),
+                           left < 0 ? 0 : bytes,
+                           left);
+    if (left >= 0) add(begin());
+  }
+
+  // after the grid update: owned planes into the halos of the neighbors, for G2P
+  template<typename Node, typename A>
+  void update_halos(std::vector<Node, A>& nodes) {
+    if (!communicator_.distributed()) return;
+    auto [left, right] = neighbors();
+    size_t bytes = halo_ * plane_nodes_ * sizeof(Node);
+    communicator_.sendrecv(planes(nodes, begin()),
+                           left < 0 ? 0 : bytes,
+                           left,
+                           planes(nodes, end()),
+                           right < 0 ? 0 : bytes,
+                           right);
+    communicator_.sendrecv(planes(nodes, end() - halo_),
+                           right < 0 ? 0 : bytes,
+                           right,
+                           planes(nodes, local_begin()),
+                           left < 0 ? 0 : bytes,
+                           left);
+  }
+
+  template<typename TGridData>
+  void accumulate_halos(Grid<TGridData, Dim, T>& grid) {
+    accumulate_halos(grid.Nodes());
+  }
+  template<typename TGridData>
+  void update_halos(Grid<TGridData, Dim, T>& grid) {
+    update_halos(grid.Nodes());
+  }
+
+  /*
+   * send the particles that left the slab to their owners, every array of data must
+   * cover the entries of x_tag (particle attributes); arrays are moved as bytes, sorted by
+   * name, so every rank has to hold the same arrays, empty ones included
+   * staying particles keep their order, received ones follow by rank, all as entries
+   * [0, count)
+   */
+  bool migrate(DataContainer& data, const TypeTag<TV>& x_tag) {
+    if (!communicator_.distributed()) return true;
+    std::vector<DataArrayBase*> arrays;
+    for (auto& [hash, array] : data.dataset) arrays.push_back(array.get());
+    std::sort(arrays.begin(), arrays.end(), [](auto a, auto b) { return a->name < b->name; });
+    auto& x = data.get_array(x_tag);
+    bool covered = true;
+    for (auto array : arrays) {
+      if (array->ranges.ranges != x.ranges.ranges) {
+        META_ERROR("migrate: {} does not cover the particles of {}", array->name, x.name);
+        covered = false;
+      }
+    }
+    // every rank has to take the same way out, exchange() is collective
+    if (!agree(covered, arrays)) {
+      META_ERROR("migrate: ranks hold different arrays or arrays not covering {}", x.name);
+      return false;
+    }
+
+    size_t count = x.element_count();
+    auto positions = static_cast<const TV*>(x.raw_data());
+    std::vector<int> destination(count);
+    std::vector<uint64_t> leaving(size(), 0);
+    for (size_t i = 0; i < count; i++) {
+      destination[i] = owner(positions[i]);
+      leaving[destination[i]]++;
+    }
+
+    std::vector<std::vector<char>> send(size());
+    for (int r = 0; r < size(); r++) {
+      if (r == rank() || leaving[r] == 0) continue;
+      auto& buffer = send[r];
+      buffer.resize(sizeof(uint64_t));
+      std::memcpy(buffer.data(), &leaving[r], sizeof(uint64_t));
+      for (auto array : arrays) {
+        auto element = array->element_size();
+        auto source = static_cast<const char*>(array->raw_data());
+        for (size_t i = 0; i < count; i++) {
+          if (destination[i] == r) {
+            buffer.insert(buffer.end(), source + i * element, source + (i + 1) * element);
+          }
+        }
+      }
+    }
+    auto received = communicator_.exchange(send);
+
+    std::vector<uint64_t> arriving(size(), 0);
+    size_t total = leaving[rank()];
+    for (int r = 0; r < size(); r++) {
+      if (r == rank() || received[r].empty()) continue;
+      std::memcpy(&arriving[r], received[r].data(), sizeof(uint64_t));
+      total += arriving[r];
+    }
+
+    std::vector<size_t> read_offset(size(), sizeof(uint64_t));
+    for (auto array : arrays) {
+      auto element = array->element_size();
+      // stayers move down in place, then the arrivals are appended
+      auto storage = static_cast<char*>(array->raw_data());
+      size_t kept = 0;
+      for (size_t i = 0; i < count; i++) {
+        if (destination[i] != rank()) continue;
+        if (kept != i) std::memmove(storage + kept * element, storage + i * element, element);
+        kept++;
+      }
+      array->raw_resize(total);
+      storage = static_cast<char*>(array->raw_data());
+      for (int r = 0; r < size(); r++) {
+        if (arriving[r] == 0) continue;
+        size_t bytes = arriving[r] * element;
+        std::memcpy(storage + kept * element, received[r].data() + read_offset[r], bytes);
+        read_offset[r] += bytes;
+        kept += arriving[r];
+      }
+      array->ranges = total ? RangeSet(Range{0, int(total)}) : RangeSet();
+      array->ranges_changed();
+    }
+    data.total_size = int(total);
+    return true;
+  }
+
+  // move the slabs to equal particle counts (at least halo planes each), then migrate
+  bool rebalance(DataContainer& data, const TypeTag<TV>& x_tag) {
+    std::vector<double> counts(shape_[0], 0);
+    {
+      const auto& x = std::as_const(data).get_array(x_tag);
+      auto positions = static_cast<const TV*>(x.raw_data());
+      for (size_t i = 0; i < x.element_count(); i++) counts[plane(positions[i])]++;
+    }
+    communicator_.sum(counts);
+    double total = 0;
+    for (auto c : counts) total += c;
+
+    int ranks = size();
+    std::vector<int> splits(ranks + 1, int(shape_[0]));
+    splits[0] = 0;
+    double sum = 0;
+    for (int p = 0, r = 1; p < int(shape_[0]) && r < ranks; p++) {
+      sum += counts[p];
+      while (r < ranks && sum >= total * r / ranks) splits[r++] = p + 1;
+    }
+    for (int r = 1; r < ranks; r++) splits[r] = std::max(splits[r], splits[r - 1] + halo_);
+    for (int r = ranks - 1; r > 0; r--) splits[r] = std::min(splits[r], splits[r + 1] - halo_);
+
+    if (splits != splits_) {
+      splits_ = splits;
+      layout_version_++;
+      if (write_log && rank() == 0) {
+        double most = 0;
+        for (int r = 0; r < ranks; r++) {
+          most = std::max(most, std::accumulate(counts.begin() + splits[r],
+                                                counts.begin() + splits[r + 1],
+                                                0.0));
+        }
+        META_INFO("rebalance: {} particles over {} ranks, largest slab {:.0f} ({:.2f} x mean)",
+                  total,
+                  ranks,
+                  most,
+                  total > 0 ? most * ranks / total : 0);
+      }
+    }
+    return migrate(data, x_tag);
+  }
+
+  // migrate, or rebalance when it is due
+  bool redistribute(DataContainer& data, const TypeTag<TV>& x_tag) {
+    calls_++;
+    if (rebalance_interval > 0 && calls_ % rebalance_interval == 0) {
+      return rebalance(data, x_tag);
+    }
+    return migrate(data, x_tag);
+  }
+
+private:
+  std::pair<int, int> neighbors() const {
+    return {rank() > 0 ? rank() - 1 : -1, rank() + 1 < size() ? rank() + 1 : -1};
+  }
+
+  // nodes of the global plane in the local grid
+  template<typename Node, typename A>
+  Node* planes(std::vector<Node, A>& nodes, int plane) const {
+    return nodes.data() + size_t(plane - local_begin()) * plane_nodes_;
+  }
+
+  // ok on every rank and the same names and element sizes of arrays
+  bool agree(bool ok, const std::vector<DataArrayBase*>& arrays) {
+    std::string signature;
+    for (auto array : arrays) {
+      signature += array->name + ":" + std::to_string(array->element_size()) + ";";
+    }
+    // 32 bits stay exact in a double sum
+    double hash = double(std::hash<std::string>()(signature) & 0xffffffffu);
+    double failed = communicator_.max(ok ? 0 : 1);
+    double most = communicator_.max(hash);
+    double sum = communicator_.sum(hash);
+    return failed == 0 && most == hash && sum == hash * size();
+  }
+
+  Communicator& communicator_;
+  TV lower_;
+  T dx_;
+  std::array<size_t, Dim> shape_;
+  int halo_;
+  size_t plane_nodes_;
+  std::vector<int> splits_;
+  int layout_version_{0};
+  int calls_{0};
+};
+
+}   // namespace MS
+
+#endif   // METASIM_DOMAIN_DECOMPOSITION_HPP
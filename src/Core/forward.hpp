@@ -0,0 +1,51 @@
+//
+// Created by Metal on 2021/5/15.
+//
+
+#ifndef METASIM_FORWARD_HPP
+#define METASIM_FORWARD_HPP
+
+#include <Eigen/Core>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// default scalar, configured by METASIM_REAL_TYPE (double or float)
+using real = double;
+
+template<int Dim, typename Scalar = real>
+using Vec = Eigen::Matrix<Scalar, Dim, 1>;
+
+template<int Row, int Col, typename Scalar = real>
+using Mat = Eigen::Matrix<Scalar, Row, Col>;
+
+// scalar types of a simulation pipeline:
+// TParticle for particle states (positions, velocities, deformation)
+// TGrid for grid accumulation and kernel weights
+template<typename TParticle, typename TGrid = TParticle>
+struct Precision {
+  using particle_type = TParticle;
+  using grid_type = TGrid;
+};
+
+using DoublePrecision = Precision<double>;
+using SinglePrecision = Precision<float>;
+// positions stay double, P2G/G2P transfers run in float
+using MixedPrecision = Precision<double, float>;
+
+// context controller (program exec cwd)
+// global singleton
+struct Context {
+  std::string abs_project_dir{"/root/repo"};
+  std::string output_dir, data_dir;
+  Context() {
+    output_dir = abs_project_dir + "/output";
+    data_dir = abs_project_dir + "/data";
+  }
+};
+inline Context context;
+
+#endif   // METASIM_FORWARD_HPP
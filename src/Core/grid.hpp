@@ -6,19 +6,22 @@
 #define METASIM_GRID_HPP
 
 #include "meta.hpp"
+#include "Core/memory_resource.hpp"
 
 class IGridBase {
 public:
     virtual ~IGridBase() = default;
 };
 
-template<typename TGridData, int Dim>
+// T: scalar of grid positions, float for single/mixed precision pipelines
+template<typename TGridData, int Dim, typename TScalar = real>
 class Grid : public IGridBase {
 
 public:
-    using T = real;
+    using T = TScalar;
     using TVI = Vec<Dim, int>;
     using TV = Vec<Dim, T>;
+    using NodeArray = std::vector<TGridData, MS::Allocator<TGridData>>;
 
     Grid() = default;
 
@@ -57,13 +60,18 @@ public:
         nodes_.resize(total_size_);
         Xi_.resize(total_size_);
 
-        for (int i = 0; i < total_size_; i++) {
+        // in parallel, so the threads iterating the nodes touch their pages first
+        SIM_LOOP(0, total_size_, [&](size_t i) {
             Xi_[i] = Coord(i);
             nodes_[i] = init_value;
-            printf("Xi of %d is (%d, %d, %d)\n", i, Xi_[i](0), Xi_[i](1), Xi_[i](2));
-        }
+        });
     };
 
+    // storage of the nodes (e.g. MS::NumaResource), set before InitializeGrid
+    void SetMemoryResource(std::shared_ptr<MS::MemoryResource> resource) {
+        nodes_ = NodeArray(MS::Allocator<TGridData>(std::move(resource)));
+    }
+
     template<typename OP>
     void IterateAllGrid(OP operate) {
         SIM_LOOP(0, nodes_.size(), [&](int i) {
@@ -79,20 +87,37 @@ public:
         });
     }
 
+    // active_idx_ keeps ascending order, so compact vectors indexed by it are
+    // deterministic across runs
     template<typename OP>
     void IterateAllGridWithCheck(OP operate) {
-        active_idx_.clear();
+        std::vector<char> is_active(nodes_.size());
         SIM_LOOP(0, nodes_.size(), [&](int i) {
-            if (operate(nodes_[i], Xi_[i], i)) {
-                active_idx_.push_back(i);
-            }
+            is_active[i] = operate(nodes_[i], Xi_[i], i);
         });
+        active_idx_.clear();
+        for (size_t i = 0; i < is_active.size(); i++) {
+            if (is_active[i]) active_idx_.push_back(i);
+        }
+    }
+
+    const std::vector<size_t>& ActiveIndices() const { return active_idx_; }
+    const std::array<size_t, Dim>& Shape() const { return shape_; }
+    size_t TotalSize() const { return total_size_; }
+    // nodes in Index order, e.g. for exchanging node planes between ranks
+    NodeArray& Nodes() { return nodes_; }
+
+    // bytes held by nodes_, Xi_ and active_idx_, see MS::MemoryTelemetry
+    std::vector<MS::MemoryUsage> MemoryFootprint() const {
+        return {MS::vector_usage("nodes_", nodes_),
+                MS::vector_usage("Xi_", Xi_),
+                MS::vector_usage("active_idx_", active_idx_)};
     }
 
 protected:
     size_t total_size_ = 0;
     std::array<size_t, Dim> shape_;
-    std::vector<TGridData> nodes_;
+    NodeArray nodes_;
     std::vector<TVI> Xi_;
     std::vector<size_t> active_idx_;
 };
@@ -0,0 +1,152 @@
+#ifndef METASIM_MEMORY_RESOURCE_HPP
+#define METASIM_MEMORY_RESOURCE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace MS {
+
+// source of raw storage for DataArray, e.g. the heap or a mapped file section
+class MemoryResource {
+public:
+  virtual ~MemoryResource() = default;
+  virtual void* allocate(size_t bytes, size_t alignment) = 0;
+  virtual void deallocate(void* p, size_t bytes, size_t alignment) = 0;
+  // storage handed out holding values already (a mapped file section), see Allocator
+  virtual std::pair<const void*, size_t> held_values() const { return {nullptr, 0}; }
+};
+
+// bytes held by one buffer, see MemoryTelemetry
+struct MemoryUsage {
+  std::string name;
+  size_t bytes_used{0};
+  size_t bytes_reserved{0};
+  // pieces the buffer is made of: ranges of a RangeSet, chunks of an arena
+  size_t fragments{1};
+  // largest bytes_used known to the owner, 0 if it does not keep track
+  size_t high_water{0};
+};
+
+template<typename Vector>
+MemoryUsage vector_usage(std::string name, const Vector& vector) {
+  using value_type = typename Vector::value_type;
+  return {std::move(name),
+          vector.size() * sizeof(value_type),
+          vector.capacity() * sizeof(value_type),
+          1};
+}
+
+/*
+ * allocator of DataArray storage, shares ownership of its MemoryResource (null for the heap)
+ *
+ * Value-less construct() value-initializes (resize zero-fills scalars) except over the
+ * held_values() of the resource, e.g. a mapped file section adopted by a DataArray (see
+ * ParticleFile): its contents are kept. Copies of a container fall back to the heap.
+ */
+template<typename T>
+class Allocator {
+public:
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+  using is_always_equal = std::false_type;
+
+  Allocator() = default;
+  explicit Allocator(std::shared_ptr<MemoryResource> resource)
+    : resource(std::move(resource)) {
+    if (this->resource) {
+      auto [held, bytes] = this->resource->held_values();
+      held_ = static_cast<const char*>(held);
+      held_end_ = held_ + bytes;
+    }
+  }
+  template<typename U>
+  Allocator(const Allocator<U>& other)
+    : resource(other.resource)
+    , held_(other.held_)
+    , held_end_(other.held_end_) {}
+
+  T* allocate(size_t n) {
+    if (resource) return static_cast<T*>(resource->allocate(n * sizeof(T), alignof(T)));
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (resource) {
+      resource->deallocate(p, n * sizeof(T), alignof(T));
+    } else {
+      ::operator delete(p, std::align_val_t(alignof(T)));
+    }
+  }
+
+  template<typename U>
+  void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+    auto byte = reinterpret_cast<const char*>(p);
+    if (byte >= held_ && byte < held_end_) {
+      ::new (static_cast<void*>(p)) U;
+    } else {
+      ::new (static_cast<void*>(p)) U();
+    }
+  }
+
+  template<typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+  }
+
+  Allocator select_on_container_copy_construction() const { return Allocator(); }
+
+  template<typename U>
+  bool operator==(const Allocator<U>& other) const {
+    return resource == other.resource;
+  }
+  template<typename U>
+  bool operator!=(const Allocator<U>& other) const {
+    return resource != other.resource;
+  }
+
+  std::shared_ptr<MemoryResource> resource;
+
+private:
+  template<typename U>
+  friend class Allocator;
+
+  // held_values() of resource, asked once
+  const char* held_{nullptr};
+  const char* held_end_{nullptr};
+};
+
+/*
+ * heap allocator whose value-less construct() default-initializes, for staging buffers
+ * resized right before they are overwritten (e.g. FrameSnapshot payloads)
+ */
+template<typename T>
+class StagingAllocator : public std::allocator<T> {
+public:
+  template<typename U>
+  struct rebind {
+    using other = StagingAllocator<U>;
+  };
+
+  StagingAllocator() = default;
+  template<typename U>
+  StagingAllocator(const StagingAllocator<U>&) {}
+
+  template<typename U>
+  void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+    ::new (static_cast<void*>(p)) U;
+  }
+
+  template<typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+  }
+};
+
+}   // namespace MS
+
+#endif   // METASIM_MEMORY_RESOURCE_HPP
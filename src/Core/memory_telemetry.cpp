@@ -0,0 +1,248 @@
+#include "Core/memory_telemetry.hpp"
+#include <algorithm>
+#include <new>
+
+namespace MS {
+
+class MemoryTelemetry::TrackedResource : public MemoryResource {
+public:
+  TrackedResource(MemoryTelemetry& telemetry, std::shared_ptr<MemoryResource> upstream)
+    : telemetry_(telemetry)
+    , upstream_(std::move(upstream)) {}
+
+  void* allocate(size_t bytes, size_t alignment) override {
+    telemetry_.reserve(bytes);
+    try {
+      if (upstream_) return upstream_->allocate(bytes, alignment);
+      return ::operator new(bytes, std::align_val_t(alignment));
+    } catch (...) {
+      META_ERROR("memory: allocating {:.1f} MB failed with {:.1f} MB tracked, largest {}",
+                 bytes / 1e6,
+                 telemetry_.tracked_bytes() / 1e6,
+                 telemetry_.largest(3));
+      telemetry_.release(bytes);
+      throw;
+    }
+  }
+
+  void deallocate(void* p, size_t bytes, size_t alignment) override {
+    if (upstream_) {
+      upstream_->deallocate(p, bytes, alignment);
+    } else {
+      ::operator delete(p, std::align_val_t(alignment));
+    }
+    telemetry_.release(bytes);
+  }
+
+private:
+  MemoryTelemetry& telemetry_;
+  std::shared_ptr<MemoryResource> upstream_;
+};
+
+void MemoryTelemetry::watch(const std::string& source, collector_t collect) {
+  for (auto& [name, collector] : sources_) {
+    if (name == source) {
+      collector = std::move(collect);
+      return;
+    }
+  }
+  sources_.emplace_back(source, std::move(collect));
+}
+
+void MemoryTelemetry::watch(const std::string& source, const DataContainer& container) {
+  watch(source, [&container] { return usage(container); });
+}
+
+void MemoryTelemetry::watch(const std::string& source, const StepArena& arena) {
+  watch(source, [&arena] { return usage(arena); });
+}
+
+void MemoryTelemetry::watch(const std::string& source, const PoolResource& pool) {
+  watch(source, [&pool] { return usage(pool); });
+}
+
+void MemoryTelemetry::watch(const std::string& source, const SpillResource& spill) {
+  watch(source, [&spill] { return usage(spill); });
+}
+
+std::vector<MemoryUsage> MemoryTelemetry::usage(const DataContainer& container) {
+  std::vector<MemoryUsage> usages;
+  for (auto& [hash, array] : container.dataset) {
+    usages.push_back(
+      {array->name, array->bytes_used(), array->bytes_reserved(), array->ranges.ranges.size()});
+  }
+  std::sort(usages.begin(), usages.end(), [](auto& a, auto& b) { return a.name < b.name; });
+  return usages;
+}
+
+std::vector<MemoryUsage> MemoryTelemetry::usage(const StepArena& arena) {
+  auto statistics = arena.statistics();
+  return {{"chunks",
+           statistics.bytes_used,
+           statistics.bytes_reserved,
+           statistics.chunks,
+           statistics.high_water}};
+}
+
+std::vector<MemoryUsage> MemoryTelemetry::usage(const PoolResource& pool) {
+  auto statistics = pool.statistics();
+  return {{"blocks", statistics.bytes_in_use, statistics.bytes_in_use + statistics.bytes_pooled}};
+}
+
+std::vector<MemoryUsage> MemoryTelemetry::usage(const SpillResource& spill) {
+  auto statistics = spill.statistics();
+  return {{"mapped", statistics.bytes_resident, statistics.bytes_mapped}};
+}
+
+void MemoryTelemetry::unwatch(const std::string& source) {
+  sources_.erase(std::remove_if(sources_.begin(),
+                                sources_.end(),
+                                [&](auto& entry) { return entry.first == source; }),
+                 sources_.end());
+}
+
+const std::vector<MemoryTelemetry::Entry>& MemoryTelemetry::sample() {
+  std::vector<Entry> entries;
+  for (auto& [source, collect] : sources_) {
+    for (auto& usage : collect()) {
+      auto& high_water = high_water_[source + "/" + usage.name];
+      high_water = std::max({high_water, usage.bytes_used, usage.high_water});
+      entries.push_back({source, std::move(usage), high_water});
+    }
+  }
+  {
+    // largest() reads the entries from allocating threads
+    std::lock_guard<std::mutex> lock(entries_mutex_);
+    entries_.swap(entries);
+  }
+  size_t reserved = bytes_reserved(), tracked = tracked_bytes();
+  untracked_bytes_.store(reserved > tracked ? reserved - tracked : 0, std::memory_order_relaxed);
+  if (budget && reserved < warn_fraction * budget) {
+    warned_ = false;
+    exceeded_ = false;
+  }
+  return entries_;
+}
+
+size_t MemoryTelemetry::bytes_used() const {
+  size_t bytes = 0;
+  for (auto& entry : entries_) bytes += entry.usage.bytes_used;
+  return bytes;
+}
+
+size_t MemoryTelemetry::bytes_reserved() const {
+  size_t bytes = 0;
+  for (auto& entry : entries_) bytes += entry.usage.bytes_reserved;
+  return bytes;
+}
+
+void MemoryTelemetry::sample_frame(int frame) {
+  sample();
+  size_t reserved = bytes_reserved();
+  if (write_log) {
+    size_t high_water = 0, ranges = 0;
+    for (auto& entry : entries_) {
+      high_water += entry.high_water;
+      ranges += entry.usage.fragments;
+    }
+    META_INFO("memory frame {}: used {:.1f} MB, reserved {:.1f} MB, high water {:.1f} MB, "
+              "{} fragments, largest {}",
+              frame,
+              bytes_used() / 1e6,
+              reserved / 1e6,
+              high_water / 1e6,
+              ranges,
+              largest(1));
+  }
+  if (budget && reserved >= warn_fraction * budget && !warned_.exchange(true)) {
+    META_WARN("memory: {:.1f} MB reserved of a {:.1f} MB budget, largest {}",
+              reserved / 1e6,
+              budget / 1e6,
+              largest(3));
+  }
+}
+
+void MemoryTelemetry::report() const {
+  std::vector<const Entry*> sorted;
+  for (auto& entry : entries_) sorted.push_back(&entry);
+  std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) {
+    return a->usage.bytes_reserved > b->usage.bytes_reserved;
+  });
+  META_INFO("{:<32}{:>12}{:>12}{:>12}{:>12}{:>12}",
+            "memory",
+            "used MB",
+            "reserved MB",
+            "high MB",
+            "slack MB",
+            "fragments");
+  for (auto entry : sorted) {
+    META_INFO("{:<32}{:>12.2f}{:>12.2f}{:>12.2f}{:>12.2f}{:>12}",
+              entry->source + "/" + entry->usage.name,
+              entry->usage.bytes_used / 1e6,
+              entry->usage.bytes_reserved / 1e6,
+              entry->high_water / 1e6,
+              entry->slack() / 1e6,
+              entry->usage.fragments);
+  }
+  META_INFO("{:<32}{:>12.2f}{:>12.2f}", "total", bytes_used() / 1e6, bytes_reserved() / 1e6);
+}
+
+std::shared_ptr<MemoryResource> MemoryTelemetry::resource(
+  std::shared_ptr<MemoryResource> upstream) {
+  return std::make_shared<TrackedResource>(*this, std::move(upstream));
+}
+
+void MemoryTelemetry::reserve(size_t bytes) {
+  size_t tracked = tracked_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  size_t high_water = tracked_high_water_.load(std::memory_order_relaxed);
+  while (tracked > high_water &&
+         !tracked_high_water_.compare_exchange_weak(high_water, tracked)) {}
+  if (!budget) return;
+
+  size_t projected = tracked + untracked_bytes_.load(std::memory_order_relaxed);
+  if (projected > budget) {
+    if (strict) {
+      tracked_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+      META_ERROR("memory: allocating {:.1f} MB would pass the {:.1f} MB budget, largest {}",
+                 bytes / 1e6,
+                 budget / 1e6,
+                 largest(3));
+      throw std::bad_alloc();
+    }
+    if (!exceeded_.exchange(true)) {
+      META_WARN("memory: allocating {:.1f} MB passes the {:.1f} MB budget, largest {}",
+                bytes / 1e6,
+                budget / 1e6,
+                largest(3));
+    }
+  } else if (projected >= warn_fraction * budget && !warned_.exchange(true)) {
+    META_WARN("memory: {:.1f} MB of a {:.1f} MB budget in use after allocating {:.1f} MB, "
+              "largest {}",
+              projected / 1e6,
+              budget / 1e6,
+              bytes / 1e6,
+              largest(3));
+  }
+}
+
+// the count largest reservations of the last sample, for messages
+std::string MemoryTelemetry::largest(size_t count) const {
+  std::lock_guard<std::mutex> lock(entries_mutex_);
+  std::vector<const Entry*> sorted;
+  for (auto& entry : entries_) sorted.push_back(&entry);
+  count = std::min(count, sorted.size());
+  std::partial_sort(sorted.begin(), sorted.begin() + count, sorted.end(), [](auto a, auto b) {
+    return a->usage.bytes_reserved > b->usage.bytes_reserved;
+  });
+  std::string text;
+  for (size_t i = 0; i < count; i++) {
+    text += fmt::format("{}{}/{} {:.1f} MB",
+                        i ? ", " : "",
+                        sorted[i]->source,
+                        sorted[i]->usage.name,
+                        sorted[i]->usage.bytes_reserved / 1e6);
+  }
+  return text.empty() ? "none" : text;
+}
+
+}   // namespace MS
@@ -0,0 +1,122 @@
+#ifndef METASIM_MEMORY_TELEMETRY_HPP
+#define METASIM_MEMORY_TELEMETRY_HPP
+
+#include "Core/data_container.hpp"
+#include "Core/memory_resource.hpp"
+#include "Core/pool_resource.hpp"
+#include "Core/spill_resource.hpp"
+#include "Core/step_arena.hpp"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Where the memory of a run goes
+ *
+ * Sources are watched by name: the arrays of a DataContainer (one entry per attribute,
+ * fragments are its ranges), the buffers of a Grid (MemoryFootprint()), step arenas and
+ * pools, or any collector returning MemoryUsage entries. sample() asks every source for
+ * its current bytes and keeps a high water mark per entry; it is cheap (no data is
+ * touched) and may be called at any time between steps. Watched objects must outlive
+ * the telemetry or be unwatched.
+ *
+ * With a budget, sample_frame() warns when the reserved bytes pass warn_fraction of it.
+ * Storage allocated through resource() is counted as it happens: an allocation that
+ * would pass the budget (on top of the untracked bytes of the last sample) warns before
+ * it is made, and with strict it throws std::bad_alloc instead of asking the system.
+ */
+class MemoryTelemetry {
+public:
+  struct Entry {
+    std::string source;
+    MemoryUsage usage;
+    size_t high_water{0};
+    // reserved but unused bytes
+    size_t slack() const {
+      return usage.bytes_reserved - std::min(usage.bytes_used, usage.bytes_reserved);
+    }
+  };
+
+  using collector_t = std::function<std::vector<MemoryUsage>()>;
+
+  // bytes, 0 for none
+  size_t budget{0};
+  double warn_fraction{0.9};
+  bool strict{false};
+  bool write_log{true};
+
+  MemoryTelemetry() = default;
+  MemoryTelemetry(const MemoryTelemetry&) = delete;
+  MemoryTelemetry& operator=(const MemoryTelemetry&) = delete;
+
+  // watching a source name again replaces its collector
+  void watch(const std::string& source, collector_t collect);
+  void watch(const std::string& source, const DataContainer& container);
+  void watch(const std::string& source, const StepArena& arena);
+  void watch(const std::string& source, const PoolResource& pool);
+  void watch(const std::string& source, const SpillResource& spill);
+  template<typename TGrid>
+  void watch_grid(const std::string& source, const TGrid& grid) {
+    watch(source, [&grid] { return grid.MemoryFootprint(); });
+  }
+  void unwatch(const std::string& source);
+  bool watching() const { return !sources_.empty(); }
+
+  // entries of the sources above, for collectors of objects that may be replaced
+  static std::vector<MemoryUsage> usage(const DataContainer& container);
+  static std::vector<MemoryUsage> usage(const StepArena& arena);
+  static std::vector<MemoryUsage> usage(const PoolResource& pool);
+  // used are the resident bytes, reserved the mapped ones
+  static std::vector<MemoryUsage> usage(const SpillResource& spill);
+
+  // current usage of every watched source, updates the high water marks
+  const std::vector<Entry>& sample();
+  const std::vector<Entry>& entries() const { return entries_; }
+  // totals of the last sample
+  size_t bytes_used() const;
+  size_t bytes_reserved() const;
+
+  // sample, log one line for frame and check the budget
+  void sample_frame(int frame);
+  // table of the last sample, largest reservations first
+  void report() const;
+
+  /*
+   * storage counted against the budget as it is allocated, from upstream (null for the
+   * heap), e.g. DataContainer::resource or Grid::SetMemoryResource; the resource
+   * refers to this telemetry
+   */
+  std::shared_ptr<MemoryResource> resource(std::shared_ptr<MemoryResource> upstream = nullptr);
+  size_t tracked_bytes() const { return tracked_bytes_.load(std::memory_order_relaxed); }
+  size_t tracked_high_water() const { return tracked_high_water_.load(std::memory_order_relaxed); }
+
+private:
+  class TrackedResource;
+
+  // called by TrackedResource before bytes more are allocated
+  void reserve(size_t bytes);
+  void release(size_t bytes) { tracked_bytes_.fetch_sub(bytes, std::memory_order_relaxed); }
+  std::string largest(size_t count) const;
+
+  std::vector<std::pair<std::string, collector_t>> sources_;
+  std::vector<Entry> entries_;
+  // sample() replaces the entries under it, largest() reads them under it from any thread
+  mutable std::mutex entries_mutex_;
+  std::map<std::string, size_t> high_water_;
+
+  std::atomic<size_t> tracked_bytes_{0}, tracked_high_water_{0};
+  // bytes of the last sample not allocated through resource()
+  std::atomic<size_t> untracked_bytes_{0};
+  // a warning per crossing of warn_fraction and of the budget, until a sample is below
+  std::atomic<bool> warned_{false}, exceeded_{false};
+};
+
+}   // namespace MS
+
+#endif   // METASIM_MEMORY_TELEMETRY_HPP
@@ -0,0 +1,219 @@
+#include "Core/numa_resource.hpp"
+#include "Utils/logger.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
+#include <thread>
+#include <unistd.h>
+
+namespace MS {
+
+namespace {
+
+// linux/mempolicy.h
+constexpr int mpol_bind = 2;
+constexpr int mpol_interleave = 3;
+
+constexpr size_t page_bytes = 4096;
+constexpr size_t huge_page_bytes = size_t(2) << 20;
+
+size_t mapped_bytes(size_t bytes, bool huge) {
+  size_t unit = huge && bytes >= huge_page_bytes ? huge_page_bytes : page_bytes;
+  return (bytes + unit - 1) / unit * unit;
+}
+
+// "0-3,8,10-11"
+std::vector<int> parse_cpu_list(const std::string& list) {
+  std::vector<int> result;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (item.empty() || item == "\n") continue;
+    auto dash = item.find('-');
+    int first = std::stoi(item.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+    for (int cpu = first; cpu <= last; cpu++) result.push_back(cpu);
+  }
+  return result;
+}
+
+bool set_policy(void* p, size_t bytes, int mode, const std::vector<int>& nodes) {
+  int highest = *std::max_element(nodes.begin(), nodes.end());
+  std::vector<unsigned long> mask(highest / 64 + 1);
+  for (int n : nodes) mask[n / 64] |= 1ul << (n % 64);
+  return syscall(SYS_mbind, p, bytes, mode, mask.data(), mask.size() * 64 + 1, 0) == 0;
+}
+
+bool pin(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+std::vector<int> cpu_order() {
+  std::vector<int> order;
+  for (int n = 0; n < NumaResource::nodes(); n++) {
+    auto cpus = NumaResource::cpus(n);
+    order.insert(order.end(), cpus.begin(), cpus.end());
+  }
+  return order;
+}
+
+class PinObserver : public tbb::task_scheduler_observer {
+public:
+  explicit PinObserver(std::vector<int> order)
+    : order(std::move(order)) {
+    observe(true);
+  }
+  void on_scheduler_entry(bool) override {
+    int slot = tbb::this_task_arena::current_thread_index();
+    if (slot >= 0) pin(order[slot % order.size()]);
+  }
+  std::vector<int> order;
+};
+
+}   // namespace
+
+void* NumaResource::allocate(size_t bytes, size_t alignment) {
+  if (bytes < map_threshold || alignment > page_bytes) {
+    return ::operator new(bytes, std::align_val_t(alignment));
+  }
+  bool huge = huge_pages && bytes >= huge_page_bytes;
+  size_t length = mapped_bytes(bytes, huge_pages);
+  // huge pages need 2 MiB aligned blocks, map more and trim
+  size_t slack = huge ? huge_page_bytes : 0;
+  auto base = static_cast<char*>(
+    mmap(nullptr, length + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (base == MAP_FAILED) throw std::bad_alloc();
+  char* p = base;
+  if (huge) {
+    p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(base) + slack - 1) / slack * slack);
+    if (p > base) munmap(base, p - base);
+    if (base + slack > p) munmap(p + length, base + slack - p);
+    madvise(p, length, MADV_HUGEPAGE);
+  }
+
+  if (policy == Policy::interleave && nodes() > 1) {
+    std::vector<int> all(nodes());
+    for (int n = 0; n < nodes(); n++) all[n] = n;
+    set_policy(p, length, mpol_interleave, all);
+  } else if (policy == Policy::bind) {
+    set_policy(p, length, mpol_bind, {node});
+  }
+
+  // first touch in the stretches a static partitioned loop gives each thread
+  size_t pages = length / page_bytes;
+  tbb::parallel_for(
+    tbb::blocked_range<size_t>(0, pages),
+    [&](const tbb::blocked_range<size_t>& range) {
+      for (size_t page = range.begin(); page < range.end(); page++) {
+        static_cast<volatile char*>(p)[page * page_bytes] = 0;
+      }
+    },
+    tbb::static_partitioner());
+  bytes_mapped_ += length;
+  return p;
+}
+
+void NumaResource::deallocate(void* p, size_t bytes, size_t alignment) {
+  if (!p) return;
+  if (bytes < map_threshold || alignment > page_bytes) {
+    ::operator delete(p, std::align_val_t(alignment));
+    return;
+  }
+  size_t length = mapped_bytes(bytes, huge_pages);
+  munmap(p, length);
+  bytes_mapped_ -= length;
+}
+
+int NumaResource::nodes() {
+  static int count = [] {
+    int n = 0;
+    while (std::ifstream("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist")) n++;
+    return std::max(n, 1);
+  }();
+  return count;
+}
+
+std::vector<int> NumaResource::cpus(int node) {
+  std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+  std::string list;
+  if (file && std::getline(file, list)) return parse_cpu_list(list);
+  std::vector<int> all;
+  if (node == 0) {
+    for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+      all.push_back(int(cpu));
+    }
+  }
+  return all;
+}
+
+bool NumaResource::pin_threads() {
+  static PinObserver observer(cpu_order());
+  if (observer.order.empty()) return false;
+  bool pinned = pin(observer.order[0]);
+  if (!pinned) META_WARN("numa: thread affinity refused, threads are not pinned");
+  return pinned;
+}
+
+std::vector<size_t> NumaResource::page_nodes(const void* p, size_t bytes, size_t stride) {
+  std::vector<size_t> counts(nodes() + 1, 0);
+  auto first = reinterpret_cast<uintptr_t>(p) / page_bytes * page_bytes;
+  auto last = reinterpret_cast<uintptr_t>(p) + bytes;
+  std::vector<void*> pages;
+  for (auto page = first; page < last; page += stride * page_bytes) {
+    pages.push_back(reinterpret_cast<void*>(page));
+  }
+  constexpr size_t batch = 4096;
+  std::vector<int> status(batch);
+  for (size_t begin = 0; begin < pages.size(); begin += batch) {
+    size_t count = std::min(batch, pages.size() - begin);
+    // no target nodes: only query where the pages are
+    if (syscall(SYS_move_pages, 0, count, pages.data() + begin, nullptr, status.data(), 0) != 0) {
+      counts.back() += count;
+      continue;
+    }
+    for (size_t i = 0; i < count; i++) {
+      int n = status[i];
+      counts[n >= 0 && n < nodes() ? n : nodes()]++;
+    }
+  }
+  return counts;
+}
+
+void NumaResource::report(const DataContainer& container) {
+  std::vector<const DataArrayBase*> arrays;
+  for (auto& [hash, array] : container.dataset) arrays.push_back(array.get());
+  std::sort(arrays.begin(), arrays.end(), [](auto a, auto b) { return a->name < b->name; });
+  for (auto array : arrays) {
+    // the storage as held, uniform ranges stay as they are
+    size_t bytes = array->stored_bytes();
+    if (bytes == 0) continue;
+    // a few thousand samples per array are enough for shares
+    size_t stride = std::max<size_t>(1, bytes / page_bytes / 4096);
+    auto counts = page_nodes(array->stored_data(), bytes, stride);
+    size_t total = 0;
+    for (auto c : counts) total += c;
+    std::string shares;
+    for (int n = 0; n < nodes(); n++) {
+      shares += fmt::format(" node{} {:.1f}%", n, 100.0 * counts[n] / std::max<size_t>(total, 1));
+    }
+    META_INFO("numa: {:<16}{:>10.1f} MB{}, not placed {:.1f}%",
+              array->name,
+              bytes / 1e6,
+              shares,
+              100.0 * counts.back() / std::max<size_t>(total, 1));
+  }
+}
+
+}   // namespace MS
@@ -0,0 +1,73 @@
+#ifndef METASIM_NUMA_RESOURCE_HPP
+#define METASIM_NUMA_RESOURCE_HPP
+
+#include "Core/data_container.hpp"
+#include "Core/memory_resource.hpp"
+#include <atomic>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Storage placed on the NUMA nodes of the threads that work on it (Linux)
+ *
+ * Blocks of at least map_threshold bytes are mapped, given a policy and touched right
+ * away by a parallel_for with the static partitioner, one stretch of pages per thread,
+ * before DataArray::append or Grid::InitializeGrid copy into them from a single thread.
+ * With pin_threads() every TBB thread slot stays on one cpu, cpus ordered by node, so
+ * loops over the particles with the static partitioner run where their pages are. Only
+ * those: SIM_LOOP and the default partitioners hand out chunks by work stealing, their
+ * accesses are local as far as the chunks happen to line up with the first touch.
+ * Policies:
+ *   first_touch: pages on the node of the thread touching them
+ *   interleave:  pages round robin over all nodes (bandwidth bound data shared by all)
+ *   bind:        pages on node
+ * Without NUMA support (single node, containers) the policy calls fail quietly and the
+ * resource is a plain page allocator with huge pages.
+ */
+class NumaResource : public MemoryResource {
+public:
+  enum class Policy { first_touch, interleave, bind };
+
+  Policy policy{Policy::first_touch};
+  int node{0};
+  // madvise(MADV_HUGEPAGE) blocks of 2 MiB and more
+  bool huge_pages{true};
+  size_t map_threshold{size_t(1) << 16};
+
+  NumaResource() = default;
+  explicit NumaResource(Policy policy, int node = 0)
+    : policy(policy)
+    , node(node) {}
+
+  void* allocate(size_t bytes, size_t alignment) override;
+  void deallocate(void* p, size_t bytes, size_t alignment) override;
+
+  size_t bytes_mapped() const { return bytes_mapped_; }
+
+  // nodes of the machine, 1 without NUMA
+  static int nodes();
+  // cpus of node, in ascending order
+  static std::vector<int> cpus(int node);
+
+  /*
+   * pin TBB thread slot i (and the calling thread, slot 0) to the i-th cpu ordered by
+   * node, for threads entering the scheduler from now on; false if affinity is refused
+   * slots count per arena, nested arenas (BatchRunner) share the first cpus
+   */
+  static bool pin_threads();
+
+  // pages of [p, p + bytes) per node, sampled every stride pages, the last entry counts
+  // pages not yet touched (or not known)
+  static std::vector<size_t> page_nodes(const void* p, size_t bytes, size_t stride = 1);
+  // log the page placement of every array of container, as stored (see
+  // DataArrayBase::stored_data)
+  static void report(const DataContainer& container);
+
+private:
+  std::atomic<size_t> bytes_mapped_{0};
+};
+
+}   // namespace MS
+
+#endif   // METASIM_NUMA_RESOURCE_HPP
@@ -0,0 +1,192 @@
+#include "Core/phase_graph.hpp"
+#include "Utils/logger.hpp"
+#include "Utils/profiler.hpp"
+#include <algorithm>
+
+namespace MS {
+
+namespace {
+template<typename Phase>
+double mean_ms(const Phase& phase) {
+  return phase.count ? phase.total_ms / phase.count : 0;
+}
+// deferred phases do not hold up the step, so they are off every path
+template<typename Phase>
+double path_ms(const Phase& phase) {
+  return phase.deferred ? 0 : mean_ms(phase);
+}
+}   // namespace
+
+int PhaseGraph::find(const std::string& name) const {
+  for (size_t i = 0; i < phases_.size(); i++) {
+    if (phases_[i]->name == name) return int(i);
+  }
+  return -1;
+}
+
+int PhaseGraph::add(const std::string& name, body_t body, const std::vector<std::string>& after) {
+  META_ASSERT(find(name) < 0, "phase {} added twice", name);
+  auto phase = std::make_unique<Phase>();
+  phase->name = name;
+  phase->body = std::move(body);
+  for (auto& dependency : after) {
+    int id = find(dependency);
+    if (id < 0) {
+      META_ERROR("phase {} depends on unknown phase {}", name, dependency);
+      continue;
+    }
+    if (phases_[id]->deferred) {
+      META_ERROR("phase {} can't depend on deferred phase {}", name, dependency);
+      continue;
+    }
+    phase->after.push_back(id);
+  }
+  // a new phase invalidates the built graph
+  wait();
+  graph_.reset();
+  phases_.push_back(std::move(phase));
+  return int(phases_.size() - 1);
+}
+
+int PhaseGraph::add_deferred(const std::string& name, body_t body,
+                             const std::vector<std::string>& after,
+                             const std::vector<std::string>& before) {
+  int id = add(name, std::move(body), after);
+  phases_[id]->deferred = true;
+  for (auto& successor : before) {
+    int next = find(successor);
+    if (next < 0) {
+      META_ERROR("deferred phase {} is before unknown phase {}", name, successor);
+      continue;
+    }
+    phases_[next]->waits_for.push_back(id);
+  }
+  return id;
+}
+
+void PhaseGraph::wait(Phase& phase) {
+  std::shared_future<void> in_flight;
+  {
+    std::lock_guard<std::mutex> lock(phase.in_flight_mutex);
+    in_flight = phase.in_flight;
+  }
+  if (in_flight.valid()) in_flight.wait();
+}
+
+void PhaseGraph::execute(Phase& phase) {
+  for (int id : phase.waits_for) wait(*phases_[id]);
+  auto begin = std::chrono::steady_clock::now();
+  {
+    ProfileZone zone(phase.name.c_str());
+    phase.body();
+  }
+  phase.total_ms +=
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  phase.count++;
+}
+
+void PhaseGraph::build() {
+  graph_ = std::make_unique<tbb::flow::graph>();
+  start_ = std::make_unique<tbb::flow::broadcast_node<tbb::flow::continue_msg>>(*graph_);
+  for (auto& phase : phases_) {
+    Phase* p = phase.get();
+    phase->node =
+      std::make_unique<node_t>(*graph_, [this, p](const tbb::flow::continue_msg&) {
+        if (p->deferred) {
+          // the previous run of it may still be going
+          wait(*p);
+          std::lock_guard<std::mutex> lock(p->in_flight_mutex);
+          p->in_flight = std::async(std::launch::async, [this, p] { execute(*p); }).share();
+        } else {
+          execute(*p);
+        }
+      });
+    if (phase->after.empty()) tbb::flow::make_edge(*start_, *phase->node);
+    for (int id : phase->after) tbb::flow::make_edge(*phases_[id]->node, *phase->node);
+  }
+}
+
+void PhaseGraph::run() {
+  if (!graph_) build();
+  start_->try_put(tbb::flow::continue_msg());
+  graph_->wait_for_all();
+}
+
+void PhaseGraph::wait() {
+  for (auto& phase : phases_) wait(*phase);
+}
+
+std::vector<double> PhaseGraph::longest_paths(std::vector<int>& predecessor) const {
+  // phases only depend on earlier ones, so insertion order is a topological order
+  std::vector<double> finish(phases_.size(), 0);
+  predecessor.assign(phases_.size(), -1);
+  for (size_t i = 0; i < phases_.size(); i++) {
+    auto& phase = *phases_[i];
+    double start = 0;
+    for (int id : phase.after) {
+      if (finish[id] > start) {
+        start = finish[id];
+        predecessor[i] = id;
+      }
+    }
+    finish[i] = start + path_ms(phase);
+  }
+  return finish;
+}
+
+std::vector<std::string> PhaseGraph::critical_path() const {
+  std::vector<int> predecessor;
+  auto finish = longest_paths(predecessor);
+  if (finish.empty()) return {};
+  int id = int(std::max_element(finish.begin(), finish.end()) - finish.begin());
+  std::vector<std::string> path;
+  for (; id >= 0; id = predecessor[id]) path.push_back(phases_[id]->name);
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
+std::vector<PhaseGraph::PhaseStatistics> PhaseGraph::statistics() const {
+  std::vector<int> predecessor;
+  auto finish = longest_paths(predecessor);
+  // longest chain from each phase to the end of the step, walked backwards
+  std::vector<double> tail(phases_.size(), 0);
+  for (size_t i = phases_.size(); i-- > 0;) {
+    auto& phase = *phases_[i];
+    tail[i] += path_ms(phase);
+    for (int id : phase.after) tail[id] = std::max(tail[id], tail[i]);
+  }
+  double length = finish.empty() ? 0 : *std::max_element(finish.begin(), finish.end());
+
+  auto path = critical_path();
+  std::vector<PhaseStatistics> result;
+  for (size_t i = 0; i < phases_.size(); i++) {
+    auto& phase = *phases_[i];
+    double through = finish[i] - path_ms(phase) + tail[i];
+    result.push_back({phase.name,
+                      phase.count,
+                      mean_ms(phase),
+                      length - through,
+                      std::find(path.begin(), path.end(), phase.name) != path.end()});
+  }
+  return result;
+}
+
+void PhaseGraph::report() const {
+  auto path = critical_path();
+  std::string chain;
+  for (auto& name : path) chain += (chain.empty() ? "" : " > ") + name;
+  META_INFO("{:<24}{:>10}{:>12}{:>12}", "phase", "count", "mean ms", "slack ms");
+  double length = 0;
+  for (auto& phase : statistics()) {
+    META_INFO("{:<24}{:>10}{:>12.3f}{:>12.3f}{}",
+              phase.name,
+              phase.count,
+              phase.mean_ms,
+              phase.slack_ms,
+              phase.critical ? "  *" : "");
+    if (phase.critical) length += phase.mean_ms;
+  }
+  META_INFO("critical path {:.3f} ms: {}", length, chain);
+}
+
+}   // namespace MS
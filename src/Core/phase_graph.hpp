@@ -0,0 +1,93 @@
+#ifndef METASIM_PHASE_GRAPH_HPP
+#define METASIM_PHASE_GRAPH_HPP
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tbb/flow_graph.h>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Step as a dependency graph of phases
+ *
+ * Phases (p2g, plasticity of each group, grid update, collision, output staging,
+ * diagnostics) name the phases they read results of, independent phases run
+ * concurrently on a tbb::flow::graph that is built on the first run() and reused.
+ * A deferred phase does not hold up the end of the step: it overlaps the next step
+ * until a phase listed in its `before` starts there (e.g. diagnostics reading positions
+ * overlaps the next p2g, but g2p waits for it). Deferred phases run on a thread of their
+ * own: TBB work spawned from a graph node can't be awaited from outside of it.
+ * Every phase is a profiler zone; durations are kept per phase so report() can give
+ * the critical path of the step.
+ */
+class PhaseGraph {
+public:
+  using body_t = std::function<void()>;
+
+  struct PhaseStatistics {
+    std::string name;
+    size_t count;
+    double mean_ms;
+    // mean_ms of the longest chain through this phase minus the critical path
+    double slack_ms;
+    bool critical;
+  };
+
+  PhaseGraph() = default;
+  ~PhaseGraph() { wait(); }
+  PhaseGraph(const PhaseGraph&) = delete;
+  PhaseGraph& operator=(const PhaseGraph&) = delete;
+
+  // returns the id of the phase, dependencies must be added before
+  int add(const std::string& name, body_t body, const std::vector<std::string>& after = {});
+  int add_deferred(const std::string& name, body_t body, const std::vector<std::string>& after,
+                   const std::vector<std::string>& before);
+
+  bool empty() const { return phases_.empty(); }
+  int find(const std::string& name) const;
+
+  // one step, returns once every phase but the deferred ones finished
+  void run();
+  // wait for deferred phases still running
+  void wait();
+
+  // phases in insertion order from the mean durations of all runs
+  std::vector<PhaseStatistics> statistics() const;
+  std::vector<std::string> critical_path() const;
+  void report() const;
+
+private:
+  using node_t = tbb::flow::continue_node<tbb::flow::continue_msg>;
+
+  struct Phase {
+    std::string name;
+    body_t body;
+    std::vector<int> after;
+    // deferred phases this phase waits for from the previous step
+    std::vector<int> waits_for;
+    bool deferred{false};
+    std::mutex in_flight_mutex;
+    std::shared_future<void> in_flight;
+    std::unique_ptr<node_t> node;
+    size_t count{0};
+    double total_ms{0};
+  };
+
+  void build();
+  void execute(Phase& phase);
+  static void wait(Phase& phase);
+  std::vector<double> longest_paths(std::vector<int>& predecessor) const;
+
+  std::vector<std::unique_ptr<Phase>> phases_;
+  std::unique_ptr<tbb::flow::graph> graph_;
+  std::unique_ptr<tbb::flow::broadcast_node<tbb::flow::continue_msg>> start_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_PHASE_GRAPH_HPP
@@ -0,0 +1,64 @@
+#include "Core/pool_resource.hpp"
+#include <algorithm>
+
+namespace MS {
+
+int PoolResource::size_class(size_t bytes) {
+  int c = min_class;
+  while ((size_t(1) << c) < bytes) c++;
+  return c;
+}
+
+void* PoolResource::allocate(size_t bytes, size_t alignment) {
+  if (bytes > max_block_bytes || alignment > block_alignment) {
+    bytes_in_use_ += bytes;
+    return ::operator new(bytes, std::align_val_t(alignment));
+  }
+  int c = size_class(bytes);
+  size_t block = size_t(1) << c;
+  bytes_in_use_ += block;
+  {
+    auto& pool = classes_[c];
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (!pool.free.empty()) {
+      void* p = pool.free.back();
+      pool.free.pop_back();
+      bytes_pooled_ -= block;
+      hits_++;
+      return p;
+    }
+  }
+  misses_++;
+  return ::operator new(block, std::align_val_t(block_alignment));
+}
+
+void PoolResource::deallocate(void* p, size_t bytes, size_t alignment) {
+  if (!p) return;
+  if (bytes > max_block_bytes || alignment > block_alignment) {
+    bytes_in_use_ -= bytes;
+    ::operator delete(p, std::align_val_t(alignment));
+    return;
+  }
+  int c = size_class(bytes);
+  size_t block = size_t(1) << c;
+  bytes_in_use_ -= block;
+  bytes_pooled_ += block;
+  auto& pool = classes_[c];
+  std::lock_guard<std::mutex> lock(pool.mutex);
+  pool.free.push_back(p);
+}
+
+void PoolResource::release() {
+  for (auto& pool : classes_) {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    for (void* p : pool.free) ::operator delete(p, std::align_val_t(block_alignment));
+    pool.free.clear();
+  }
+  bytes_pooled_ = 0;
+}
+
+PoolResource::Statistics PoolResource::statistics() const {
+  return {bytes_in_use_.load(), bytes_pooled_.load(), hits_.load(), misses_.load()};
+}
+
+}   // namespace MS
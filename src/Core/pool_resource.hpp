@@ -0,0 +1,59 @@
+#ifndef METASIM_POOL_RESOURCE_HPP
+#define METASIM_POOL_RESOURCE_HPP
+
+#include "Core/memory_resource.hpp"
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Thread-safe pool of power of two blocks, shared by many DataContainers
+ *
+ * Freed blocks are kept per size class and handed to the next request of that class,
+ * so scenes created after others finished (parameter sweeps) reuse their storage
+ * instead of going back to the system allocator. Blocks above max_block_bytes are
+ * not pooled.
+ */
+class PoolResource : public MemoryResource {
+public:
+  constexpr static int min_class = 8;    // 256 B
+  constexpr static int max_class = 28;   // 256 MiB
+  constexpr static size_t max_block_bytes = size_t(1) << max_class;
+  constexpr static size_t block_alignment = 64;
+
+  struct Statistics {
+    size_t bytes_in_use, bytes_pooled;
+    size_t hits, misses;
+  };
+
+  PoolResource() = default;
+  ~PoolResource() override { release(); }
+  PoolResource(const PoolResource&) = delete;
+  PoolResource& operator=(const PoolResource&) = delete;
+
+  void* allocate(size_t bytes, size_t alignment) override;
+  void deallocate(void* p, size_t bytes, size_t alignment) override;
+
+  // give pooled blocks back to the system, blocks in use are not affected
+  void release();
+  Statistics statistics() const;
+
+private:
+  struct SizeClass {
+    std::mutex mutex;
+    std::vector<void*> free;
+  };
+
+  static int size_class(size_t bytes);
+
+  std::array<SizeClass, max_class + 1> classes_;
+  std::atomic<size_t> bytes_in_use_{0}, bytes_pooled_{0};
+  std::atomic<size_t> hits_{0}, misses_{0};
+};
+
+}   // namespace MS
+
+#endif   // METASIM_POOL_RESOURCE_HPP
@@ -126,8 +126,7 @@ struct RangeSet {
   template<typename... Rest>
   void intersect(const Range& range, Rest&&... rest) {
     auto p = std::equal_range(ranges.begin(), ranges.end(), range);
-    RangeSet new_range_set(*this);
-    auto& new_ranges = new_range_set.ranges;
+    std::vector<Range> new_ranges;
 
     if (p.first != p.second) {
       auto leftmost_upper = p.first->upper;
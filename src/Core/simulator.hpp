@@ -5,8 +5,13 @@
 #ifndef METASIM_SIMULATOR_HPP
 #define METASIM_SIMULATOR_HPP
 
+#include "core/memory_telemetry.hpp"
 #include "core/meta.hpp"
+#include "core/phase_graph.hpp"
+#include "core/step_arena.hpp"
+#include "utils/frame_codec.hpp"
 #include "utils/logger.hpp"
+#include "utils/perf_counters.hpp"
 #include "utils/profiler.hpp"
 
 namespace MS {
@@ -35,11 +40,69 @@ public:
   virtual void initialize() = 0;
 
   Simulator() {
-    if (set_timer) {}
+    memory_telemetry.watch("step_arena", [this] { return MemoryTelemetry::usage(*step_arena); });
   }
 
+  // number of work items (particles) of a frame, the unit of per item counter metrics
+  virtual size_t work_items() const { return 0; }
+
   virtual ~Simulator() {
-    if (set_timer) {}
+    if (set_timer) {
+      if (write_log) {
+        Profiler::report();
+        if (!step_graph.empty()) step_graph.report();
+      }
+      // one trace per process, simulators add their zones and leave the buffers empty
+      std::filesystem::create_directories(context.output_dir);
+      Profiler::export_chrome_trace(context.output_dir + "/profile.json");
+      Profiler::clear();
+    }
+    if (log_memory && write_log) memory_telemetry.report();
+  }
+
+  // advance_frame with its callbacks, profiled as zone "frame"; deferred phases of
+  // step_graph finish before the frame end callbacks, never later than the frame
+  void simulate_frame() {
+    // read here rather than on construction, so set_timer may be changed until the first frame
+    if (set_timer && !Profiler::enabled()) Profiler::set_enabled(true);
+    META_PROFILE_SCOPE("frame");
+    for (auto& callback : frame_begin_callbacks) callback(frame_cnt);
+    if (set_counters && !PerfCounters::enabled()) PerfCounters::enable();
+    advance_frame();
+    step_graph.wait();
+    for (auto& callback : frame_end_callbacks) callback(frame_cnt);
+    if (set_counters && write_log) PerfCounters::report_frame(frame_cnt, work_items());
+    if (log_memory) memory_telemetry.sample_frame(frame_cnt);
+    frame_cnt++;
+  }
+
+  // advance_step with its callbacks, profiled as zone "step", phases nest below it
+  // a non-empty step_graph replaces advance_step; steps run outside of simulate_frame
+  // must be followed by step_graph.wait() before the simulator or what the phases use goes
+  void simulate_step() {
+    META_PROFILE_SCOPE("step");
+    for (auto& callback : step_begin_callbacks) callback(frame_cnt, total_time);
+    if (step_graph.empty()) {
+      advance_step();
+    } else {
+      step_graph.run();
+    }
+    total_time += dt;
+    step_cnt++;
+    for (auto& callback : step_end_callbacks) callback(frame_cnt, total_time);
+    step_arena->reset();
+  }
+
+  // queue the attributes of tags (all without tags) for asynchronous output when
+  // write_frame is set, only the copy into a staging buffer happens on this thread
+  template<typename... Types>
+  void output_frame(const DataContainer& data, const TypeTag<Types>&... tags) {
+    if (!write_frame) return;
+    if (!frame_writer) {
+      frame_writer = std::make_unique<FrameWriter>(
+        2, frame_codec ? frame_codec->sink(context.output_dir) : FrameWriter::sink_t{});
+    }
+    frame_writer->submit(frame_cnt, data, tags...);
   }
 
 public:
@@ -47,6 +110,10 @@ public:
   bool write_log{true};
   bool write_frame{true};
   bool set_timer{true};
+  // hardware counters of META_PROFILE_PHASE phases, reported after every frame
+  bool set_counters{false};
+  // sample memory_telemetry after every frame, which also checks its budget
+  bool log_memory{false};
 
 public:
   T dt;
@@ -55,6 +122,19 @@ public:
   int frame_cnt;   // current frame count
   int step_cnt;    // current step count
   T total_time;
+
+  // phases of a step and their dependencies, built once and run by simulate_step
+  PhaseGraph step_graph;
+  // transient buffers of a step, reset after the step end callbacks; deferred phases of
+  // step_graph overlap the next step and must not use it
+  std::shared_ptr<StepArena> step_arena{std::make_shared<StepArena>()};
+  // bytes of step_arena and of what else is watched (particle containers, grids, pools)
+  MemoryTelemetry memory_telemetry;
+
+  // optional compression of output frames, set up before the first output_frame
+  std::unique_ptr<FrameCodec> frame_codec;
+  // declared after frame_codec, so pending frames are written before the codec goes away
+  std::unique_ptr<FrameWriter> frame_writer;
 };
 }   // namespace MS
 
@@ -0,0 +1,180 @@
+#include "Core/snapshot.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <tbb/parallel_for.h>
+#include <unordered_set>
+
+namespace MS {
+
+void Snapshot::read(const ArrayState& array, size_t offset, void* out, size_t bytes) const {
+  auto target = static_cast<char*>(out);
+  while (bytes > 0) {
+    auto& page = *array.pages[offset / page_bytes];
+    size_t begin = offset % page_bytes;
+    size_t n = std::min(bytes, page.size() - begin);
+    std::memcpy(target, page.data() + begin, n);
+    target += n;
+    offset += n;
+    bytes -= n;
+  }
+}
+
+size_t Snapshot::stored_index(const ArrayState& array, int entry) {
+  if (!array.layout) return size_t(array.ranges.query_offset(entry));
+  auto iter = std::upper_bound(array.ranges.begin(), array.ranges.end(), Range{entry, entry + 1});
+  size_t i = std::prev(iter) - array.ranges.begin();
+  auto& layout = *array.layout;
+  return layout.offsets[i] + (layout.uniform[i] ? 0 : entry - array.ranges[i].lower);
+}
+
+namespace {
+
+bool same_range_layout(const RangeLayout* a, const RangeLayout* b) {
+  if (!a || !b) return a == b;
+  return a->offsets == b->offsets && a->uniform == b->uniform;
+}
+
+}   // namespace
+
+int SnapshotStore::take(const DataContainer& container) {
+  const Snapshot* previous = latest();
+  if (previous && previous->page_bytes != page_bytes) previous = nullptr;
+
+  Snapshot snapshot;
+  snapshot.id = next_id_++;
+  snapshot.total_size = container.total_size;
+  snapshot.page_bytes = page_bytes;
+  report_ = Report();
+
+  for (auto& [hash, array] : container.dataset) {
+    Snapshot::ArrayState state{array.get(),
+                               array->name,
+                               array->ranges,
+                               array->version,
+                               array->element_size(),
+                               array->element_count(),
+                               nullptr,
+                               array->stored_count(),
+                               {}};
+    size_t bytes = array->stored_bytes();
+    report_.bytes_total += bytes;
+    auto old = previous ? previous->find(hash) : nullptr;
+    bool same_layout = old && old->source == array.get() &&
+                       old->element_size == state.element_size &&
+                       old->stored_count == state.stored_count &&
+                       old->ranges.ranges == state.ranges.ranges &&
+                       same_range_layout(old->layout.get(), array->stored_layout());
+    if (same_layout) {
+      state.layout = old->layout;
+    } else if (array->stored_layout()) {
+      state.layout = std::make_shared<const RangeLayout>(*array->stored_layout());
+    }
+    if (same_layout && trust_versions && old->version == state.version) {
+      state.pages = old->pages;
+      report_.arrays_shared++;
+      snapshot.arrays.emplace(hash, std::move(state));
+      continue;
+    }
+
+    // unchanged pages are shared with the previous snapshot, the others copied
+    auto data = static_cast<const char*>(array->stored_data());
+    state.pages.resize((bytes + page_bytes - 1) / page_bytes);
+    std::atomic<size_t> copied{0};
+    tbb::parallel_for(size_t(0), state.pages.size(), [&](size_t page) {
+      size_t begin = page * page_bytes;
+      size_t n = std::min(page_bytes, bytes - begin);
+      if (same_layout && std::memcmp(old->pages[page]->data(), data + begin, n) == 0) {
+        state.pages[page] = old->pages[page];
+        return;
+      }
+      state.pages[page] = std::make_shared<const std::vector<char>>(data + begin, data + begin + n);
+      copied += n;
+    });
+    report_.bytes_copied += copied;
+    report_.arrays_compared++;
+    snapshot.arrays.emplace(hash, std::move(state));
+  }
+
+  snapshots_.push_back(std::move(snapshot));
+  while (snapshots_.size() > std::max<size_t>(capacity, 1)) snapshots_.pop_front();
+
+  if (write_log) {
+    META_INFO("snapshot {}: copied {:.1f} of {:.1f} MB, arrays shared {}, compared {}",
+              snapshots_.back().id,
+              report_.bytes_copied / 1e6,
+              report_.bytes_total / 1e6,
+              report_.arrays_shared,
+              report_.arrays_compared);
+  }
+  return snapshots_.back().id;
+}
+
+bool SnapshotStore::restore(DataContainer& container, int id) const {
+  auto snapshot = find(id);
+  if (!snapshot) {
+    META_ERROR("snapshot {} is not kept", id);
+    return false;
+  }
+  // arrays can only be restored in place, their types are not known here
+  for (auto& [hash, state] : snapshot->arrays) {
+    auto iter = container.dataset.find(hash);
+    if (iter == container.dataset.end() || iter->second->element_size() != state.element_size) {
+      META_ERROR("snapshot {}: array {} was removed or replaced", id, state.name);
+      return false;
+    }
+  }
+
+  for (auto iter = container.dataset.begin(); iter != container.dataset.end();) {
+    if (snapshot->arrays.count(iter->first)) {
+      ++iter;
+    } else {
+      iter = container.dataset.erase(iter);
+    }
+  }
+
+  for (auto& [hash, state] : snapshot->arrays) {
+    auto& array = *container.dataset[hash];
+    bool same_layout = array.stored_count() == state.stored_count &&
+                       array.ranges.ranges == state.ranges.ranges &&
+                       same_range_layout(array.stored_layout(), state.layout.get());
+    if (same_layout && trust_versions && &array == state.source &&
+        array.version == state.version) {
+      continue;
+    }
+    // the stored values as they were, uniform ranges included
+    auto storage = array.assign_storage(state.ranges, state.layout.get(), state.stored_count);
+    auto data = static_cast<char*>(storage);
+    tbb::parallel_for(size_t(0), state.pages.size(), [&](size_t page) {
+      auto& stored = *state.pages[page];
+      char* target = data + page * snapshot->page_bytes;
+      if (std::memcmp(target, stored.data(), stored.size()) != 0) {
+        std::memcpy(target, stored.data(), stored.size());
+      }
+    });
+  }
+  container.total_size = snapshot->total_size;
+  return true;
+}
+
+const Snapshot* SnapshotStore::find(int id) const {
+  for (auto& snapshot : snapshots_) {
+    if (snapshot.id == id) return &snapshot;
+  }
+  return nullptr;
+}
+
+size_t SnapshotStore::bytes() const {
+  std::unordered_set<const void*> counted;
+  size_t total = 0;
+  for (auto& snapshot : snapshots_) {
+    for (auto& [hash, state] : snapshot.arrays) {
+      for (auto& page : state.pages) {
+        if (counted.insert(page.get()).second) total += page->size();
+      }
+    }
+  }
+  return total;
+}
+
+}   // namespace MS
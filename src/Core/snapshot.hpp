@@ -0,0 +1,139 @@
+#ifndef METASIM_SNAPSHOT_HPP
+#define METASIM_SNAPSHOT_HPP
+
+#include "Core/data_container.hpp"
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace MS {
+
+// state of a DataContainer at one point, storage pages are shared between snapshots
+class Snapshot {
+public:
+  using page_t = std::shared_ptr<const std::vector<char>>;
+
+  // the storage of an array as held, see DataArrayBase::stored_data
+  struct ArrayState {
+    const DataArrayBase* source;
+    std::string name;
+    RangeSet ranges;
+    uint64_t version;
+    size_t element_size;
+    size_t element_count;
+    // uniform ranges, null for dense storage
+    std::shared_ptr<const RangeLayout> layout;
+    size_t stored_count;
+    std::vector<page_t> pages;
+  };
+
+  int id{-1};
+  int total_size{0};
+  size_t page_bytes{0};
+  std::unordered_map<size_t, ArrayState> arrays;
+
+  const ArrayState* find(size_t type_hash) const {
+    auto iter = arrays.find(type_hash);
+    return iter == arrays.end() ? nullptr : &iter->second;
+  }
+
+  // value of entry of attr_tag when the snapshot was taken, e.g. x_n next to x_{n+1}
+  template<typename Type>
+  Type value(const TypeTag<Type>& attr_tag, int entry) const {
+    auto array = find(attr_tag.type_hash);
+    META_ASSERT(array && array->element_size == sizeof(Type),
+                "no {} in snapshot",
+                attr_tag.type_name);
+    Type result;
+    read(*array, stored_index(*array, entry) * sizeof(Type), &result, sizeof(Type));
+    return result;
+  }
+
+  // all values of attr_tag in storage order, uniform ranges expanded, false if the
+  // snapshot has no such array
+  template<typename Type>
+  bool read(const TypeTag<Type>& attr_tag, std::vector<Type>& values) const {
+    auto array = find(attr_tag.type_hash);
+    if (!array || array->element_size != sizeof(Type)) return false;
+    values.resize(array->element_count);
+    if (!array->layout) {
+      read(*array, 0, values.data(), values.size() * sizeof(Type));
+      return true;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < array->ranges.ranges.size(); i++) {
+      size_t length = array->ranges[i].length();
+      size_t stored = array->layout->offsets[i] * sizeof(Type);
+      if (array->layout->uniform[i]) {
+        read(*array, stored, &values[offset], sizeof(Type));
+        std::fill_n(values.begin() + offset, length, values[offset]);
+      } else {
+        read(*array, stored, &values[offset], length * sizeof(Type));
+      }
+      offset += length;
+    }
+    return true;
+  }
+
+private:
+  void read(const ArrayState& array, size_t offset, void* out, size_t bytes) const;
+  // index of entry in the stored values of array
+  static size_t stored_index(const ArrayState& array, int entry);
+};
+
+/*
+ * Copy-on-write snapshots of a DataContainer, for rolling back a failed step
+ *
+ * take() stores the arrays as held (uniform ranges once, see DataArrayBase::stored_data)
+ * in pages of page_bytes. Arrays whose version did not move since the previous snapshot
+ * share all of its pages without reading them; the others are compared page by page
+ * and only pages that changed are copied, so a snapshot per step reads the arrays the
+ * step wrote to and copies the pages of them that changed. restore() writes back only
+ * the pages that differ, drops arrays created after the snapshot and resizes arrays
+ * whose ranges changed (e.g. emitted or deleted particles).
+ */
+class SnapshotStore {
+public:
+  size_t page_bytes{size_t(1) << 16};
+  // snapshots kept, the oldest is dropped by take()
+  size_t capacity{2};
+  // false: compare every array, for code that writes through kept references without touch()
+  bool trust_versions{true};
+  bool write_log{false};
+
+  struct Report {
+    size_t bytes_total{0};
+    size_t bytes_copied{0};
+    int arrays_shared{0};
+    int arrays_compared{0};
+  };
+
+  // snapshot container, returns its id
+  int take(const DataContainer& container);
+  // put container back to snapshot id, false if it was dropped or can't be restored
+  bool restore(DataContainer& container, int id) const;
+  // the latest snapshot
+  bool restore(DataContainer& container) const {
+    return !snapshots_.empty() && restore(container, snapshots_.back().id);
+  }
+
+  const Snapshot* find(int id) const;
+  const Snapshot* latest() const { return snapshots_.empty() ? nullptr : &snapshots_.back(); }
+  size_t size() const { return snapshots_.size(); }
+  void clear() { snapshots_.clear(); }
+
+  const Report& last_report() const { return report_; }
+  // bytes held by all snapshots, shared pages counted once
+  size_t bytes() const;
+
+private:
+  std::deque<Snapshot> snapshots_;
+  int next_id_{0};
+  Report report_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_SNAPSHOT_HPP
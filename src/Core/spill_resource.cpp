@@ -0,0 +1,200 @@
+#include "Core/spill_resource.hpp"
+#include "Utils/logger.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace MS {
+
+namespace {
+
+constexpr size_t page_bytes = 4096;
+
+size_t round_up(size_t bytes, size_t unit) { return (bytes + unit - 1) / unit * unit; }
+
+}   // namespace
+
+SpillResource::SpillResource(size_t budget, const std::string& directory)
+  : budget(budget)
+  , directory_(directory) {
+  std::error_code error;
+  std::filesystem::create_directories(directory_, error);
+  if (error) META_ERROR("spill: cannot create {}: {}", directory_, error.message());
+}
+
+SpillResource::~SpillResource() {
+  for (auto& [data, mapping] : mappings_) {
+    munmap(mapping.data, mapping.bytes);
+    close(mapping.fd);
+  }
+}
+
+void* SpillResource::allocate(size_t bytes, size_t alignment) {
+  if (bytes < map_threshold || alignment > page_bytes) {
+    return ::operator new(bytes, std::align_val_t(alignment));
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  Mapping mapping;
+  mapping.bytes = round_up(bytes, page_bytes);
+  mapping.segment_bytes = round_up(std::max(segment_bytes, page_bytes), page_bytes);
+
+  // the file is gone with its last descriptor, also when the process dies
+  std::string path = directory_ + "/metasim_spill_XXXXXX";
+  mapping.fd = mkstemp(path.data());
+  if (mapping.fd < 0) {
+    META_ERROR("spill: cannot create a file in {}", directory_);
+    throw std::bad_alloc();
+  }
+  unlink(path.c_str());
+  if (ftruncate(mapping.fd, off_t(mapping.bytes)) != 0) {
+    META_ERROR("spill: cannot extend a file in {} to {:.1f} MB", directory_, bytes / 1e6);
+    close(mapping.fd);
+    throw std::bad_alloc();
+  }
+  void* data = mmap(nullptr, mapping.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, mapping.fd, 0);
+  if (data == MAP_FAILED) {
+    META_ERROR("spill: cannot map {:.1f} MB", bytes / 1e6);
+    close(mapping.fd);
+    throw std::bad_alloc();
+  }
+  mapping.data = static_cast<char*>(data);
+  // the caller fills the block next
+  enforce_locked(mapping.bytes);
+  mapping.last_use.assign((mapping.bytes + mapping.segment_bytes - 1) / mapping.segment_bytes,
+                          ++clock_);
+  bytes_mapped_ += mapping.bytes;
+  mappings_.emplace(mapping.data, std::move(mapping));
+  return data;
+}
+
+void SpillResource::deallocate(void* p, size_t bytes, size_t alignment) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = mappings_.find(static_cast<const char*>(p));
+    if (it != mappings_.end()) {
+      munmap(it->second.data, it->second.bytes);
+      close(it->second.fd);
+      bytes_mapped_ -= it->second.bytes;
+      mappings_.erase(it);
+      return;
+    }
+  }
+  ::operator delete(p, std::align_val_t(alignment));
+}
+
+// op(mapping, segment) for the segments of spilled blocks meeting [p, p + bytes)
+template<typename OP>
+void SpillResource::for_each_segment(const void* p, size_t bytes, OP op) {
+  auto first = static_cast<const char*>(p);
+  auto last = first + bytes;
+  auto it = mappings_.upper_bound(first);
+  if (it != mappings_.begin()) --it;
+  for (; it != mappings_.end() && it->first < last; ++it) {
+    auto& mapping = it->second;
+    auto begin = std::max(first, it->first);
+    auto end = std::min(last, it->first + mapping.bytes);
+    if (begin >= end) continue;
+    size_t first_segment = (begin - mapping.data) / mapping.segment_bytes;
+    size_t last_segment = (end - 1 - mapping.data) / mapping.segment_bytes;
+    for (size_t s = first_segment; s <= last_segment; s++) op(mapping, s);
+  }
+}
+
+void SpillResource::prefetch(const void* p, size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t stamp = ++clock_;
+  size_t spilled = 0;
+  for_each_segment(p, bytes, [&](Mapping& mapping, size_t segment) {
+    mapping.last_use[segment] = stamp;
+    spilled += mapping.segment_bytes;
+  });
+  if (!spilled) return;
+  enforce_locked(std::min(spilled, bytes));
+  for_each_segment(p, bytes, [&](Mapping& mapping, size_t segment) {
+    size_t offset = segment * mapping.segment_bytes;
+    madvise(mapping.data + offset,
+            std::min(mapping.segment_bytes, mapping.bytes - offset),
+            MADV_WILLNEED);
+  });
+}
+
+void SpillResource::done(const void* p, size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for_each_segment(p, bytes, [](Mapping& mapping, size_t segment) {
+    mapping.last_use[segment] = 0;
+  });
+}
+
+size_t SpillResource::enforce() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return enforce_locked(0);
+}
+
+std::vector<size_t> SpillResource::resident_pages(const Mapping& mapping) {
+  std::vector<unsigned char> resident(mapping.bytes / page_bytes);
+  std::vector<size_t> pages(mapping.last_use.size());
+  if (mincore(mapping.data, mapping.bytes, resident.data()) != 0) return pages;
+  size_t pages_per_segment = mapping.segment_bytes / page_bytes;
+  for (size_t page = 0; page < resident.size(); page++) {
+    pages[page / pages_per_segment] += resident[page] & 1;
+  }
+  return pages;
+}
+
+size_t SpillResource::enforce_locked(size_t reserve) {
+  size_t target = budget > reserve ? budget - reserve : 0;
+  struct Candidate {
+    uint64_t last_use;
+    Mapping* mapping;
+    size_t segment, bytes;
+  };
+  std::vector<Candidate> candidates;
+  size_t resident = 0;
+  for (auto& [data, mapping] : mappings_) {
+    auto pages = resident_pages(mapping);
+    for (size_t s = 0; s < pages.size(); s++) {
+      if (!pages[s]) continue;
+      resident += pages[s] * page_bytes;
+      candidates.push_back({mapping.last_use[s], &mapping, s, pages[s] * page_bytes});
+    }
+  }
+  if (resident <= target) return 0;
+
+  std::sort(candidates.begin(), candidates.end(), [](auto& a, auto& b) {
+    return a.last_use < b.last_use;
+  });
+  size_t dropped = 0;
+  for (auto& candidate : candidates) {
+    if (resident - dropped <= target) break;
+    auto& mapping = *candidate.mapping;
+    size_t offset = candidate.segment * mapping.segment_bytes;
+    size_t length = std::min(mapping.segment_bytes, mapping.bytes - offset);
+    // write back, unmap the pages and drop them from the page cache
+    msync(mapping.data + offset, length, MS_SYNC);
+    madvise(mapping.data + offset, length, MADV_DONTNEED);
+    posix_fadvise(mapping.fd, off_t(offset), off_t(length), POSIX_FADV_DONTNEED);
+    dropped += candidate.bytes;
+    segments_evicted_++;
+  }
+  bytes_evicted_ += dropped;
+  if (write_log) {
+    META_INFO("spill: evicted {:.1f} MB, {:.1f} of {:.1f} MB resident",
+              dropped / 1e6,
+              (resident - dropped) / 1e6,
+              budget / 1e6);
+  }
+  return dropped;
+}
+
+SpillResource::Statistics SpillResource::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t resident = 0;
+  for (auto& [data, mapping] : mappings_) {
+    for (auto pages : resident_pages(mapping)) resident += pages * page_bytes;
+  }
+  return {bytes_mapped_, resident, segments_evicted_, bytes_evicted_};
+}
+
+}   // namespace MS
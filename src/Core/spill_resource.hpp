@@ -0,0 +1,100 @@
+#ifndef METASIM_SPILL_RESOURCE_HPP
+#define METASIM_SPILL_RESOURCE_HPP
+
+#include "Core/data_array.hpp"
+#include "Core/memory_resource.hpp"
+#include "meta.hpp"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Out of core storage for attributes that are rarely touched (history buffers, stress
+ * records), in files of a scratch directory (Linux)
+ *
+ * Blocks of at least map_threshold bytes get an unlinked file each, mapped shared: the
+ * kernel pages them in on access and writes them back to their file, not to swap. The
+ * resource keeps the resident bytes of its blocks under budget itself. Blocks are cut
+ * into segments of segment_bytes with a last use stamp, and enforce() writes back and
+ * drops the resident segments used longest ago until the rest fits; allocate() and
+ * prefetch() enforce room for their bytes first. Use is what the hints say: prefetch()
+ * before a pass stamps the segments of a range and reads them ahead, done() after it
+ * makes them the first to go. Segments written without hints keep the stamp of their
+ * allocation.
+ * Hot attributes stay on the heap, cold ones move here with DataContainer::relocate()
+ * (or all arrays created later with DataContainer::resource). The scratch directory
+ * must be on a disk: files on tmpfs stay in memory.
+ */
+class SpillResource : public MemoryResource {
+public:
+  struct Statistics {
+    size_t bytes_mapped;
+    size_t bytes_resident;
+    size_t segments_evicted;
+    size_t bytes_evicted;
+  };
+
+  // resident bytes of spilled blocks
+  size_t budget;
+  // unit of eviction, a multiple of the page size
+  size_t segment_bytes{size_t(4) << 20};
+  size_t map_threshold{size_t(1) << 16};
+  bool write_log{false};
+
+  explicit SpillResource(size_t budget,
+                         const std::string& directory = context.output_dir + "/spill");
+  ~SpillResource() override;
+  SpillResource(const SpillResource&) = delete;
+  SpillResource& operator=(const SpillResource&) = delete;
+
+  void* allocate(size_t bytes, size_t alignment) override;
+  void deallocate(void* p, size_t bytes, size_t alignment) override;
+
+  // about to read or write [p, p + bytes), other storage of this resource, heap blocks
+  // included, is ignored
+  void prefetch(const void* p, size_t bytes);
+  void prefetch(const DataArrayBase& array) {
+    prefetch(array.stored_data(), array.stored_bytes());
+  }
+  // finished with [p, p + bytes) for now, evicted before anything else
+  void done(const void* p, size_t bytes);
+  void done(const DataArrayBase& array) { done(array.stored_data(), array.stored_bytes()); }
+
+  // write back and drop segments used longest ago until the resident bytes fit the
+  // budget, returns the bytes dropped
+  size_t enforce();
+
+  const std::string& directory() const { return directory_; }
+  Statistics statistics() const;
+
+private:
+  struct Mapping {
+    char* data;
+    size_t bytes;
+    size_t segment_bytes;
+    int fd;
+    std::vector<uint64_t> last_use;
+  };
+
+  // fit the budget less reserve bytes, mutex_ held
+  size_t enforce_locked(size_t reserve);
+  // resident pages per segment of mapping
+  static std::vector<size_t> resident_pages(const Mapping& mapping);
+  template<typename OP>
+  void for_each_segment(const void* p, size_t bytes, OP op);
+
+  std::string directory_;
+  mutable std::mutex mutex_;
+  // by address
+  std::map<const char*, Mapping> mappings_;
+  uint64_t clock_{0};
+  size_t bytes_mapped_{0};
+  size_t segments_evicted_{0}, bytes_evicted_{0};
+};
+
+}   // namespace MS
+
+#endif   // METASIM_SPILL_RESOURCE_HPP
@@ -0,0 +1,68 @@
+#include "Core/step_arena.hpp"
+#include <algorithm>
+#include <cstdint>
+
+namespace MS {
+
+StepArena::Chunk StepArena::new_chunk(size_t bytes) {
+  chunk_allocations_++;
+  return {std::unique_ptr<char[]>(new char[bytes]), bytes};
+}
+
+void* StepArena::allocate(size_t bytes, size_t alignment) {
+  auto& arena = sub_arenas_.local();
+  while (true) {
+    if (arena.current < arena.chunks.size()) {
+      auto& chunk = arena.chunks[arena.current];
+      auto base = reinterpret_cast<uintptr_t>(chunk.storage.get());
+      size_t offset = (base + arena.offset + alignment - 1) / alignment * alignment - base;
+      if (offset + bytes <= chunk.bytes) {
+        arena.offset = offset + bytes;
+        arena.used = arena.used_before + arena.offset;
+        return chunk.storage.get() + offset;
+      }
+      // the rest of this chunk stays unused until reset()
+      arena.used_before += chunk.bytes;
+      arena.current++;
+      arena.offset = 0;
+      continue;
+    }
+    size_t last = arena.chunks.empty() ? chunk_bytes_ : arena.chunks.back().bytes;
+    arena.chunks.push_back(new_chunk(std::max(2 * last, bytes + alignment)));
+  }
+}
+
+void StepArena::reset() {
+  bytes_used_ = 0;
+  for (auto& arena : sub_arenas_) {
+    bytes_used_ += arena.used;
+    // one chunk of the high water mark, the next steps fit without allocating
+    if (arena.current > 0) {
+      size_t total = 0;
+      for (auto& chunk : arena.chunks) total += chunk.bytes;
+      arena.chunks.clear();
+      arena.chunks.push_back(new_chunk(total));
+    }
+    arena.current = 0;
+    arena.offset = 0;
+    arena.used_before = 0;
+    arena.used = 0;
+  }
+  high_water_ = std::max(high_water_, bytes_used_);
+  steps_++;
+}
+
+void StepArena::release() {
+  for (auto& arena : sub_arenas_) arena = SubArena();
+}
+
+StepArena::Statistics StepArena::statistics() const {
+  size_t reserved = 0, chunks = 0;
+  for (auto& arena : sub_arenas_) {
+    for (auto& chunk : arena.chunks) reserved += chunk.bytes;
+    chunks += arena.chunks.size();
+  }
+  return {bytes_used_, high_water_, reserved, chunks, chunk_allocations_.load(), steps_};
+}
+
+}   // namespace MS
@@ -0,0 +1,80 @@
+#ifndef METASIM_STEP_ARENA_HPP
+#define METASIM_STEP_ARENA_HPP
+
+#include "Core/memory_resource.hpp"
+#include <atomic>
+#include <memory>
+#include <tbb/enumerable_thread_specific.h>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Bump allocator for the transient buffers of one step (weights, bins, active lists,
+ * scatter caches, reduction temporaries)
+ *
+ * Every thread allocates from a sub-arena of its own without locking; deallocate() is a
+ * no-op and reset() at the end of the step rewinds all sub-arenas at once. A sub-arena
+ * that needed more than one chunk in a step is replaced at reset() by a single chunk of
+ * its high water mark, so steady state steps do not touch the heap at all
+ * (chunk_allocations stops moving).
+ * Storage handed out is only valid until the next reset(): use it through Allocator
+ * (TransientVector, DataArray of a DataContainer with this resource) for buffers that do
+ * not outlive the step, and reserve() vectors, as growing leaves the old block unused.
+ */
+class StepArena : public MemoryResource {
+public:
+  struct Statistics {
+    size_t bytes_used;          // by the last step
+    size_t high_water;          // bytes used by the largest step
+    size_t bytes_reserved;      // chunks held
+    size_t chunks;              // number of chunks held
+    size_t chunk_allocations;   // heap allocations since construction
+    size_t steps;
+  };
+
+  explicit StepArena(size_t chunk_bytes = size_t(1) << 20)
+    : chunk_bytes_(chunk_bytes) {}
+  StepArena(const StepArena&) = delete;
+  StepArena& operator=(const StepArena&) = delete;
+
+  void* allocate(size_t bytes, size_t alignment) override;
+  void deallocate(void*, size_t, size_t) override {}
+
+  // end of step, no storage of this step may be used afterwards; not thread-safe
+  void reset();
+  // give all chunks back to the heap
+  void release();
+
+  Statistics statistics() const;
+
+private:
+  struct Chunk {
+    std::unique_ptr<char[]> storage;
+    size_t bytes;
+  };
+
+  struct SubArena {
+    std::vector<Chunk> chunks;
+    size_t current{0};
+    size_t offset{0};
+    // bytes of the chunks before current, and of this step in total
+    size_t used_before{0};
+    size_t used{0};
+  };
+
+  Chunk new_chunk(size_t bytes);
+
+  size_t chunk_bytes_;
+  tbb::enumerable_thread_specific<SubArena> sub_arenas_;
+  std::atomic<size_t> chunk_allocations_{0};
+  size_t bytes_used_{0}, high_water_{0}, steps_{0};
+};
+
+// vector for storage of a step, e.g. TransientVector<int> bins{Allocator<int>(arena)}
+template<typename T>
+using TransientVector = std::vector<T, Allocator<T>>;
+
+}   // namespace MS
+
+#endif   // METASIM_STEP_ARENA_HPP
@@ -0,0 +1,248 @@
+#ifndef METASIM_BVH_HPP
+#define METASIM_BVH_HPP
+
+#include "meta.hpp"
+#include <algorithm>
+#include <array>
+#include <limits>
+
+namespace MS {
+
+/*
+ * bounding volume hierarchy over axis aligned boxes, built with binned SAH
+ * (Wald, "On fast construction of SAH-based bounding volume hierarchies")
+ *
+ * Nodes are stored in depth first order, children always after their parent,
+ * so refit() is a single reverse sweep and keeps the topology. Refitting is
+ * the cheap path for deforming meshes; rebuild when the motion is large
+ * enough to degrade the tree.
+ */
+template<typename T, int Dim>
+class BVH {
+public:
+  using TV = Vec<Dim, T>;
+  using Box = std::pair<TV, TV>;
+
+  constexpr static int leaf_size = 4;
+  constexpr static int bin_count = 16;
+
+  struct Node {
+    TV lower, upper;
+    // leaf: primitives order_[first, first + count), inner: children first and first + 1
+    int first;
+    int count;
+    bool is_leaf() const { return count > 0; }
+  };
+
+  void build(const std::vector<Box>& boxes) {
+    nodes_.clear();
+    order_.resize(boxes.size());
+    centroids_.resize(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++) {
+      order_[i] = int(i);
+      centroids_[i] = (boxes[i].first + boxes[i].second) * T(0.5);
+    }
+    if (boxes.empty()) return;
+    nodes_.reserve(2 * boxes.size() / leaf_size + 1);
+    nodes_.push_back({});
+    split(boxes, 0, 0, int(boxes.size()));
+    centroids_.clear();
+    centroids_.shrink_to_fit();
+  }
+
+  // recompute node bounds for moved primitives, the boxes must keep their indices
+  void refit(const std::vector<Box>& boxes) {
+    for (int n = int(nodes_.size()) - 1; n >= 0; n--) {
+      auto& node = nodes_[n];
+      if (node.is_leaf()) {
+        set_bounds(node, boxes, node.first, node.first + node.count);
+      } else {
+        const auto &left = nodes_[node.first], &right = nodes_[node.first + 1];
+        node.lower = left.lower.cwiseMin(right.lower);
+        node.upper = left.upper.cwiseMax(right.upper);
+      }
+    }
+  }
+
+  bool empty() const { return nodes_.empty(); }
+  const std::vector<Node>& nodes() const { return nodes_; }
+
+  static T box_distance2(const Node& node, const TV& p) {
+    TV gap = (node.lower - p).cwiseMax(p - node.upper).cwiseMax(TV::Zero());
+    return gap.squaredNorm();
+  }
+
+  /*
+   * nearest primitive to p, closer child first with pruning by box distance
+   * prim_distance2(prim, best2) returns the squared distance of prim to p
+   * returns the primitive index, -1 if nothing is closer than sqrt(max_distance2)
+   */
+  template<typename PrimDistance2>
+  int nearest(const TV& p, PrimDistance2 prim_distance2,
+              T max_distance2 = std::numeric_limits<T>::max()) const {
+    int best = -1;
+    T best2 = max_distance2;
+    if (nodes_.empty() || box_distance2(nodes_[0], p) >= best2) return best;
+
+    std::array<int, 64> stack;
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const auto& node = nodes_[stack[--top]];
+      if (box_distance2(node, p) >= best2) continue;
+      if (node.is_leaf()) {
+        for (int i = node.first; i < node.first + node.count; i++) {
+          T d2 = prim_distance2(order_[i], best2);
+          if (d2 < best2) {
+            best2 = d2;
+            best = order_[i];
+          }
+        }
+        continue;
+      }
+      int near = node.first, far = node.first + 1;
+      T near2 = box_distance2(nodes_[near], p), far2 = box_distance2(nodes_[far], p);
+      if (far2 < near2) {
+        std::swap(near, far);
+        std::swap(near2, far2);
+      }
+      if (far2 < best2) stack[top++] = far;
+      if (near2 < best2) stack[top++] = near;
+    }
+    return best;
+  }
+
+  // calls op(prim) for every primitive whose box overlaps [lower, upper]
+  template<typename OP>
+  void overlapping(const TV& lower, const TV& upper, OP op) const {
+    if (nodes_.empty()) return;
+    std::array<int, 64> stack;
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const auto& node = nodes_[stack[--top]];
+      if ((node.upper.array() < lower.array()).any() || (node.lower.array() > upper.array()).any())
+        continue;
+      if (node.is_leaf()) {
+        for (int i = node.first; i < node.first + node.count; i++) op(order_[i]);
+      } else {
+        stack[top++] = node.first + 1;
+        stack[top++] = node.first;
+      }
+    }
+  }
+
+private:
+  static T half_area(const TV& extent) {
+    if constexpr (Dim == 2) {
+      return extent(0) + extent(1);
+    } else {
+      return extent(0) * extent(1) + extent(1) * extent(2) + extent(2) * extent(0);
+    }
+  }
+
+  void set_bounds(Node& node, const std::vector<Box>& boxes, int begin, int end) const {
+    node.lower = TV::Constant(std::numeric_limits<T>::max());
+    node.upper = TV::Constant(std::numeric_limits<T>::lowest());
+    for (int i = begin; i < end; i++) {
+      node.lower = node.lower.cwiseMin(boxes[order_[i]].first);
+      node.upper = node.upper.cwiseMax(boxes[order_[i]].second);
+    }
+  }
+
+  // the recursion depth is bounded by the 64 entry traversal stack, splits that fail
+  // to separate the primitives fall back to the median
+  void split(const std::vector<Box>& boxes, int n, int begin, int end, int depth = 0) {
+    set_bounds(nodes_[n], boxes, begin, end);
+    int count = end - begin;
+    if (count <= leaf_size || depth >= 48) {
+      nodes_[n].first = begin;
+      nodes_[n].count = count;
+      return;
+    }
+
+    TV c_lower = TV::Constant(std::numeric_limits<T>::max());
+    TV c_upper = TV::Constant(std::numeric_limits<T>::lowest());
+    for (int i = begin; i < end; i++) {
+      c_lower = c_lower.cwiseMin(centroids_[order_[i]]);
+      c_upper = c_upper.cwiseMax(centroids_[order_[i]]);
+    }
+
+    // binned SAH over all axes
+    int best_axis = -1, best_bin = 0;
+    T best_cost = std::numeric_limits<T>::max();
+    for (int axis = 0; axis < Dim; axis++) {
+      T extent = c_upper(axis) - c_lower(axis);
+      if (extent <= 0) continue;
+      T scale = bin_count / extent;
+      std::array<int, bin_count> bin_n{};
+      std::array<TV, bin_count> bin_lower, bin_upper;
+      bin_lower.fill(TV::Constant(std::numeric_limits<T>::max()));
+      bin_upper.fill(TV::Constant(std::numeric_limits<T>::lowest()));
+      for (int i = begin; i < end; i++) {
+        int b = bin_of(centroids_[order_[i]](axis), c_lower(axis), scale);
+        bin_n[b]++;
+        bin_lower[b] = bin_lower[b].cwiseMin(boxes[order_[i]].first);
+        bin_upper[b] = bin_upper[b].cwiseMax(boxes[order_[i]].second);
+      }
+      // sweep from the right, then evaluate every plane from the left
+      std::array<T, bin_count> right_cost;
+      TV lo = TV::Constant(std::numeric_limits<T>::max());
+      TV hi = TV::Constant(std::numeric_limits<T>::lowest());
+      int right_n = 0;
+      for (int b = bin_count - 1; b > 0; b--) {
+        right_n += bin_n[b];
+        lo = lo.cwiseMin(bin_lower[b]);
+        hi = hi.cwiseMax(bin_upper[b]);
+        right_cost[b] = right_n ? right_n * half_area(hi - lo) : 0;
+      }
+      lo = TV::Constant(std::numeric_limits<T>::max());
+      hi = TV::Constant(std::numeric_limits<T>::lowest());
+      int left_n = 0;
+      for (int b = 0; b < bin_count - 1; b++) {
+        left_n += bin_n[b];
+        lo = lo.cwiseMin(bin_lower[b]);
+        hi = hi.cwiseMax(bin_upper[b]);
+        if (left_n == 0 || left_n == count) continue;
+        T cost = left_n * half_area(hi - lo) + right_cost[b + 1];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = b;
+        }
+      }
+    }
+
+    int mid;
+    if (best_axis < 0) {
+      // all centroids coincide, cut in the middle
+      mid = begin + count / 2;
+    } else {
+      T scale = bin_count / (c_upper(best_axis) - c_lower(best_axis));
+      auto middle = std::partition(order_.begin() + begin, order_.begin() + end, [&](int prim) {
+        return bin_of(centroids_[prim](best_axis), c_lower(best_axis), scale) <= best_bin;
+      });
+      mid = int(middle - order_.begin());
+    }
+
+    int left = int(nodes_.size());
+    nodes_[n].first = left;
+    nodes_[n].count = 0;
+    nodes_.push_back({});
+    nodes_.push_back({});
+    split(boxes, left, begin, mid, depth + 1);
+    split(boxes, left + 1, mid, end, depth + 1);
+  }
+
+  static int bin_of(T c, T lower, T scale) {
+    return std::min(bin_count - 1, std::max(0, int((c - lower) * scale)));
+  }
+
+  std::vector<Node> nodes_;
+  std::vector<int> order_;
+  std::vector<TV> centroids_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_BVH_HPP
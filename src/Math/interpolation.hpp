@@ -13,47 +13,56 @@ public:
     virtual ~InterpolationKernelBase() = default;
 };
 
-template<typename KernelImpl, int Dim, int Order>
+// T: scalar of weights and gradients, positions may be passed in a wider type
+// (e.g. double positions with float weights in MixedPrecision)
+template<typename KernelImpl, int Dim, int Order, typename TScalar = real>
 struct MPMInterpolationKernel : InterpolationKernelBase {
 public:
-    using T = real;
+    using T = TScalar;
     using TVI = Vec<Dim, int>;
     using TV = Vec<Dim, T>;
 
-    using KernelVec = Vec<Order + 1>;
-    using KernelMat = Mat<Order + 1, Dim>;
+    using KernelVec = Vec<Order + 1, T>;
+    using KernelMat = Mat<Order + 1, Dim, T>;
 
     constexpr static const int order = Order;
 
     // pass in particle_pos in Grid Space (aka. xp / dx)
+    // the offset to base node is taken in TIn before narrowing to T, so float weights
+    // stay accurate far away from the origin
+    template<typename TIn>
     static std::tuple<TVI, KernelMat, KernelMat, KernelMat> calc_o_w_dw_ddw(
-            const TV &xp_div_dx) {
+            const Vec<Dim, TIn> &xp_div_dx) {
         KernelMat w, dw, ddw;
         auto o = calc_base_node(xp_div_dx);
         for (int i = 0; i < Dim; i++) {
-            w.col(i) = calc_weight(o(i), xp_div_dx(i));
-            dw.col(i) = calc_weight_grad(o(i), xp_div_dx(i));
-            ddw.col(i) = calc_weight_hessian(o(i), xp_div_dx(i));
+            T x = calc_local_offset(o(i), xp_div_dx(i));
+            w.col(i) = calc_weight(0, x);
+            dw.col(i) = calc_weight_grad(0, x);
+            ddw.col(i) = calc_weight_hessian(0, x);
         }
         return {o, w, dw, ddw};
     }
 
+    template<typename TIn>
     static std::tuple<TVI, KernelMat, KernelMat> calc_o_w_dw(
-            const TV &xp_div_dx) {
-        KernelMat w, dw, ddw;
+            const Vec<Dim, TIn> &xp_div_dx) {
+        KernelMat w, dw;
         auto o = calc_base_node(xp_div_dx);
         for (int i = 0; i < Dim; i++) {
-            w.col(i) = calc_weight(o(i), xp_div_dx(i));
-            dw.col(i) = calc_weight_grad(o(i), xp_div_dx(i));
+            T x = calc_local_offset(o(i), xp_div_dx(i));
+            w.col(i) = calc_weight(0, x);
+            dw.col(i) = calc_weight_grad(0, x);
         }
         return {o, w, dw};
     }
 
-    static std::tuple<TVI, KernelMat> calc_o_w(const TV &xp_div_dx) {
-        KernelMat w, dw, ddw;
+    template<typename TIn>
+    static std::tuple<TVI, KernelMat> calc_o_w(const Vec<Dim, TIn> &xp_div_dx) {
+        KernelMat w;
         auto o = calc_base_node(xp_div_dx);
         for (int i = 0; i < Dim; i++) {
-            w.col(i) = calc_weight(o(i), xp_div_dx(i));
+            w.col(i) = calc_weight(0, calc_local_offset(o(i), xp_div_dx(i)));
         }
         return {o, w};
     }
@@ -81,13 +90,23 @@ public:
         return KernelImpl::calc_weight_hessian(o, x);
     };
 
-    static TVI calc_base_node(const Vec<Dim> &center) {
-        return Eigen::floor(center.array() - 0.5 * (Order - 1)).cast<int>();
+    template<typename TIn>
+    static TVI calc_base_node(const Vec<Dim, TIn> &center) {
+        return (center.array() - TIn(0.5 * (Order - 1))).floor().template cast<int>();
+    }
+
+    template<typename TIn>
+    static T calc_local_offset(int o, TIn x) {
+        return T(x - TIn(o));
     }
 };
 
-template<int Dim>
-struct QuadraticKernel : public MPMInterpolationKernel<QuadraticKernel, Dim, 2> {
+template<int Dim, typename TScalar = real>
+struct QuadraticKernel
+    : public MPMInterpolationKernel<QuadraticKernel<Dim, TScalar>, Dim, 2, TScalar> {
+    using Base = MPMInterpolationKernel<QuadraticKernel<Dim, TScalar>, Dim, 2, TScalar>;
+    using typename Base::T;
+    using typename Base::KernelVec;
 
     static KernelVec calc_weight(T o, T x) {
         // +-(o)------(o+1)--(x)--(o+2)-+
@@ -112,8 +131,12 @@ struct QuadraticKernel : public MPMInterpolationKernel<QuadraticKernel, Dim, 2>
     }
 };
 
-template<int Dim>
-struct CubicKernel : public MPMInterpolationKernel<CubicKernel, Dim, 3> {
+template<int Dim, typename TScalar = real>
+struct CubicKernel
+    : public MPMInterpolationKernel<CubicKernel<Dim, TScalar>, Dim, 3, TScalar> {
+    using Base = MPMInterpolationKernel<CubicKernel<Dim, TScalar>, Dim, 3, TScalar>;
+    using typename Base::T;
+    using typename Base::KernelVec;
 
     static KernelVec calc_weight(T o, T x) {
         T d0 = x - o;
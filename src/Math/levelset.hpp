@@ -0,0 +1,570 @@
+#ifndef METASIM_LEVELSET_HPP
+#define METASIM_LEVELSET_HPP
+
+#include "Math/bvh.hpp"
+#include "Math/triangle_mesh.hpp"
+#include "Utils/logger.hpp"
+#include "meta.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_sort.h>
+#include <unordered_map>
+
+namespace MS {
+
+/*
+ * Narrow band signed distance field on sparse blocks
+ *
+ * nodes sit at integer coords * dx, grouped in blocks of block_width^Dim nodes.
+ * Only blocks within band_width cells of the interface are allocated, so memory
+ * grows with the surface area. Outside the band, values are clamped to
+ * +-band_width * dx, the sign is recovered by looking for the band along -x.
+ * Negative inside.
+ */
+template<typename T, int Dim>
+class SparseLevelSet {
+public:
+  using TV = Vec<Dim, T>;
+  using TVI = Vec<Dim, int>;
+
+  constexpr static int block_width = 8;
+  constexpr static int block_size = Dim == 2 ? 64 : 512;
+
+  SparseLevelSet(T dx, int band_width = 3)
+    : dx_(dx)
+    , inv_dx_(T(1) / dx)
+    , band_width_(band_width) {}
+
+  T dx() const { return dx_; }
+  T band() const { return band_width_ * dx_; }
+  size_t num_blocks() const { return block_coords_.size(); }
+  size_t memory_bytes() const {
+    return phi_.size() * sizeof(T) + block_coords_.size() * sizeof(TVI) +
+           neighbors_.size() * sizeof(neighbors_[0]) +
+           block_index_.size() * (sizeof(uint64_t) + sizeof(int) + 2 * sizeof(void*));
+  }
+
+  void clear() {
+    block_index_.clear();
+    block_coords_.clear();
+    neighbors_.clear();
+    phi_.clear();
+  }
+
+  /*
+   * union of spheres of the given radius around particles, then redistanced
+   * positions: any container with size() and operator[] returning TV
+   */
+  template<typename TPositions>
+  void build_from_particles(const TPositions& positions, T radius) {
+    clear();
+    auto n = positions.size();
+    T reach = radius + band();
+
+    // (block, particle) pairs grouped by block, so every block is splatted by one task
+    auto pairs = block_pairs(n, [&](size_t p) {
+      TV x = positions[p];
+      return std::make_pair(TV(x.array() - reach), TV(x.array() + reach));
+    });
+    auto ranges = group_ranges(pairs);
+    auto blocks = activate_groups(pairs, ranges);
+
+    tbb::parallel_for(size_t(0), blocks.size(), [&](size_t g) {
+      int b = blocks[g];
+      T* phi = block_phi(b);
+      TVI block_origin = block_coords_[b] * block_width;
+      for (auto k = ranges[g]; k < ranges[g + 1]; k++) {
+        TV xp = positions[pairs[k].second];
+        // only the nodes of this block inside the reach of the particle
+        TVI lo, hi;
+        for (int d = 0; d < Dim; d++) {
+          lo(d) = std::max(int(std::ceil((xp(d) - reach) * inv_dx_)) - block_origin(d), 0);
+          hi(d) = std::min(int(std::floor((xp(d) + reach) * inv_dx_)) - block_origin(d),
+                           block_width - 1);
+        }
+        for_each_in_box(lo, hi, [&](const TVI& local) {
+          auto l = local_index(local);
+          T d = (node_position(b, l) - xp).norm() - radius;
+          phi[l] = std::min(phi[l], d);
+        });
+      }
+    });
+
+    redistance();
+    prune();
+  }
+
+  // exact distances from a closed, consistently oriented triangle mesh
+  void build_from_mesh(TriangleMesh<T>& mesh) {
+    static_assert(Dim == 3, "mesh level set needs Dim == 3");
+    clear();
+    if (mesh.face_normals.size() != mesh.faces.size()) mesh.compute_normals();
+
+    // blocks within the band of a face
+    std::vector<std::pair<TV, TV>> boxes(mesh.faces.size());
+    tbb::parallel_for(size_t(0), boxes.size(), [&](size_t f) { boxes[f] = mesh.face_bounds(f); });
+    auto pairs = block_pairs(boxes.size(), [&](size_t f) {
+      return std::make_pair(TV(boxes[f].first.array() - band()),
+                            TV(boxes[f].second.array() + band()));
+    });
+    auto blocks = activate_groups(pairs, group_ranges(pairs));
+    // the pseudo normal sign is only reliable inside the band, where every close face is seen
+    std::vector<char> known(phi_.size());
+
+    // closest face of every node within the band
+    BVH<T, 3> bvh;
+    bvh.build(boxes);
+    T band2 = band() * band();
+    tbb::parallel_for(size_t(0), blocks.size(), [&](size_t g) {
+      int b = blocks[g];
+      T* phi = block_phi(b);
+      for (int l = 0; l < block_size; l++) {
+        TV x = node_position(b, l);
+        int face = bvh.nearest(
+          x,
+          [&](int f, T) {
+            int feature;
+            const auto& tri = mesh.faces[f];
+            return (x - closest_point_on_triangle(x,
+                                                  mesh.vertices[tri(0)],
+                                                  mesh.vertices[tri(1)],
+                                                  mesh.vertices[tri(2)],
+                                                  feature))
+              .squaredNorm();
+          },
+          band2);
+        if (face < 0) continue;
+        TV normal;
+        TV q = mesh.closest_point(face, x, normal);
+        T d = (x - q).norm();
+        known[b * block_size + l] = 1;
+        phi[l] = (x - q).dot(normal) < 0 ? -d : d;
+      }
+    });
+    propagate_sign(known);
+    prune();
+  }
+
+  /*
+   * parallel fast sweeping on the band
+   * nodes next to a sign change are kept, the others are recomputed from the Eikonal
+   * equation. Blocks are swept in parallel (Gauss-Seidel inside a block with all 2^Dim
+   * orderings, Jacobi across blocks) until the largest update is below tolerance * dx.
+   */
+  int redistance(int max_iterations = 32, T tolerance = T(1e-4)) {
+    auto n_blocks = num_blocks();
+    if (!n_blocks) return 0;
+    std::vector<char> frozen(phi_.size());
+    tbb::parallel_for(size_t(0), n_blocks, [&](size_t b) {
+      for (int l = 0; l < block_size; l++) frozen[b * block_size + l] = is_interface(b, l);
+    });
+    tbb::parallel_for(size_t(0), phi_.size(), [&](size_t i) {
+      if (!frozen[i]) phi_[i] = phi_[i] < 0 ? -band() : band();
+    });
+
+    std::vector<T> previous;
+    int iteration = 0;
+    for (; iteration < max_iterations; iteration++) {
+      previous = phi_;
+      T max_change = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, n_blocks),
+        T(0),
+        [&](const tbb::blocked_range<size_t>& r, T change) {
+          for (auto b = r.begin(); b != r.end(); b++) {
+            change = std::max(change, sweep_block(b, frozen, previous));
+          }
+          return change;
+        },
+        [](T a, T b) { return std::max(a, b); });
+      if (max_change < tolerance * dx_) break;
+    }
+    return iteration;
+  }
+
+  // batched queries, phi and grad are resized to positions.size(), grad is optional
+  template<typename TPositions>
+  void sample(const TPositions& positions, std::vector<T>& phi,
+              std::vector<TV>* grad = nullptr) const {
+    phi.resize(positions.size());
+    if (grad) grad->resize(positions.size());
+    tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, positions.size()), [&](const tbb::blocked_range<size_t>& r) {
+        for (auto p = r.begin(); p != r.end(); p++) {
+          TV g;
+          phi[p] = value_and_gradient(positions[p], g);
+          if (grad) (*grad)[p] = g;
+        }
+      });
+  }
+
+  T value(const TV& x) const {
+    TV g;
+    return value_and_gradient(x, g);
+  }
+
+  // multilinear interpolation of the cell corners and its analytic gradient
+  T value_and_gradient(const TV& x, TV& grad) const {
+    TV xi = x * inv_dx_;
+    TVI base = xi.array().floor().template cast<int>();
+    TV frac = xi - base.template cast<T>();
+
+    std::array<T, 1 << Dim> corner;
+    for (int c = 0; c < (1 << Dim); c++) {
+      TVI node = base;
+      for (int d = 0; d < Dim; d++) node(d) += (c >> d) & 1;
+      corner[c] = node_value(node);
+    }
+
+    T value = 0;
+    grad.setZero();
+    for (int c = 0; c < (1 << Dim); c++) {
+      T w = 1;
+      TV dw = TV::Ones();
+      for (int d = 0; d < Dim; d++) {
+        bool upper = (c >> d) & 1;
+        T wd = upper ? frac(d) : 1 - frac(d);
+        T dwd = upper ? inv_dx_ : -inv_dx_;
+        for (int e = 0; e < Dim; e++) dw(e) *= e == d ? dwd : wd;
+        w *= wd;
+      }
+      value += w * corner[c];
+      grad += dw * corner[c];
+    }
+    return value;
+  }
+
+  // value at a grid node, clamped to the band outside of allocated blocks
+  T node_value(const TVI& node) const {
+    TVI block, local;
+    split(node, block, local);
+    auto it = block_index_.find(block_key(block));
+    if (it != block_index_.end()) return phi_[it->second * block_size + local_index(local)];
+    return far_sign(block, local) * band();
+  }
+
+private:
+  constexpr static uint64_t key_bits = 21;
+  constexpr static int key_offset = 1 << (key_bits - 1);
+
+  static uint64_t block_key(const TVI& block) {
+    uint64_t key = 0;
+    for (int d = 0; d < Dim; d++) key = (key << key_bits) | uint64_t(block(d) + key_offset);
+    return key;
+  }
+
+  static int floor_div(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+  static void split(const TVI& node, TVI& block, TVI& local) {
+    for (int d = 0; d < Dim; d++) {
+      block(d) = floor_div(node(d), block_width);
+      local(d) = node(d) - block(d) * block_width;
+    }
+  }
+
+  static int local_index(const TVI& local) {
+    int index = 0;
+    for (int d = 0; d < Dim; d++) index = index * block_width + local(d);
+    return index;
+  }
+
+  static TVI local_coord(int index) {
+    TVI local;
+    for (int d = Dim - 1; d >= 0; d--) {
+      local(d) = index % block_width;
+      index /= block_width;
+    }
+    return local;
+  }
+
+  TV node_position(int b, int l) const {
+    return (block_coords_[b] * block_width + local_coord(l)).template cast<T>() * dx_;
+  }
+
+  T* block_phi(int b) { return phi_.data() + size_t(b) * block_size; }
+
+  // visit all integer coords in [lo, hi]
+  template<typename OP>
+  static void for_each_in_box(const TVI& lo, const TVI& hi, OP op) {
+    for (int d = 0; d < Dim; d++) {
+      if (lo(d) > hi(d)) return;
+    }
+    TVI coord = lo;
+    while (true) {
+      op(coord);
+      int d = Dim - 1;
+      while (d >= 0 && ++coord(d) > hi(d)) {
+        coord(d) = lo(d);
+        d--;
+      }
+      if (d < 0) break;
+    }
+  }
+
+  int activate(const TVI& block) {
+    auto [it, inserted] = block_index_.try_emplace(block_key(block), int(block_coords_.size()));
+    if (inserted) block_coords_.push_back(block);
+    return it->second;
+  }
+
+  // allocate values and resolve the 2 * Dim face neighbors of every block
+  void finish_activation() {
+    phi_.assign(block_coords_.size() * block_size, band());
+    block_lower_.setConstant(std::numeric_limits<int>::max());
+    block_upper_.setConstant(std::numeric_limits<int>::min());
+    for (auto& block : block_coords_) {
+      block_lower_ = block_lower_.cwiseMin(block);
+      block_upper_ = block_upper_.cwiseMax(block);
+    }
+    neighbors_.resize(block_coords_.size());
+    tbb::parallel_for(size_t(0), block_coords_.size(), [&](size_t b) {
+      for (int d = 0; d < Dim; d++) {
+        for (int s = 0; s < 2; s++) {
+          TVI nb = block_coords_[b];
+          nb(d) += s ? 1 : -1;
+          auto it = block_index_.find(block_key(nb));
+          neighbors_[b][2 * d + s] = it == block_index_.end() ? -1 : it->second;
+        }
+      }
+    });
+  }
+
+  static TVI key_block(uint64_t key) {
+    TVI block;
+    for (int d = Dim - 1; d >= 0; d--) {
+      block(d) = int(key & ((uint64_t(1) << key_bits) - 1)) - key_offset;
+      key >>= key_bits;
+    }
+    return block;
+  }
+
+  /*
+   * (block key, item) pairs of the blocks meeting box(item) = (lower, upper) of n items,
+   * counted and filled in parallel, sorted by block
+   */
+  template<typename Box>
+  std::vector<std::pair<uint64_t, int>> block_pairs(size_t n, Box box) const {
+    auto block_range = [&](size_t i, TVI& lo, TVI& hi) {
+      auto [lower, upper] = box(i);
+      for (int d = 0; d < Dim; d++) {
+        lo(d) = floor_div(int(std::floor(lower(d) * inv_dx_)), block_width);
+        hi(d) = floor_div(int(std::ceil(upper(d) * inv_dx_)), block_width);
+      }
+    };
+    std::vector<size_t> offsets(n + 1, 0);
+    tbb::parallel_for(size_t(0), n, [&](size_t i) {
+      TVI lo, hi;
+      block_range(i, lo, hi);
+      offsets[i + 1] = size_t((hi - lo + TVI::Ones()).cwiseMax(0).prod());
+    });
+    for (size_t i = 0; i < n; i++) offsets[i + 1] += offsets[i];
+    std::vector<std::pair<uint64_t, int>> pairs(offsets[n]);
+    tbb::parallel_for(size_t(0), n, [&](size_t i) {
+      TVI lo, hi;
+      block_range(i, lo, hi);
+      auto k = offsets[i];
+      for_each_in_box(lo, hi, [&](const TVI& block) { pairs[k++] = {block_key(block), int(i)}; });
+    });
+    tbb::parallel_sort(pairs.begin(), pairs.end());
+    return pairs;
+  }
+
+  template<typename Pairs>
+  static std::vector<size_t> group_ranges(const Pairs& pairs) {
+    std::vector<size_t> ranges;
+    for (size_t k = 0; k < pairs.size(); k++) {
+      if (k == 0 || pairs[k].first != pairs[k - 1].first) ranges.push_back(k);
+    }
+    ranges.push_back(pairs.size());
+    return ranges;
+  }
+
+  // activate the block of every group in key order, returns the block of each group
+  std::vector<int> activate_groups(const std::vector<std::pair<uint64_t, int>>& pairs,
+                                   const std::vector<size_t>& ranges) {
+    std::vector<int> blocks(ranges.size() - 1);
+    for (size_t g = 0; g < blocks.size(); g++) {
+      blocks[g] = activate(key_block(pairs[ranges[g]].first));
+    }
+    finish_activation();
+    return blocks;
+  }
+
+  // value of the axis neighbor (d, s) of node l in block b, false if it lies outside the band
+  bool neighbor_value(const std::vector<T>& values, size_t b, const TVI& local, int d, int s,
+                      T& value) const {
+    TVI nl = local;
+    nl(d) += s ? 1 : -1;
+    size_t nb = b;
+    if (nl(d) < 0 || nl(d) >= block_width) {
+      int index = neighbors_[b][2 * d + s];
+      if (index < 0) return false;
+      nb = index;
+      nl(d) = (nl(d) + block_width) % block_width;
+    }
+    value = values[nb * block_size + local_index(nl)];
+    return true;
+  }
+
+  bool is_interface(size_t b, int l) const {
+    T phi = phi_[b * block_size + l];
+    TVI local = local_coord(l);
+    for (int d = 0; d < Dim; d++) {
+      for (int s = 0; s < 2; s++) {
+        T other;
+        if (neighbor_value(phi_, b, local, d, s, other) && (other < 0) != (phi < 0)) return true;
+      }
+    }
+    return false;
+  }
+
+  // Gauss-Seidel sweeps inside block b, neighbors in other blocks read from previous
+  T sweep_block(size_t b, const std::vector<char>& frozen, const std::vector<T>& previous) {
+    T max_change = 0;
+    for (int ordering = 0; ordering < (1 << Dim); ordering++) {
+      for (int k = 0; k < block_size; k++) {
+        // flip the traversal direction of each axis according to ordering
+        TVI local = local_coord(k);
+        for (int d = 0; d < Dim; d++) {
+          if ((ordering >> d) & 1) local(d) = block_width - 1 - local(d);
+        }
+        auto i = b * block_size + local_index(local);
+        if (frozen[i]) continue;
+
+        std::array<T, Dim> a;
+        for (int d = 0; d < Dim; d++) {
+          a[d] = band();
+          for (int s = 0; s < 2; s++) {
+            T value;
+            TVI nl = local;
+            nl(d) += s ? 1 : -1;
+            bool inside = nl(d) >= 0 && nl(d) < block_width;
+            if (neighbor_value(inside ? phi_ : previous, b, local, d, s, value)) {
+              a[d] = std::min(a[d], std::abs(value));
+            }
+          }
+        }
+        T updated = std::min(solve_eikonal(a), band());
+        T old = std::abs(phi_[i]);
+        if (updated < old) {
+          max_change = std::max(max_change, old - updated);
+          phi_[i] = phi_[i] < 0 ? -updated : updated;
+        }
+      }
+    }
+    return max_change;
+  }
+
+  // upwind solution of |grad phi| = 1 from the smallest neighbor per axis
+  T solve_eikonal(std::array<T, Dim> a) const {
+    std::sort(a.begin(), a.end());
+    T u = a[0] + dx_;
+    if (u <= a[1]) return u;
+    T sum = a[0] + a[1], diff = a[0] - a[1];
+    u = T(0.5) * (sum + std::sqrt(2 * dx_ * dx_ - diff * diff));
+    if constexpr (Dim == 3) {
+      if (u > a[2]) {
+        T s = a[0] + a[1] + a[2];
+        T s2 = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+        T disc = s * s - 3 * (s2 - dx_ * dx_);
+        u = (s + std::sqrt(std::max(disc, T(0)))) / 3;
+      }
+    }
+    return u;
+  }
+
+  // copy signs from known nodes into their unknown axis neighbors until all are reached
+  void propagate_sign(std::vector<char>& known) {
+    bool changed = true;
+    while (changed) {
+      std::vector<char> next = known;
+      changed = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_blocks()),
+        false,
+        [&](const tbb::blocked_range<size_t>& r, bool any) {
+          for (auto b = r.begin(); b != r.end(); b++) {
+            for (int l = 0; l < block_size; l++) {
+              auto i = b * block_size + l;
+              if (known[i]) continue;
+              TVI local = local_coord(l);
+              for (int d = 0; d < Dim && !next[i]; d++) {
+                for (int s = 0; s < 2 && !next[i]; s++) {
+                  TVI nl = local;
+                  nl(d) += s ? 1 : -1;
+                  size_t nb = b;
+                  if (nl(d) < 0 || nl(d) >= block_width) {
+                    int index = neighbors_[b][2 * d + s];
+                    if (index < 0) continue;
+                    nb = index;
+                    nl(d) = (nl(d) + block_width) % block_width;
+                  }
+                  auto j = nb * block_size + local_index(nl);
+                  if (known[j]) {
+                    phi_[i] = phi_[j] < 0 ? -band() : band();
+                    next[i] = 1;
+                    any = true;
+                  }
+                }
+              }
+            }
+          }
+          return any;
+        },
+        [](bool a, bool b) { return a || b; });
+      known = std::move(next);
+    }
+  }
+
+  // drop blocks that hold no value inside the band
+  void prune() {
+    std::vector<TVI> coords;
+    std::vector<T> phi;
+    for (size_t b = 0; b < block_coords_.size(); b++) {
+      const T* values = block_phi(b);
+      bool keep = std::any_of(values, values + block_size, [&](T v) { return std::abs(v) < band(); });
+      if (keep) {
+        coords.push_back(block_coords_[b]);
+        phi.insert(phi.end(), values, values + block_size);
+      }
+    }
+    block_index_.clear();
+    block_coords_ = std::move(coords);
+    for (size_t b = 0; b < block_coords_.size(); b++) block_index_[block_key(block_coords_[b])] = b;
+    std::vector<T> kept = std::move(phi);
+    finish_activation();
+    phi_ = std::move(kept);
+  }
+
+  // sign of a node outside the band: the closest band node along -x decides
+  T far_sign(TVI block, const TVI& local) const {
+    for (int d = 0; d < Dim; d++) {
+      if (block(d) < block_lower_(d) || block(d) > block_upper_(d)) return T(1);
+    }
+    TVI row = local;
+    row(0) = block_width - 1;
+    while (--block(0) >= block_lower_(0)) {
+      auto it = block_index_.find(block_key(block));
+      if (it != block_index_.end()) {
+        return phi_[it->second * block_size + local_index(row)] < 0 ? T(-1) : T(1);
+      }
+    }
+    return T(1);
+  }
+
+  T dx_, inv_dx_;
+  int band_width_;
+
+  std::unordered_map<uint64_t, int> block_index_;
+  std::vector<TVI> block_coords_;
+  TVI block_lower_, block_upper_;
+  std::vector<std::array<int, 2 * Dim>> neighbors_;
+  std::vector<T> phi_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_LEVELSET_HPP
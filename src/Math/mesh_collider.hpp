@@ -0,0 +1,145 @@
+#ifndef METASIM_MESH_COLLIDER_HPP
+#define METASIM_MESH_COLLIDER_HPP
+
+#include "Math/bvh.hpp"
+#include "Math/triangle_mesh.hpp"
+#include "Utils/logger.hpp"
+#include "meta.hpp"
+#include <Eigen/Geometry>
+#include <limits>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace MS {
+
+/*
+ * collision geometry from a closed triangle mesh
+ *
+ * The mesh lives in its own frame and moves rigidly with (rotation, translation) and
+ * (linear_velocity, angular_velocity), so rigid motion never touches the BVH. Deforming
+ * meshes pass new vertex positions to update_vertices(), which refits the tree.
+ */
+template<typename T>
+class MeshCollider {
+public:
+  using TV = Vec<3, T>;
+  using TM = Mat<3, 3, T>;
+
+  struct Contact {
+    // signed distance, negative inside the mesh
+    T phi;
+    // outward surface normal at the closest point, world frame
+    TV normal;
+    TV closest;
+    // collider velocity at the query point
+    TV velocity;
+    int face;
+  };
+
+  TM rotation{TM::Identity()};
+  TV translation{TV::Zero()};
+  TV linear_velocity{TV::Zero()};
+  TV angular_velocity{TV::Zero()};
+
+  explicit MeshCollider(TriangleMesh<T> mesh) : mesh_(std::move(mesh)) { rebuild(); }
+
+  const TriangleMesh<T>& mesh() const { return mesh_; }
+  const BVH<T, 3>& bvh() const { return bvh_; }
+
+  void rebuild() {
+    mesh_.compute_normals();
+    update_face_boxes();
+    bvh_.build(face_boxes_);
+  }
+
+  // vertices in the collider frame, the face list stays the same
+  void update_vertices(const std::vector<TV>& vertices) {
+    META_ASSERT(vertices.size() == mesh_.vertices.size(), "vertex count changed, rebuild instead");
+    mesh_.vertices = vertices;
+    mesh_.compute_normals();
+    update_face_boxes();
+    bvh_.refit(face_boxes_);
+  }
+
+  // integrate the rigid pose by dt
+  void advance(T dt) {
+    translation += linear_velocity * dt;
+    T angle = angular_velocity.norm() * dt;
+    if (angle > 0) {
+      rotation = Eigen::AngleAxis<T>(angle, angular_velocity.normalized()).toRotationMatrix() *
+                 rotation;
+    }
+  }
+
+  /*
+   * closest surface point and signed distance of x
+   * points farther than max_distance get phi = max_distance, face = -1 and an unknown sign
+   */
+  Contact query(const TV& x, T max_distance = std::numeric_limits<T>::max()) const {
+    Contact contact;
+    contact.velocity = linear_velocity + angular_velocity.cross(x - translation);
+    TV local = rotation.transpose() * (x - translation);
+
+    T max2 = max_distance < std::sqrt(std::numeric_limits<T>::max())
+               ? max_distance * max_distance
+               : std::numeric_limits<T>::max();
+    int face = bvh_.nearest(
+      local,
+      [&](int f, T) {
+        int feature;
+        const auto& tri = mesh_.faces[f];
+        return (local - closest_point_on_triangle(local,
+                                                  mesh_.vertices[tri(0)],
+                                                  mesh_.vertices[tri(1)],
+                                                  mesh_.vertices[tri(2)],
+                                                  feature))
+          .squaredNorm();
+      },
+      max2);
+
+    contact.face = face;
+    if (face < 0) {
+      contact.phi = max_distance;
+      contact.normal = TV::Zero();
+      contact.closest = x;
+      return contact;
+    }
+
+    TV pseudo_normal;
+    TV q = mesh_.closest_point(face, local, pseudo_normal);
+    TV diff = local - q;
+    T dist = diff.norm();
+    bool inside = diff.dot(pseudo_normal) < 0;
+    contact.phi = inside ? -dist : dist;
+    // away from the surface the gradient direction is more accurate than the pseudo normal
+    TV normal = dist > std::numeric_limits<T>::epsilon() * 100 ? TV(diff / contact.phi)
+                                                               : pseudo_normal;
+    contact.normal = rotation * normal;
+    contact.closest = rotation * q + translation;
+    return contact;
+  }
+
+  // batched query of n points in parallel
+  void query(const TV* x, size_t n, Contact* out,
+             T max_distance = std::numeric_limits<T>::max()) const {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, n, 256), [&](const tbb::blocked_range<size_t>& r) {
+      for (size_t i = r.begin(); i != r.end(); i++) out[i] = query(x[i], max_distance);
+    });
+  }
+
+private:
+  void update_face_boxes() {
+    face_boxes_.resize(mesh_.faces.size());
+    tbb::parallel_for(size_t(0), mesh_.faces.size(), [&](size_t f) {
+      face_boxes_[f] = mesh_.face_bounds(f);
+    });
+  }
+
+  TriangleMesh<T> mesh_;
+  BVH<T, 3> bvh_;
+  std::vector<std::pair<TV, TV>> face_boxes_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_MESH_COLLIDER_HPP
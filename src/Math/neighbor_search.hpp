@@ -0,0 +1,343 @@
+#ifndef METASIM_NEIGHBOR_SEARCH_HPP
+#define METASIM_NEIGHBOR_SEARCH_HPP
+
+#include "meta.hpp"
+#include "Core/data_array.hpp"
+#include "Utils/logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_scan.h>
+#include <tbb/tick_count.h>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Fixed radius neighbor search over a cell list (SPH density, DEM contacts, sampling checks)
+ *
+ * Cells of size radius cover the box [lower, upper], indexed like Grid nodes (last
+ * dimension fastest); positions outside are clamped into the border cells. build() is a
+ * parallel counting sort: particles take a slot in their cell with an atomic counter,
+ * cell_start() is the exclusive scan of the counts and sorted() lists the particles cell
+ * by cell, ascending within a cell, so results do not depend on the number of threads.
+ * Positions are copied in sorted order, queries walk the 3^Dim cells around a particle
+ * over contiguous memory.
+ * update() recomputes the cells only: when at most incremental_fraction of the particles
+ * changed cells, the old order is merged with the moved particles instead of sorting
+ * again.
+ */
+template<int Dim, typename T = real>
+class NeighborSearch {
+public:
+  using TV = Vec<Dim, T>;
+  using TVI = Vec<Dim, int>;
+
+  struct Neighbor {
+    int index;
+    T distance2;
+  };
+
+  // largest share of particles changing cells that update() handles without a full build
+  double incremental_fraction{0.05};
+  bool write_log{false};
+
+  NeighborSearch(T radius, const TV& lower, const TV& upper)
+    : radius_(radius)
+    , lower_(lower) {
+    size_t cells = 1;
+    for (int d = 0; d < Dim; d++) {
+      cell_shape_(d) = std::max(1, int(std::ceil((upper(d) - lower(d)) / radius)));
+      cells *= cell_shape_(d);
+    }
+    META_ASSERT(
+      cells < size_t(INT_MAX), "neighbor search: {} cells of {} are too many", cells, radius);
+    cells_total_ = int(cells);
+    count_ = std::make_unique<std::atomic<int>[]>(cells_total_);
+    cell_start_.assign(cells_total_ + 1, 0);
+    for_each_in_box(TVI::Constant(-1), TVI::Constant(1), [&](const TVI& offset) {
+      neighbor_offsets_.push_back(offset);
+    });
+  }
+
+  // sort count positions x into cells from scratch
+  void build(const TV* x, size_t count) {
+    auto timer = tbb::tick_count::now();
+    int n = int(count);
+    cell_.resize(n);
+    rank_.resize(n);
+    tbb::parallel_for(
+      0, cells_total_, [&](int c) { count_[c].store(0, std::memory_order_relaxed); });
+    tbb::parallel_for(tbb::blocked_range<int>(0, n), [&](const auto& range) {
+      for (int i = range.begin(); i < range.end(); i++) {
+        cell_[i] = cell_index(cell_coord(x[i]));
+        rank_[i] = count_[cell_[i]].fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+    scan_counts([&](int c) { return count_[c].load(std::memory_order_relaxed); });
+
+    sorted_.resize(n);
+    tbb::parallel_for(tbb::blocked_range<int>(0, n), [&](const auto& range) {
+      for (int i = range.begin(); i < range.end(); i++) {
+        sorted_[cell_start_[cell_[i]] + rank_[i]] = i;
+      }
+    });
+    // slots were taken in thread order
+    tbb::parallel_for(tbb::blocked_range<int>(0, cells_total_), [&](const auto& range) {
+      for (int c = range.begin(); c < range.end(); c++) {
+        if (cell_start_[c + 1] - cell_start_[c] > 1) {
+          std::sort(sorted_.begin() + cell_start_[c], sorted_.begin() + cell_start_[c + 1]);
+        }
+      }
+    });
+    gather_positions(x);
+    finish(timer, false, n);
+  }
+
+  // uniform ranges of x are read as stored, the array is left as it is
+  void build(const DataArray<TV>& x) {
+    if (!x.is_uniform()) return build(x.data.data(), x.data.size());
+    auto dense = dense_positions(x);
+    build(dense.data(), dense.size());
+  }
+
+  // particles moved, same count as the last build
+  void update(const TV* x, size_t count) {
+    if (int(count) != int(cell_.size()) || sorted_.empty()) return build(x, count);
+    auto timer = tbb::tick_count::now();
+    int n = int(count);
+
+    // particles whose cell changed
+    tbb::enumerable_thread_specific<std::vector<int>> moved_local;
+    next_cell_.resize(n);
+    tbb::parallel_for(tbb::blocked_range<int>(0, n), [&](const auto& range) {
+      auto& local = moved_local.local();
+      for (int i = range.begin(); i < range.end(); i++) {
+        next_cell_[i] = cell_index(cell_coord(x[i]));
+        if (next_cell_[i] != cell_[i]) local.push_back(i);
+      }
+    });
+    std::vector<int> moved;
+    for (auto& local : moved_local) moved.insert(moved.end(), local.begin(), local.end());
+    if (moved.size() > incremental_fraction * n) return build(x, count);
+
+    // new counts from the old ones, the moved particles sorted by their new cell
+    for (int i : moved) {
+      count_[cell_[i]].fetch_sub(1, std::memory_order_relaxed);
+      count_[next_cell_[i]].fetch_add(1, std::memory_order_relaxed);
+    }
+    std::sort(moved.begin(), moved.end(), [&](int a, int b) {
+      return next_cell_[a] != next_cell_[b] ? next_cell_[a] < next_cell_[b] : a < b;
+    });
+    std::vector<int> old_start;
+    old_start.swap(cell_start_);
+    cell_start_.resize(cells_total_ + 1);
+    scan_counts([&](int c) { return count_[c].load(std::memory_order_relaxed); });
+
+    // per cell: merge the staying particles of the old order with the arriving ones
+    std::vector<int> merged(n);
+    tbb::parallel_for(tbb::blocked_range<int>(0, cells_total_), [&](const auto& range) {
+      auto arriving = std::lower_bound(moved.begin(),
+                                       moved.end(),
+                                       range.begin(),
+                                       [&](int i, int c) { return next_cell_[i] < c; });
+      for (int c = range.begin(); c < range.end(); c++) {
+        int out = cell_start_[c];
+        auto staying = sorted_.begin() + old_start[c];
+        auto staying_end = sorted_.begin() + old_start[c + 1];
+        while (staying != staying_end || (arriving != moved.end() && next_cell_[*arriving] == c)) {
+          bool take_arriving = arriving != moved.end() && next_cell_[*arriving] == c &&
+                               (staying == staying_end || *arriving < *staying);
+          if (take_arriving) {
+            merged[out++] = *arriving++;
+          } else if (next_cell_[*staying] == c) {
+            merged[out++] = *staying++;
+          } else {
+            ++staying;
+          }
+        }
+      }
+    });
+    sorted_.swap(merged);
+    cell_.swap(next_cell_);
+    gather_positions(x);
+    finish(timer, true, int(moved.size()));
+  }
+
+  void update(const DataArray<TV>& x) {
+    if (!x.is_uniform()) return update(x.data.data(), x.data.size());
+    auto dense = dense_positions(x);
+    update(dense.data(), dense.size());
+  }
+
+  /*
+   * op(i, neighbors) for every particle i with its neighbors within radius but itself,
+   * in parallel; neighbors is a per thread buffer valid during the call
+   */
+  template<typename OP>
+  void query_all(OP op) const {
+    tbb::enumerable_thread_specific<std::vector<Neighbor>> buffers;
+    tbb::parallel_for(tbb::blocked_range<int>(0, int(sorted_.size())), [&](const auto& range) {
+      auto& neighbors = buffers.local();
+      // in sorted order, consecutive particles visit the same cells
+      for (int k = range.begin(); k < range.end(); k++) {
+        int i = sorted_[k];
+        neighbors.clear();
+        for_each_in_radius(sorted_x_[k], cell_[i], [&](int j, T distance2) {
+          if (j != i) neighbors.push_back({j, distance2});
+        });
+        op(i, static_cast<const std::vector<Neighbor>&>(neighbors));
+      }
+    });
+  }
+
+  // op(q, neighbors) for query points[q] (e.g. new samples), in parallel
+  template<typename OP>
+  void query(const TV* points, size_t count, OP op) const {
+    tbb::enumerable_thread_specific<std::vector<Neighbor>> buffers;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, count), [&](const auto& range) {
+      auto& neighbors = buffers.local();
+      for (size_t q = range.begin(); q < range.end(); q++) {
+        neighbors.clear();
+        for_each_neighbor(points[q],
+                          [&](int j, T distance2) { neighbors.push_back({j, distance2}); });
+        op(q, static_cast<const std::vector<Neighbor>&>(neighbors));
+      }
+    });
+  }
+
+  // op(j, distance2) for every particle j within radius of x
+  template<typename OP>
+  void for_each_neighbor(const TV& x, OP op) const {
+    for_each_in_radius(x, cell_index(cell_coord(x)), op);
+  }
+
+  T radius() const { return radius_; }
+  size_t size() const { return sorted_.size(); }
+  // particles cell by cell, those of cell c are sorted()[cell_start()[c], cell_start()[c + 1])
+  const std::vector<int>& sorted() const { return sorted_; }
+  const std::vector<int>& cell_start() const { return cell_start_; }
+  int cell_of(int i) const { return cell_[i]; }
+
+  double seconds() const { return seconds_; }
+  bool last_incremental() const { return incremental_; }
+
+private:
+  TVI cell_coord(const TV& x) const {
+    TVI cell;
+    for (int d = 0; d < Dim; d++) {
+      cell(d) = std::clamp(int(std::floor((x(d) - lower_(d)) / radius_)), 0, cell_shape_(d) - 1);
+    }
+    return cell;
+  }
+
+  int cell_index(const TVI& cell) const {
+    int index = 0;
+    for (int d = 0; d < Dim; d++) index = index * cell_shape_(d) + cell(d);
+    return index;
+  }
+
+  TVI cell_coord(int index) const {
+    TVI coord;
+    for (int d = Dim - 1; d >= 0; d--) {
+      coord(d) = index % cell_shape_(d);
+      index /= cell_shape_(d);
+    }
+    return coord;
+  }
+
+  template<typename OP>
+  static void for_each_in_box(const TVI& lo, const TVI& hi, OP op) {
+    TVI coord = lo;
+    while (true) {
+      op(coord);
+      int d = Dim - 1;
+      while (d >= 0 && ++coord(d) > hi(d)) {
+        coord(d) = lo(d);
+        d--;
+      }
+      if (d < 0) break;
+    }
+  }
+
+  template<typename OP>
+  void for_each_in_radius(const TV& x, int center, OP op) const {
+    T r2 = radius_ * radius_;
+    TVI cell = cell_coord(center);
+    for (auto& offset : neighbor_offsets_) {
+      TVI other = cell + offset;
+      if ((other.array() < 0).any() || (other.array() >= cell_shape_.array()).any()) continue;
+      int c = cell_index(other);
+      for (int k = cell_start_[c]; k < cell_start_[c + 1]; k++) {
+        T distance2 = (sorted_x_[k] - x).squaredNorm();
+        if (distance2 <= r2) op(sorted_[k], distance2);
+      }
+    }
+  }
+
+  // cell_start_ = exclusive prefix sum of count(c)
+  template<typename Count>
+  void scan_counts(Count count) {
+    tbb::parallel_scan(
+      tbb::blocked_range<int>(0, cells_total_),
+      0,
+      [&](const auto& range, int sum, bool is_final) {
+        for (int c = range.begin(); c < range.end(); c++) {
+          if (is_final) cell_start_[c] = sum;
+          sum += count(c);
+        }
+        if (is_final && range.end() == cells_total_) cell_start_[cells_total_] = sum;
+        return sum;
+      },
+      [](int a, int b) { return a + b; });
+  }
+
+  static std::vector<TV> dense_positions(const DataArray<TV>& x) {
+    std::vector<TV> dense;
+    dense.reserve(x.element_count());
+    for (auto& xi : x) dense.push_back(xi);
+    return dense;
+  }
+
+  void gather_positions(const TV* x) {
+    sorted_x_.resize(sorted_.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, sorted_.size()), [&](const auto& range) {
+      for (size_t k = range.begin(); k < range.end(); k++) sorted_x_[k] = x[sorted_[k]];
+    });
+  }
+
+  void finish(tbb::tick_count timer, bool incremental, int sorted) {
+    seconds_ = (tbb::tick_count::now() - timer).seconds();
+    incremental_ = incremental;
+    if (write_log) {
+      META_INFO("neighbor search: {} {} of {} particles into {} cells in {:.3f}s",
+                incremental ? "moved" : "sorted",
+                sorted,
+                sorted_.size(),
+                cells_total_,
+                seconds_);
+    }
+  }
+
+  T radius_;
+  TV lower_;
+  TVI cell_shape_;
+  int cells_total_;
+  std::vector<TVI> neighbor_offsets_;
+
+  std::unique_ptr<std::atomic<int>[]> count_;
+  std::vector<int> cell_start_;
+  std::vector<int> cell_, next_cell_, rank_;
+  std::vector<int> sorted_;
+  std::vector<TV> sorted_x_;
+  double seconds_{0};
+  bool incremental_{false};
+};
+
+}   // namespace MS
+
+#endif   // METASIM_NEIGHBOR_SEARCH_HPP
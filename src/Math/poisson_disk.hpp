@@ -1,8 +1,276 @@
-#pragma once
+#ifndef METASIM_POISSON_DISK_HPP
+#define METASIM_POISSON_DISK_HPP
 
-#include "../meta.hpp"
+#include "meta.hpp"
+#include "Core/data_container.hpp"
+#include "Utils/logger.hpp"
+#include <algorithm>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/tick_count.h>
 
-template<int Dim>
+namespace MS {
+
+/*
+ * Parallel Poisson disk sampling by phase-group dart throwing (Wei 2008)
+ *
+ * A background grid with cell size r / sqrt(Dim) holds at most one sample per cell,
+ * cells swallowed by the disk of an accepted sample are flagged and never retried.
+ * Cells are grouped in tiles of tile_width^Dim, and tiles are split into 2^Dim phases
+ * by the parity of their coordinates. Tiles of one phase are at least one tile
+ * (>= r) apart, so all of them throw darts concurrently without conflicts; each
+ * dart only reads neighbor tiles that belong to other phases.
+ * Tiles draw from their own seeded generator, the result does not depend on the
+ * number of threads.
+ */
+template<int Dim, typename T = real>
 class PoissonDiskSampler {
-  
-};
\ No newline at end of file
+public:
+  using TV = Vec<Dim, T>;
+  using TVI = Vec<Dim, int>;
+
+  constexpr static int tile_width = 4;
+
+  // darts thrown per empty cell in every round, and number of rounds over all phases
+  int attempts_per_cell{4};
+  int rounds{4};
+  bool write_log{true};
+
+  PoissonDiskSampler(T radius, const TV& lower, const TV& upper, uint64_t seed = 0)
+    : radius_(radius)
+    , cell_size_(radius / std::sqrt(T(Dim)))
+    , lower_(lower)
+    , seed_(seed) {
+    reach_ = int(std::ceil(radius_ / cell_size_));
+    cells_total_ = 1;
+    tiles_total_ = 1;
+    for (int d = 0; d < Dim; d++) {
+      cell_shape_(d) = std::max(1, int(std::ceil((upper(d) - lower(d)) / cell_size_)));
+      tile_shape_(d) = (cell_shape_(d) + tile_width - 1) / tile_width;
+      cells_total_ *= cell_shape_(d);
+      tiles_total_ *= tile_shape_(d);
+    }
+  }
+
+  static auto inside_box(const TV& lower, const TV& upper) {
+    return [=](const TV& x) {
+      return (x.array() >= lower.array()).all() && (x.array() <= upper.array()).all();
+    };
+  }
+
+  /*
+   * fill the region {x | inside(x)} of the domain box, e.g. a level set with
+   * [&](const TV& x) { return levelset.value(x) < 0; }
+   * returns number of samples
+   */
+  template<typename Inside>
+  size_t sample(Inside inside) {
+    auto timer = tbb::tick_count::now();
+    state_.assign(cells_total_, empty);
+    points_.resize(cells_total_);
+    build_neighbor_offsets();
+
+    for (int round = 0; round < rounds; round++) {
+      for (int phase = 0; phase < (1 << Dim); phase++) {
+        std::vector<int> tiles;
+        for (int t = 0; t < tiles_total_; t++) {
+          if (tile_phase(tile_coord(t)) == phase) tiles.push_back(t);
+        }
+        tbb::parallel_for(size_t(0), tiles.size(), [&](size_t i) {
+          throw_darts(tiles[i], round, inside);
+        });
+      }
+    }
+
+    // samples per tile, prefix summed for the output order
+    tile_offset_.assign(tiles_total_ + 1, 0);
+    tbb::parallel_for(0, tiles_total_, [&](int t) {
+      size_t count = 0;
+      for_each_cell_in_tile(t, [&](const TVI&, size_t cell) { count += state_[cell] == occupied; });
+      tile_offset_[t + 1] = count;
+    });
+    for (int t = 0; t < tiles_total_; t++) tile_offset_[t + 1] += tile_offset_[t];
+
+    seconds_ = (tbb::tick_count::now() - timer).seconds();
+    if (write_log) {
+      META_INFO("poisson disk: {} samples in {:.3f}s ({:.3e} samples/sec)",
+                count(),
+                seconds_,
+                count() / std::max(seconds_, 1e-9));
+    }
+    return count();
+  }
+
+  size_t count() const { return tile_offset_.empty() ? 0 : tile_offset_.back(); }
+  double seconds() const { return seconds_; }
+  double samples_per_second() const { return count() / std::max(seconds_, 1e-9); }
+
+  // copy the samples of the last sample() into out[0, count()), in parallel over tiles
+  void write(TV* out) const {
+    tbb::parallel_for(0, tiles_total_, [&](int t) {
+      auto p = out + tile_offset_[t];
+      for_each_cell_in_tile(t, [&](const TVI&, size_t cell) {
+        if (state_[cell] == occupied) *p++ = points_[cell];
+      });
+    });
+  }
+
+  // sample and append the points as range [first, first + count) of attr_tag
+  template<typename Inside>
+  Range sample_into(DataContainer& container, const TypeTag<TV>& attr_tag, int first,
+                    Inside inside) {
+    sample(inside);
+    Range range{first, first + int(count())};
+    write(container.allocate(attr_tag, range));
+    return range;
+  }
+
+private:
+  TVI tile_coord(int t) const {
+    TVI coord;
+    for (int d = Dim - 1; d >= 0; d--) {
+      coord(d) = t % tile_shape_(d);
+      t /= tile_shape_(d);
+    }
+    return coord;
+  }
+
+  static int tile_phase(const TVI& coord) {
+    int phase = 0;
+    for (int d = 0; d < Dim; d++) phase |= (coord(d) & 1) << d;
+    return phase;
+  }
+
+  size_t cell_index(const TVI& cell) const {
+    size_t index = 0;
+    for (int d = 0; d < Dim; d++) index = index * cell_shape_(d) + cell(d);
+    return index;
+  }
+
+  template<typename OP>
+  void for_each_cell_in_tile(int t, OP op) const {
+    TVI lo = tile_coord(t) * tile_width, hi;
+    for (int d = 0; d < Dim; d++) hi(d) = std::min(lo(d) + tile_width, cell_shape_(d)) - 1;
+    for_each_in_box(lo, hi, [&](const TVI& cell) { op(cell, cell_index(cell)); });
+  }
+
+  template<typename OP>
+  static void for_each_in_box(const TVI& lo, const TVI& hi, OP op) {
+    for (int d = 0; d < Dim; d++) {
+      if (lo(d) > hi(d)) return;
+    }
+    TVI coord = lo;
+    while (true) {
+      op(coord);
+      int d = Dim - 1;
+      while (d >= 0 && ++coord(d) > hi(d)) {
+        coord(d) = lo(d);
+        d--;
+      }
+      if (d < 0) break;
+    }
+  }
+
+  // small and cheap to seed per tile, unlike std::mt19937
+  struct SplitMix {
+    uint64_t state;
+    uint64_t next() {
+      uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      return z ^ (z >> 31);
+    }
+    // uniform in [0, 1)
+    T unit() { return T(next() >> 11) * T(1.0 / 9007199254740992.0); }
+  };
+
+  // a few darts into every cell of tile t that is neither occupied nor covered
+  template<typename Inside>
+  void throw_darts(int t, int round, Inside& inside) {
+    SplitMix rng{seed_ ^ (uint64_t(t) * 0x9E3779B97F4A7C15ull + uint64_t(round))};
+
+    for_each_cell_in_tile(t, [&](const TVI& cell, size_t index) {
+      for (int attempt = 0; attempt < attempts_per_cell && state_[index] == empty; attempt++) {
+        TV x;
+        for (int d = 0; d < Dim; d++) x(d) = lower_(d) + (cell(d) + rng.unit()) * cell_size_;
+        if (!inside(x) || has_conflict(cell, x)) continue;
+        state_[index] = occupied;
+        points_[index] = x;
+        cover_neighbors(cell, x);
+      }
+    });
+  }
+
+  // cells whose points may lie closer than r to a point of the center cell, nearest first
+  void build_neighbor_offsets() {
+    neighbor_offsets_.clear();
+    TVI lo = TVI::Constant(-reach_), hi = TVI::Constant(reach_);
+    for_each_in_box(lo, hi, [&](const TVI& offset) {
+      T gap2 = 0;
+      for (int d = 0; d < Dim; d++) {
+        T gap = std::max(std::abs(offset(d)) - 1, 0) * cell_size_;
+        gap2 += gap * gap;
+      }
+      if (gap2 < radius_ * radius_ && offset != TVI::Zero()) neighbor_offsets_.push_back(offset);
+    });
+    std::sort(neighbor_offsets_.begin(), neighbor_offsets_.end(), [](const TVI& a, const TVI& b) {
+      return a.squaredNorm() < b.squaredNorm();
+    });
+  }
+
+  template<typename OP>
+  void for_each_neighbor(const TVI& cell, OP op) const {
+    for (auto& offset : neighbor_offsets_) {
+      TVI other = cell + offset;
+      if ((other.array() < 0).any() || (other.array() >= cell_shape_.array()).any()) continue;
+      if (op(other, cell_index(other))) return;
+    }
+  }
+
+  bool has_conflict(const TVI& cell, const TV& x) const {
+    bool conflict = false;
+    T r2 = radius_ * radius_;
+    for_each_neighbor(cell, [&](const TVI&, size_t index) {
+      conflict = state_[index] == occupied && (points_[index] - x).squaredNorm() < r2;
+      return conflict;
+    });
+    return conflict;
+  }
+
+  // flag empty cells lying entirely inside the disk of x, they will never take a sample
+  void cover_neighbors(const TVI& cell, const TV& x) {
+    T r2 = radius_ * radius_;
+    for_each_neighbor(cell, [&](const TVI& other, size_t index) {
+      if (state_[index] != empty) return false;
+      T far2 = 0;
+      for (int d = 0; d < Dim; d++) {
+        T lo = lower_(d) + other(d) * cell_size_;
+        T far = std::max(std::abs(x(d) - lo), std::abs(x(d) - lo - cell_size_));
+        far2 += far * far;
+      }
+      if (far2 < r2) state_[index] = covered;
+      return false;
+    });
+  }
+
+  enum : char { empty = 0, occupied = 1, covered = 2 };
+
+  T radius_, cell_size_;
+  TV lower_;
+  uint64_t seed_;
+  int reach_;
+
+  TVI cell_shape_, tile_shape_;
+  size_t cells_total_;
+  int tiles_total_;
+
+  std::vector<TVI> neighbor_offsets_;
+  std::vector<char> state_;
+  std::vector<TV> points_;
+  std::vector<size_t> tile_offset_;
+  double seconds_{0};
+};
+
+}   // namespace MS
+
+#endif   // METASIM_POISSON_DISK_HPP
@@ -0,0 +1,446 @@
+#ifndef METASIM_SURFACE_RECONSTRUCTION_HPP
+#define METASIM_SURFACE_RECONSTRUCTION_HPP
+
+#include "meta.hpp"
+#include "Core/data_array.hpp"
+#include "Utils/logger.hpp"
+#include "Utils/mesh_file.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/tick_count.h>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Triangle mesh of the surface of a particle set (rendering output per frame)
+ *
+ * Particles are splatted to a scalar field on the nodes integer coords * dx, stored in
+ * blocks of block_width^3 cells that exist only where particles reach, and marching
+ * cubes runs over the cells of those blocks in parallel. Fields, negative inside:
+ *   density:   iso - sum of particle_volume * W(|x - x_p|), the surface is where the
+ *              density falls to iso times the rest density
+ *   level_set: |x - x_avg| - particle_radius, x_avg the W weighted mean of the particles
+ *              (Zhu & Bridson, "Animating sand as a fluid")
+ * with W the cubic spline or poly6 kernel of support smoothing_radius.
+ * A block keeps its own copy of the nodes on its upper faces. Those get the same
+ * contributions in the same order in every block holding them, so neighboring blocks
+ * agree on shared nodes without exchanging anything. A block owns the edges starting at
+ * its nodes and numbers their vertices; an exclusive scan over the blocks turns these
+ * into mesh indices and cells look the edges of upper neighbors up in their tables, so
+ * every vertex exists once and no lock is taken. The cube cases are derived from the face
+ * contours, ambiguous faces separate the inside corners, which keeps the mesh closed.
+ */
+template<typename T = real>
+class SurfaceReconstruction {
+public:
+  using TV = Vec<3, T>;
+  using TVI = Vec<3, int>;
+
+  enum class Kernel { cubic_spline, poly6 };
+  enum class Field { density, level_set };
+
+  constexpr static int block_width = 8;
+  constexpr static int block_cells = block_width * block_width * block_width;
+  constexpr static int padded_width = block_width + 1;
+  constexpr static int padded_nodes = padded_width * padded_width * padded_width;
+
+  // node spacing of the field
+  T dx;
+  T smoothing_radius;
+  Kernel kernel{Kernel::cubic_spline};
+  Field field{Field::density};
+  // density: volume of one particle, surface density relative to the rest density
+  T particle_volume;
+  T iso{T(0.5)};
+  // level set: distance of the surface from the weighted mean of the particles
+  T particle_radius;
+  bool write_log{false};
+
+  // defaults for particles spaced by spacing
+  SurfaceReconstruction(T dx, T spacing)
+    : dx(dx)
+    , smoothing_radius(2 * spacing)
+    , particle_volume(spacing * spacing * spacing)
+    , particle_radius(spacing / 2) {}
+
+  // mesh of count positions x, replaces the vertices and triangles of mesh
+  void reconstruct(const TV* x, size_t count, SurfaceMesh& mesh) {
+    auto timer = tbb::tick_count::now();
+    sigma_ = kernel_sigma();
+    activate(x, count);
+    size_t n_blocks = block_keys_.size();
+    values_.resize(n_blocks * padded_nodes);
+    edge_vertex_.resize(n_blocks * 3 * block_cells);
+    vertex_offset_.resize(n_blocks + 1);
+    triangle_offset_.resize(n_blocks + 1);
+
+    tbb::enumerable_thread_specific<Scratch> scratch;
+    tbb::parallel_for(size_t(0), n_blocks, [&](size_t b) {
+      splat(b, x, scratch.local());
+      number_vertices(b);
+    });
+    vertex_offset_[0] = triangle_offset_[0] = 0;
+    for (size_t b = 0; b < n_blocks; b++) {
+      vertex_offset_[b + 1] += vertex_offset_[b];
+      triangle_offset_[b + 1] += triangle_offset_[b];
+    }
+
+    mesh.vertices.resize(vertex_offset_[n_blocks]);
+    mesh.triangles.resize(triangle_offset_[n_blocks]);
+    tbb::parallel_for(size_t(0), n_blocks, [&](size_t b) {
+      place_vertices(b, mesh);
+      connect(b, mesh);
+    });
+
+    seconds_ = (tbb::tick_count::now() - timer).seconds();
+    if (write_log) {
+      META_INFO("surface: {} particles, {} blocks, {} vertices, {} triangles in {:.3f}s",
+                count,
+                n_blocks,
+                mesh.vertices.size(),
+                mesh.triangles.size(),
+                seconds_);
+    }
+  }
+
+  // uniform ranges of x are read as stored, the array is left as it is
+  void reconstruct(const DataArray<TV>& x, SurfaceMesh& mesh) {
+    if (!x.is_uniform()) return reconstruct(x.data.data(), x.data.size(), mesh);
+    std::vector<TV> dense;
+    dense.reserve(x.element_count());
+    for (auto& xi : x) dense.push_back(xi);
+    reconstruct(dense.data(), dense.size(), mesh);
+  }
+
+  size_t num_blocks() const { return block_keys_.size(); }
+  size_t memory_bytes() const {
+    return values_.capacity() * sizeof(T) + edge_vertex_.capacity() * sizeof(int) +
+           pairs_.capacity() * sizeof(pairs_[0]) +
+           block_keys_.capacity() * (sizeof(uint64_t) + sizeof(Block));
+  }
+  double seconds() const { return seconds_; }
+
+private:
+  constexpr static uint64_t key_bits = 21;
+  constexpr static int key_offset = 1 << (key_bits - 1);
+
+  // triangles of a cube case as edges corner * 3 + axis, corner bit d is the offset along d
+  using Triangle = std::array<uint8_t, 3>;
+
+  struct Block {
+    TVI coord;
+    // particle pairs of this block, [begin, end) of pairs_
+    size_t begin, end;
+    // blocks at offset (s & 1, s >> 1 & 1, s >> 2 & 1) for s = 1..7, -1 if not occupied
+    std::array<int, 7> upper;
+  };
+
+  struct Scratch {
+    std::vector<T> weight = std::vector<T>(padded_nodes);
+    std::vector<TV> center = std::vector<TV>(padded_nodes);
+  };
+
+  static int floor_div(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+  static uint64_t block_key(const TVI& block) {
+    uint64_t key = 0;
+    for (int d = 0; d < 3; d++) key = (key << key_bits) | uint64_t(block(d) + key_offset);
+    return key;
+  }
+
+  static TVI block_coord(uint64_t key) {
+    TVI block;
+    for (int d = 2; d >= 0; d--, key >>= key_bits) {
+      block(d) = int(key & ((uint64_t(1) << key_bits) - 1)) - key_offset;
+    }
+    return block;
+  }
+
+  static int node_index(int i, int j, int k) { return (i * padded_width + j) * padded_width + k; }
+  static int cell_index(int i, int j, int k) { return (i * block_width + j) * block_width + k; }
+
+  static const std::array<std::vector<Triangle>, 256>& cube_cases() {
+    static const auto cases = [] {
+      std::array<std::vector<Triangle>, 256> cases;
+      for (int config = 0; config < 256; config++) {
+        auto inside = [&](int corner) { return (config >> corner) & 1; };
+        // the contour leaves the face of edge e through the edge next[e]
+        std::array<int, 24> next;
+        next.fill(-1);
+        for (int d = 0; d < 3; d++) {
+          int u = (d + 1) % 3, v = (d + 2) % 3;
+          for (int s = 0; s < 2; s++) {
+            // face corners counterclockwise seen from outside
+            int base = s << d;
+            std::array<int, 4> ring = {base, base | 1 << u, base | 1 << u | 1 << v, base | 1 << v};
+            if (!s) std::swap(ring[1], ring[3]);
+            auto edge = [&](int i) {
+              int a = ring[i & 3], b = ring[(i + 1) & 3];
+              int axis = (a ^ b) == 1 ? 0 : (a ^ b) == 2 ? 1 : 2;
+              return std::min(a, b) * 3 + axis;
+            };
+            // every run of inside corners is entered through the edge before it
+            for (int i = 0; i < 4; i++) {
+              if (!inside(ring[i]) || inside(ring[(i + 3) & 3])) continue;
+              int j = i;
+              while (inside(ring[(j + 1) & 3])) j++;
+              next[edge(i + 3)] = edge(j);
+            }
+          }
+        }
+        std::array<bool, 24> used{};
+        for (int e = 0; e < 24; e++) {
+          if (next[e] < 0 || used[e]) continue;
+          std::vector<int> loop;
+          for (int f = e; !used[f]; f = next[f]) {
+            used[f] = true;
+            loop.push_back(f);
+          }
+          // fan from an edge sharing no face with the edges it connects to: the cube on the
+          // other side of an ambiguous face may have the same diagonal across that face
+          int n = int(loop.size());
+          auto share_face = [&](int a, int b) {
+            for (int d = 0; d < 3; d++) {
+              if (d != a % 3 && d != b % 3 && ((a / 3 >> d) & 1) == ((b / 3 >> d) & 1)) {
+                return true;
+              }
+            }
+            return false;
+          };
+          auto valid_root = [&](int root) {
+            for (int k = 2; k + 1 < n; k++) {
+              if (share_face(loop[root], loop[(root + k) % n])) return false;
+            }
+            return true;
+          };
+          int root = 0;
+          while (root + 1 < n && !valid_root(root)) root++;
+          for (int k = 1; k + 1 < n; k++) {
+            cases[config].push_back({uint8_t(loop[root]),
+                                      uint8_t(loop[(root + k) % n]),
+                                      uint8_t(loop[(root + k + 1) % n])});
+          }
+        }
+      }
+      return cases;
+    }();
+    return cases;
+  }
+
+  // (block, particle) pairs for every padded block within smoothing_radius of a particle
+  void activate(const TV* x, size_t count) {
+    T h = smoothing_radius;
+    tbb::enumerable_thread_specific<std::vector<std::pair<uint64_t, int>>> local_pairs;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, count), [&](const auto& range) {
+      auto& local = local_pairs.local();
+      for (size_t p = range.begin(); p < range.end(); p++) {
+        TVI lo, hi;
+        for (int d = 0; d < 3; d++) {
+          lo(d) = floor_div(int(std::floor((x[p](d) - h) / dx)) - 1, block_width);
+          hi(d) = floor_div(int(std::ceil((x[p](d) + h) / dx)), block_width);
+        }
+        for (int i = lo(0); i <= hi(0); i++)
+          for (int j = lo(1); j <= hi(1); j++)
+            for (int k = lo(2); k <= hi(2); k++) {
+              local.push_back({block_key(TVI(i, j, k)), int(p)});
+            }
+      }
+    });
+    pairs_.clear();
+    for (auto& local : local_pairs) pairs_.insert(pairs_.end(), local.begin(), local.end());
+    // pairs in particle order within a block, whatever thread made them
+    tbb::parallel_sort(pairs_.begin(), pairs_.end());
+
+    block_keys_.clear();
+    blocks_.clear();
+    for (size_t k = 0; k < pairs_.size(); k++) {
+      if (k > 0 && pairs_[k].first == pairs_[k - 1].first) continue;
+      if (!blocks_.empty()) blocks_.back().end = k;
+      block_keys_.push_back(pairs_[k].first);
+      blocks_.push_back({block_coord(pairs_[k].first), k, 0, {}});
+    }
+    if (!blocks_.empty()) blocks_.back().end = pairs_.size();
+    tbb::parallel_for(size_t(0), blocks_.size(), [&](size_t b) {
+      for (int s = 1; s < 8; s++) {
+        TVI offset(s & 1, (s >> 1) & 1, (s >> 2) & 1);
+        auto key = block_key(blocks_[b].coord + offset);
+        auto it = std::lower_bound(block_keys_.begin(), block_keys_.end(), key);
+        blocks_[b].upper[s - 1] =
+          it != block_keys_.end() && *it == key ? int(it - block_keys_.begin()) : -1;
+      }
+    });
+  }
+
+  // normalization of the kernel, both integrate to 1 over the ball of radius h
+  T kernel_sigma() const {
+    constexpr T pi = T(3.14159265358979323846);
+    T h3 = smoothing_radius * smoothing_radius * smoothing_radius;
+    return kernel == Kernel::poly6 ? T(315) / (64 * pi * h3 * h3 * h3) : T(8) / (pi * h3);
+  }
+
+  T kernel_weight(T r2) const {
+    T h = smoothing_radius;
+    if (kernel == Kernel::poly6) {
+      T q = h * h - r2;
+      return sigma_ * q * q * q;
+    }
+    T q = std::sqrt(r2) / h;
+    return sigma_ * (q <= T(0.5) ? 6 * (q * q * q - q * q) + 1 : 2 * (1 - q) * (1 - q) * (1 - q));
+  }
+
+  // field values of the padded nodes of block b, particles in ascending order
+  void splat(size_t b, const TV* x, Scratch& scratch) {
+    auto& block = blocks_[b];
+    TVI origin = block.coord * block_width;
+    T h2 = smoothing_radius * smoothing_radius;
+    std::fill(scratch.weight.begin(), scratch.weight.end(), T(0));
+    std::fill(scratch.center.begin(), scratch.center.end(), TV::Zero());
+
+    for (size_t k = block.begin; k < block.end; k++) {
+      const TV& xp = x[pairs_[k].second];
+      // squared distances along each axis, from global node coords so every block agrees
+      std::array<std::array<T, padded_width>, 3> axis2;
+      TVI lo, hi;
+      for (int d = 0; d < 3; d++) {
+        lo(d) = std::max(int(std::floor((xp(d) - smoothing_radius) / dx)) - origin(d), 0);
+        hi(d) = std::min(int(std::ceil((xp(d) + smoothing_radius) / dx)) - origin(d), block_width);
+        for (int i = lo(d); i <= hi(d); i++) {
+          T distance = (origin(d) + i) * dx - xp(d);
+          axis2[d][i] = distance * distance;
+        }
+      }
+      for (int i = lo(0); i <= hi(0); i++)
+        for (int j = lo(1); j <= hi(1); j++) {
+          T r2_ij = axis2[0][i] + axis2[1][j];
+          if (r2_ij >= h2) continue;
+          for (int k = lo(2); k <= hi(2); k++) {
+            T r2 = r2_ij + axis2[2][k];
+            if (r2 >= h2) continue;
+            T w = kernel_weight(r2);
+            int l = node_index(i, j, k);
+            scratch.weight[l] += w;
+            if (field == Field::level_set) scratch.center[l] += w * xp;
+          }
+        }
+    }
+
+    T* values = values_.data() + b * padded_nodes;
+    for (int i = 0; i < padded_width; i++)
+      for (int j = 0; j < padded_width; j++)
+        for (int k = 0; k < padded_width; k++) {
+          int l = node_index(i, j, k);
+          T w = scratch.weight[l];
+          if (field == Field::density) {
+            values[l] = iso - particle_volume * w;
+          } else if (w > 0) {
+            TV node = (origin + TVI(i, j, k)).template cast<T>() * dx;
+            values[l] = (node - scratch.center[l] / w).norm() - particle_radius;
+          } else {
+            values[l] = smoothing_radius;
+          }
+        }
+  }
+
+  int corner_config(const T* values, int i, int j, int k) const {
+    int config = 0;
+    for (int c = 0; c < 8; c++) {
+      config |= (values[node_index(i + (c & 1), j + (c >> 1 & 1), k + (c >> 2 & 1))] < 0) << c;
+    }
+    return config;
+  }
+
+  // local ids of the vertices on the edges owned by block b, counts of vertices and triangles
+  void number_vertices(size_t b) {
+    const T* values = values_.data() + b * padded_nodes;
+    int* ids = edge_vertex_.data() + b * 3 * block_cells;
+    auto& cases = cube_cases();
+    int vertices = 0, triangles = 0;
+    for (int i = 0; i < block_width; i++)
+      for (int j = 0; j < block_width; j++)
+        for (int k = 0; k < block_width; k++) {
+          bool inside = values[node_index(i, j, k)] < 0;
+          int c = cell_index(i, j, k);
+          ids[c] = (values[node_index(i + 1, j, k)] < 0) != inside ? vertices++ : -1;
+          ids[block_cells + c] = (values[node_index(i, j + 1, k)] < 0) != inside ? vertices++ : -1;
+          ids[2 * block_cells + c] =
+            (values[node_index(i, j, k + 1)] < 0) != inside ? vertices++ : -1;
+          triangles += int(cases[corner_config(values, i, j, k)].size());
+        }
+    vertex_offset_[b + 1] = vertices;
+    triangle_offset_[b + 1] = triangles;
+  }
+
+  void place_vertices(size_t b, SurfaceMesh& mesh) const {
+    const T* values = values_.data() + b * padded_nodes;
+    const int* ids = edge_vertex_.data() + b * 3 * block_cells;
+    TVI origin = blocks_[b].coord * block_width;
+    for (int i = 0; i < block_width; i++)
+      for (int j = 0; j < block_width; j++)
+        for (int k = 0; k < block_width; k++) {
+          int c = cell_index(i, j, k);
+          for (int axis = 0; axis < 3; axis++) {
+            int id = ids[axis * block_cells + c];
+            if (id < 0) continue;
+            TVI end(i, j, k);
+            end(axis)++;
+            T v0 = values[node_index(i, j, k)], v1 = values[node_index(end(0), end(1), end(2))];
+            TV p = (origin + TVI(i, j, k)).template cast<T>();
+            p(axis) += std::clamp(v0 / (v0 - v1), T(0), T(1));
+            auto& vertex = mesh.vertices[vertex_offset_[b] + id];
+            for (int d = 0; d < 3; d++) vertex[d] = float(p(d) * dx);
+          }
+        }
+  }
+
+  // triangles of the cells of block b, edges on the upper faces are owned by neighbors
+  void connect(size_t b, SurfaceMesh& mesh) const {
+    const T* values = values_.data() + b * padded_nodes;
+    auto& cases = cube_cases();
+    auto vertex = [&](int i, int j, int k, int edge) {
+      int corner = edge / 3, axis = edge % 3;
+      TVI node(i + (corner & 1), j + (corner >> 1 & 1), k + (corner >> 2 & 1));
+      int shift = 0;
+      for (int d = 0; d < 3; d++) {
+        if (node(d) == block_width) {
+          shift |= 1 << d;
+          node(d) = 0;
+        }
+      }
+      int owner = shift ? blocks_[b].upper[shift - 1] : int(b);
+      int id = edge_vertex_[(size_t(owner) * 3 + axis) * block_cells +
+                            cell_index(node(0), node(1), node(2))];
+      return uint32_t(vertex_offset_[owner] + id);
+    };
+    size_t t = triangle_offset_[b];
+    for (int i = 0; i < block_width; i++)
+      for (int j = 0; j < block_width; j++)
+        for (int k = 0; k < block_width; k++) {
+          for (auto& triangle : cases[corner_config(values, i, j, k)]) {
+            mesh.triangles[t++] = {vertex(i, j, k, triangle[0]),
+                                   vertex(i, j, k, triangle[1]),
+                                   vertex(i, j, k, triangle[2])};
+          }
+        }
+  }
+
+  std::vector<std::pair<uint64_t, int>> pairs_;
+  // sorted keys of the occupied blocks
+  std::vector<uint64_t> block_keys_;
+  std::vector<Block> blocks_;
+  std::vector<T> values_;
+  // per block and axis, local vertex id of the edge from node (i, j, k) or -1
+  std::vector<int> edge_vertex_;
+  std::vector<size_t> vertex_offset_, triangle_offset_;
+  T sigma_{0};
+  double seconds_{0};
+};
+
+}   // namespace MS
+
+#endif   // METASIM_SURFACE_RECONSTRUCTION_HPP
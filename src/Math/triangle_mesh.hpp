@@ -0,0 +1,143 @@
+#ifndef METASIM_TRIANGLE_MESH_HPP
+#define METASIM_TRIANGLE_MESH_HPP
+
+#include "meta.hpp"
+#include <Eigen/Geometry>
+#include <unordered_map>
+
+namespace MS {
+
+// indexed triangle mesh with angle weighted pseudo normals for robust inside/outside tests
+// (Baerentzen & Aanaes, "Signed distance computation using the angle weighted pseudonormal")
+template<typename T>
+struct TriangleMesh {
+  using TV = Vec<3, T>;
+  using TVI = Vec<3, int>;
+
+  std::vector<TV> vertices;
+  std::vector<TVI> faces;
+
+  std::vector<TV> face_normals;
+  std::vector<TV> vertex_normals;
+  // edge_normals[3 * f + e] for edge (faces[f][e], faces[f][(e + 1) % 3])
+  std::vector<TV> edge_normals;
+
+  void compute_normals() {
+    face_normals.resize(faces.size());
+    vertex_normals.assign(vertices.size(), TV::Zero());
+    edge_normals.assign(faces.size() * 3, TV::Zero());
+
+    std::unordered_map<uint64_t, TV> edge_sum;
+    auto edge_key = [](int a, int b) {
+      if (a > b) std::swap(a, b);
+      return (uint64_t(uint32_t(a)) << 32) | uint32_t(b);
+    };
+
+    for (size_t f = 0; f < faces.size(); f++) {
+      const auto& face = faces[f];
+      TV n = (vertices[face(1)] - vertices[face(0)]).cross(vertices[face(2)] - vertices[face(0)]);
+      T len = n.norm();
+      face_normals[f] = len > 0 ? TV(n / len) : TV::Zero();
+      for (int e = 0; e < 3; e++) {
+        // interior angle at vertex e
+        TV u = vertices[face((e + 1) % 3)] - vertices[face(e)];
+        TV v = vertices[face((e + 2) % 3)] - vertices[face(e)];
+        T angle = std::atan2(u.cross(v).norm(), u.dot(v));
+        vertex_normals[face(e)] += angle * face_normals[f];
+        edge_sum[edge_key(face(e), face((e + 1) % 3))] += face_normals[f];
+      }
+    }
+    for (auto& n : vertex_normals) n.normalize();
+    for (size_t f = 0; f < faces.size(); f++) {
+      for (int e = 0; e < 3; e++) {
+        edge_normals[3 * f + e] =
+          edge_sum[edge_key(faces[f](e), faces[f]((e + 1) % 3))].normalized();
+      }
+    }
+  }
+
+  // bounding box of face f
+  std::pair<TV, TV> face_bounds(size_t f) const {
+    const auto& face = faces[f];
+    TV lower = vertices[face(0)].cwiseMin(vertices[face(1)]).cwiseMin(vertices[face(2)]);
+    TV upper = vertices[face(0)].cwiseMax(vertices[face(1)]).cwiseMax(vertices[face(2)]);
+    return {lower, upper};
+  }
+
+  // closest point on face f to p, the pseudo normal of the closest feature is written to normal
+  TV closest_point(size_t f, const TV& p, TV& normal) const;
+};
+
+// Ericson, "Real-Time Collision Detection" 5.1.5
+// feature: 0..2 vertex a/b/c, 3..5 edge ab/bc/ca, 6 face interior
+template<typename T>
+Vec<3, T> closest_point_on_triangle(const Vec<3, T>& p, const Vec<3, T>& a, const Vec<3, T>& b,
+                                    const Vec<3, T>& c, int& feature) {
+  using TV = Vec<3, T>;
+  TV ab = b - a, ac = c - a, ap = p - a;
+  T d1 = ab.dot(ap), d2 = ac.dot(ap);
+  if (d1 <= 0 && d2 <= 0) {
+    feature = 0;
+    return a;
+  }
+
+  TV bp = p - b;
+  T d3 = ab.dot(bp), d4 = ac.dot(bp);
+  if (d3 >= 0 && d4 <= d3) {
+    feature = 1;
+    return b;
+  }
+
+  T vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    T v = d1 / (d1 - d3);
+    feature = 3;
+    return TV(a + v * ab);
+  }
+
+  TV cp = p - c;
+  T d5 = ab.dot(cp), d6 = ac.dot(cp);
+  if (d6 >= 0 && d5 <= d6) {
+    feature = 2;
+    return c;
+  }
+
+  T vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    T w = d2 / (d2 - d6);
+    feature = 5;
+    return TV(a + w * ac);
+  }
+
+  T va = d3 * d6 - d5 * d4;
+  if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+    T w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    feature = 4;
+    return TV(b + w * (c - b));
+  }
+
+  T denom = T(1) / (va + vb + vc);
+  T v = vb * denom, w = vc * denom;
+  feature = 6;
+  return a + ab * v + ac * w;
+}
+
+template<typename T>
+Vec<3, T> TriangleMesh<T>::closest_point(size_t f, const TV& p, TV& normal) const {
+  const auto& face = faces[f];
+  int feature;
+  TV q = closest_point_on_triangle(
+    p, vertices[face(0)], vertices[face(1)], vertices[face(2)], feature);
+  if (feature < 3) {
+    normal = vertex_normals[face(feature)];
+  } else if (feature < 6) {
+    normal = edge_normals[3 * f + (feature - 3)];
+  } else {
+    normal = face_normals[f];
+  }
+  return q;
+}
+
+}   // namespace MS
+
+#endif   // METASIM_TRIANGLE_MESH_HPP
@@ -0,0 +1,214 @@
+#include "Utils/benchmark.hpp"
+#include "Utils/logger.hpp"
+#include <Eigen/Core>
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <spdlog/version.h>
+#include <sstream>
+#include <tbb/blocked_range.h>
+#include <thread>
+
+namespace MS {
+
+namespace {
+
+std::string escape(const std::string& s) {
+  std::string result;
+  for (char c : s) {
+    if (c == '"' || c == '\\') result += '\\';
+    result += c;
+  }
+  return result;
+}
+
+// objects of the "benchmarks" array, flat string and number members only
+class JsonReader {
+public:
+  explicit JsonReader(std::string text)
+    : text(std::move(text)) {}
+
+  bool seek(const std::string& key) {
+    pos = text.find("\"" + key + "\"");
+    if (pos == std::string::npos) return false;
+    pos = text.find('[', pos);
+    return pos++ != std::string::npos;
+  }
+
+  // next {...} as key -> raw value, false at the end of the array
+  bool next_object(std::map<std::string, std::string>& object) {
+    object.clear();
+    skip_space();
+    if (pos < text.size() && text[pos] == ',') pos++;
+    skip_space();
+    if (pos >= text.size() || text[pos] != '{') return false;
+    pos++;
+    while (true) {
+      skip_space();
+      if (pos >= text.size()) return false;
+      if (text[pos] == '}') return ++pos, true;
+      if (text[pos] == ',') {
+        pos++;
+        continue;
+      }
+      std::string key, value;
+      if (!string(key)) return false;
+      skip_space();
+      if (pos >= text.size() || text[pos++] != ':') return false;
+      skip_space();
+      if (pos < text.size() && text[pos] == '"') {
+        if (!string(value)) return false;
+      } else {
+        auto end = text.find_first_of(",}", pos);
+        if (end == std::string::npos) return false;
+        value = text.substr(pos, end - pos);
+        pos = end;
+      }
+      object[key] = value;
+    }
+  }
+
+private:
+  void skip_space() {
+    while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) pos++;
+  }
+  bool string(std::string& s) {
+    if (text[pos] != '"') return false;
+    for (pos++; pos < text.size() && text[pos] != '"'; pos++) {
+      if (text[pos] == '\\') pos++;
+      s += text[pos];
+    }
+    return pos++ < text.size();
+  }
+
+  std::string text;
+  size_t pos{0};
+};
+
+}   // namespace
+
+Benchmark::Benchmark() {
+  context["eigen"] = fmt::format("{}.{}.{}", EIGEN_WORLD_VERSION, EIGEN_MAJOR_VERSION,
+                                 EIGEN_MINOR_VERSION);
+  context["tbb"] = fmt::format("{}.{}", TBB_VERSION_MAJOR, TBB_VERSION_MINOR);
+  context["spdlog"] = fmt::format("{}.{}.{}", SPDLOG_VER_MAJOR, SPDLOG_VER_MINOR,
+                                  SPDLOG_VER_PATCH);
+#if defined(__clang__)
+  context["compiler"] = "clang " __clang_version__;
+#elif defined(__GNUC__)
+  context["compiler"] = "gcc " __VERSION__;
+#endif
+#ifdef NDEBUG
+  context["build"] = "release";
+#else
+  context["build"] = "debug";
+#endif
+  context["hardware_threads"] = std::to_string(std::thread::hardware_concurrency());
+  char date[32];
+  auto now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+  context["date"] = date;
+}
+
+void Benchmark::add_result(const std::string& name, uint64_t iterations,
+                           std::vector<double>& samples, double items, int threads) {
+  std::sort(samples.begin(), samples.end());
+  Result result{name, iterations, samples[samples.size() / 2], samples.front(), items, threads};
+  if (write_log) {
+    META_INFO("{:<48}{:>14.1f} ns{:>14.1f} ns{:>12}{}",
+              name,
+              result.median_ns,
+              result.min_ns,
+              iterations,
+              items > 0 ? fmt::format("{:>12.3g} items/s", result.items_per_second()) : "");
+  }
+  results_.push_back(result);
+}
+
+bool Benchmark::write_json(const std::string& path) const {
+  std::ofstream file(path);
+  if (!file) {
+    META_ERROR("cannot open {} for writing", path);
+    return false;
+  }
+  file << "{\n  \"context\": {";
+  bool first = true;
+  for (auto& [key, value] : context) {
+    file << (first ? "\n" : ",\n") << "    \"" << escape(key) << "\": \"" << escape(value) << "\"";
+    first = false;
+  }
+  file << "\n  },\n  \"benchmarks\": [";
+  first = true;
+  for (auto& result : results_) {
+    file << (first ? "\n" : ",\n")
+         << fmt::format("    {{\"name\": \"{}\", \"iterations\": {}, \"median_ns\": {:.6g}, "
+                        "\"min_ns\": {:.6g}, \"items\": {}, \"threads\": {}}}",
+                        escape(result.name),
+                        result.iterations,
+                        result.median_ns,
+                        result.min_ns,
+                        result.items,
+                        result.threads);
+    first = false;
+  }
+  file << "\n  ]\n}\n";
+  if (!file) {
+    META_ERROR("failed writing {}", path);
+    return false;
+  }
+  return true;
+}
+
+bool Benchmark::read_json(const std::string& path, std::vector<Result>& results) {
+  std::ifstream file(path);
+  if (!file) {
+    META_ERROR("cannot open {}", path);
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  JsonReader reader(buffer.str());
+  if (!reader.seek("benchmarks")) {
+    META_ERROR("{} has no benchmarks", path);
+    return false;
+  }
+
+  results.clear();
+  std::map<std::string, std::string> object;
+  while (reader.next_object(object)) {
+    Result result;
+    try {
+      result.name = object.at("name");
+      result.median_ns = std::stod(object.at("median_ns"));
+      if (object.count("min_ns")) result.min_ns = std::stod(object["min_ns"]);
+      if (object.count("iterations")) result.iterations = std::stoull(object["iterations"]);
+      if (object.count("items")) result.items = std::stod(object["items"]);
+      if (object.count("threads")) result.threads = std::stoi(object["threads"]);
+    } catch (const std::exception&) {
+      META_ERROR("{}: malformed benchmark entry", path);
+      return false;
+    }
+    results.push_back(result);
+  }
+  return true;
+}
+
+std::vector<Benchmark::Comparison> Benchmark::compare(const std::vector<Result>& baseline,
+                                                      const std::vector<Result>& current,
+                                                      double threshold) {
+  std::map<std::string, const Result*> lookup;
+  for (auto& result : baseline) lookup[result.name] = &result;
+
+  std::vector<Comparison> comparisons;
+  for (auto& result : current) {
+    auto iter = lookup.find(result.name);
+    if (iter == lookup.end() || iter->second->median_ns <= 0) continue;
+    double change = result.median_ns / iter->second->median_ns - 1;
+    comparisons.push_back(
+      {result.name, iter->second->median_ns, result.median_ns, change, change > threshold});
+  }
+  return comparisons;
+}
+
+}   // namespace MS
@@ -0,0 +1,111 @@
+#ifndef METASIM_BENCHMARK_HPP
+#define METASIM_BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace MS {
+
+// keep value (and the work producing it) alive through the optimizer
+template<typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
+
+/*
+ * Minimal benchmark runner
+ *
+ * run() calibrates the iterations per sample so a sample takes min_time / samples,
+ * then keeps the median and min of the samples in ns per iteration. Results go to a
+ * JSON file together with the library versions they were measured with, and
+ * compare() checks a run against a stored baseline of the same machine.
+ */
+class Benchmark {
+public:
+  struct Result {
+    // "range_set/merge/fragments:1024"
+    std::string name;
+    uint64_t iterations{0};
+    double median_ns{0}, min_ns{0};
+    // work per iteration (elements, particles), 0 when not meaningful
+    double items{0};
+    int threads{1};
+
+    double items_per_second() const { return median_ns > 0 ? items * 1e9 / median_ns : 0; }
+  };
+
+  struct Comparison {
+    std::string name;
+    double baseline_ns, current_ns;
+    // current / baseline - 1, > 0 is slower
+    double change;
+    bool regression;
+  };
+
+  // substring a benchmark name must contain to run, empty runs all
+  std::string filter;
+  double min_time{0.2};
+  int samples{5};
+  bool write_log{true};
+  // written to the JSON "context", library versions and build are filled in
+  std::map<std::string, std::string> context;
+
+  Benchmark();
+
+  bool selected(const std::string& name) const {
+    return filter.empty() || name.find(filter) != std::string::npos;
+  }
+
+  template<typename Op>
+  void run(const std::string& name, double items, Op&& op, int threads = 1) {
+    using clock = std::chrono::steady_clock;
+    if (!selected(name)) return;
+    auto time = [&](uint64_t iterations) {
+      auto begin = clock::now();
+      for (uint64_t i = 0; i < iterations; i++) op();
+      return std::chrono::duration<double, std::nano>(clock::now() - begin).count();
+    };
+
+    // warm up and find the iterations of one sample
+    double target = min_time * 1e9 / samples;
+    uint64_t iterations = 1;
+    double elapsed = time(iterations);
+    while (elapsed < target) {
+      double scale = elapsed > 0 ? 1.2 * target / elapsed : 10;
+      iterations = std::max<uint64_t>(iterations + 1, uint64_t(iterations * std::min(scale, 10.0)));
+      elapsed = time(iterations);
+    }
+
+    std::vector<double> per_iteration;
+    for (int s = 0; s < samples; s++) per_iteration.push_back(time(iterations) / iterations);
+    add_result(name, iterations, per_iteration, items, threads);
+  }
+
+  const std::vector<Result>& results() const { return results_; }
+
+  bool write_json(const std::string& path) const;
+  static bool read_json(const std::string& path, std::vector<Result>& results);
+
+  // benchmarks in both runs, regression when slower by more than threshold (0.1 = 10%)
+  static std::vector<Comparison> compare(const std::vector<Result>& baseline,
+                                         const std::vector<Result>& current, double threshold);
+
+private:
+  void add_result(const std::string& name, uint64_t iterations, std::vector<double>& samples,
+                  double items, int threads);
+
+  std::vector<Result> results_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_BENCHMARK_HPP
@@ -0,0 +1,286 @@
+#include "Utils/checkpoint.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <tbb/parallel_for.h>
+
+namespace MS {
+
+namespace {
+
+constexpr char magic[8] = {'M', 'S', 'D', 'E', 'L', 'T', 'A', '\0'};
+constexpr uint32_t version = 1;
+
+enum Kind : uint8_t { pages = 1, whole = 2 };
+
+uint64_t hash_bytes(const char* p, size_t n) {
+  uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+  auto mix = [&](uint64_t w) {
+    h ^= w * 0x87C37B91114253D5ull;
+    h = (h << 31 | h >> 33) * 0x4CF5AD432745937Full;
+  };
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w;
+    std::memcpy(&w, p + i, 8);
+    mix(w);
+  }
+  if (i < n) {
+    uint64_t w = 0;
+    std::memcpy(&w, p + i, n - i);
+    mix(w);
+  }
+  h ^= h >> 33;
+  return h * 0xFF51AFD7ED558CCDull;
+}
+
+bool same_layout(const ParticleSection& a, const ParticleSection& b) {
+  return a.element_type == b.element_type && a.element_size == b.element_size &&
+         a.element_count == b.element_count && a.ranges.ranges == b.ranges.ranges;
+}
+
+class StreamWriter {
+public:
+  explicit StreamWriter(std::ofstream& out)
+    : out(out) {}
+  template<typename POD>
+  void put(const POD& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(POD));
+  }
+  void put(const std::string& s) {
+    put(uint32_t(s.size()));
+    out.write(s.data(), s.size());
+  }
+  std::ofstream& out;
+};
+
+class StreamReader {
+public:
+  explicit StreamReader(std::ifstream& in)
+    : in(in) {}
+  template<typename POD>
+  bool get(POD& value) {
+    return bool(in.read(reinterpret_cast<char*>(&value), sizeof(POD)));
+  }
+  bool get(std::string& s) {
+    uint32_t length;
+    if (!get(length)) return false;
+    s.resize(length);
+    return bool(in.read(s.data(), length));
+  }
+  std::ifstream& in;
+};
+
+}   // namespace
+
+std::vector<uint64_t> Checkpointer::hash_pages(const DataArrayBase& array) const {
+  auto data = static_cast<const char*>(array.raw_data());
+  size_t bytes = array.raw_bytes();
+  std::vector<uint64_t> hashes((bytes + page_bytes - 1) / page_bytes);
+  tbb::parallel_for(size_t(0), hashes.size(), [&](size_t page) {
+    size_t begin = page * page_bytes;
+    hashes[page] = hash_bytes(data + begin, std::min(page_bytes, bytes - begin));
+  });
+  return hashes;
+}
+
+bool Checkpointer::write(const std::string& path, const DataContainer& container) {
+  std::vector<const DataArrayBase*> arrays;
+  for (auto& [hash, array] : container.dataset) arrays.push_back(array.get());
+  std::sort(arrays.begin(), arrays.end(), [](auto a, auto b) { return a->name < b->name; });
+
+  // restore() can only create arrays from the full checkpoint, new or removed ones need one
+  bool full = count_ == 0 || (full_interval > 0 && count_ % full_interval == 0) ||
+              arrays.size() != previous_.size();
+  for (auto array : arrays) full = full || !previous_.count(array->name);
+
+  report_ = Report();
+  report_.full = full;
+  for (auto array : arrays) report_.bytes_total += array->raw_bytes();
+
+  bool ok;
+  if (full) {
+    ok = ParticleFile::write(path, container);
+    previous_.clear();
+    for (auto array : arrays) {
+      previous_[array->name] = {
+        array, array->version, ParticleFile::describe(*array), hash_pages(*array)};
+    }
+    report_.arrays_written = int(arrays.size());
+    report_.bytes_written = report_.bytes_total;
+  } else {
+    ok = write_delta(path, arrays);
+  }
+  count_++;
+
+  if (write_log) {
+    META_INFO("checkpoint {}: {} {:.1f} of {:.1f} MB, arrays skipped {}, partial {}, whole {}",
+              path,
+              full ? "full" : "delta",
+              report_.bytes_written / 1e6,
+              report_.bytes_total / 1e6,
+              report_.arrays_skipped,
+              report_.arrays_partial,
+              report_.arrays_written);
+  }
+  return ok;
+}
+
+bool Checkpointer::write_delta(const std::string& path,
+                               const std::vector<const DataArrayBase*>& arrays) {
+  struct Change {
+    const DataArrayBase* array;
+    ParticleSection layout;
+    Kind kind;
+    std::vector<uint32_t> pages;
+  };
+  std::vector<Change> changes;
+
+  for (auto array : arrays) {
+    auto& state = previous_[array->name];
+    if (trust_versions && state.array == array && state.version == array->version) {
+      report_.arrays_skipped++;
+      continue;
+    }
+    auto layout = ParticleFile::describe(*array);
+    auto hashes = hash_pages(*array);
+    if (same_layout(layout, state.layout) && hashes.size() == state.page_hashes.size()) {
+      std::vector<uint32_t> dirty;
+      for (size_t page = 0; page < hashes.size(); page++) {
+        if (hashes[page] != state.page_hashes[page]) dirty.push_back(uint32_t(page));
+      }
+      if (dirty.empty()) {
+        report_.arrays_skipped++;
+      } else {
+        report_.arrays_partial++;
+        changes.push_back({array, layout, pages, std::move(dirty)});
+      }
+    } else {
+      report_.arrays_written++;
+      changes.push_back({array, layout, whole, {}});
+    }
+    state = {array, array->version, layout, std::move(hashes)};
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    META_ERROR("cannot open {} for writing", path);
+    return false;
+  }
+  StreamWriter out(file);
+  file.write(magic, sizeof(magic));
+  out.put(version);
+  out.put(uint32_t(changes.size()));
+  for (auto& change : changes) {
+    auto& layout = change.layout;
+    out.put(layout.name);
+    out.put(layout.element_type);
+    out.put(uint64_t(layout.element_size));
+    out.put(uint64_t(layout.element_count));
+    out.put(uint32_t(layout.ranges.ranges.size()));
+    for (auto& range : layout.ranges) {
+      out.put(int32_t(range.lower));
+      out.put(int32_t(range.upper));
+    }
+    out.put(uint8_t(change.kind));
+    out.put(uint64_t(page_bytes));
+    out.put(uint32_t(change.pages.size()));
+    for (auto page : change.pages) out.put(page);
+
+    auto data = static_cast<const char*>(change.array->raw_data());
+    if (change.kind == whole) {
+      file.write(data, layout.bytes);
+      report_.bytes_written += layout.bytes;
+    } else {
+      for (auto page : change.pages) {
+        size_t begin = size_t(page) * page_bytes;
+        size_t length = std::min(page_bytes, layout.bytes - begin);
+        file.write(data + begin, length);
+        report_.bytes_written += length;
+      }
+    }
+  }
+  if (!file) {
+    META_ERROR("failed writing {}", path);
+    return false;
+  }
+  return true;
+}
+
+bool Checkpointer::apply_delta(const std::string& path, DataContainer& container) {
+  std::ifstream file(path, std::ios::binary);
+  StreamReader in(file);
+  char file_magic[sizeof(magic)];
+  uint32_t file_version, count;
+  if (!in.get(file_magic) || std::memcmp(file_magic, magic, sizeof(magic)) != 0 ||
+      !in.get(file_version) || file_version != version || !in.get(count)) {
+    META_ERROR("{} is not a delta checkpoint", path);
+    return false;
+  }
+
+  for (uint32_t s = 0; s < count; s++) {
+    ParticleSection layout;
+    uint64_t element_size, element_count, section_page_bytes;
+    uint32_t range_count, page_count;
+    uint8_t kind;
+    bool ok = in.get(layout.name) && in.get(layout.element_type) && in.get(element_size) &&
+              in.get(element_count) && in.get(range_count);
+    for (uint32_t r = 0; ok && r < range_count; r++) {
+      int32_t lower, upper;
+      ok = in.get(lower) && in.get(upper);
+      layout.ranges.ranges.push_back({lower, upper});
+    }
+    ok = ok && in.get(kind) && in.get(section_page_bytes) && in.get(page_count);
+    std::vector<uint32_t> page_list(ok ? page_count : 0);
+    for (auto& page : page_list) ok = ok && in.get(page);
+    if (!ok) {
+      META_ERROR("{} is truncated", path);
+      return false;
+    }
+    size_t bytes = element_size * element_count;
+
+    DataArrayBase* array = nullptr;
+    for (auto& [hash, candidate] : container.dataset) {
+      if (candidate->name == layout.name) array = candidate.get();
+    }
+    if (!array) {
+      // not restored, skip its payload
+      size_t skip = kind == whole ? bytes : 0;
+      for (auto page : page_list) {
+        skip += std::min<size_t>(section_page_bytes, bytes - size_t(page) * section_page_bytes);
+      }
+      file.seekg(skip, std::ios::cur);
+      continue;
+    }
+    if (array->element_size() != element_size || array->element_type() != layout.element_type) {
+      META_ERROR("{}: attribute '{}' changed its element type", path, layout.name);
+      return false;
+    }
+
+    // resize and materialize against the current ranges, then take the new ones
+    if (kind == whole) {
+      array->raw_resize(element_count);
+    } else if (array->element_count() != element_count) {
+      META_ERROR("{}: '{}' does not follow the previous checkpoint", path, layout.name);
+      return false;
+    }
+    auto data = static_cast<char*>(array->raw_data());
+    array->ranges = layout.ranges;
+    array->ranges_changed();
+    if (kind == whole) {
+      file.read(data, bytes);
+    } else {
+      for (auto page : page_list) {
+        size_t begin = size_t(page) * section_page_bytes;
+        file.read(data + begin, std::min<size_t>(section_page_bytes, bytes - begin));
+      }
+    }
+    if (!file) {
+      META_ERROR("{} is truncated", path);
+      return false;
+    }
+  }
+  return true;
+}
+
+}   // namespace MS
@@ -0,0 +1,81 @@
+#ifndef METASIM_CHECKPOINT_HPP
+#define METASIM_CHECKPOINT_HPP
+
+#include "Core/data_container.hpp"
+#include "Utils/particle_file.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Incremental checkpoints of a DataContainer
+ *
+ * The first checkpoint (and every full_interval-th, or whenever the set of arrays or
+ * the layout of one changes) is a full ParticleFile. The following ones are deltas to
+ * the previous checkpoint: arrays whose version did not move are skipped without
+ * reading them, the others are hashed in pages of page_bytes and only changed pages
+ * are written. restore() maps the full checkpoint and applies the deltas after it.
+ */
+class Checkpointer {
+public:
+  size_t page_bytes{size_t(1) << 16};
+  // force a full checkpoint every full_interval checkpoints, 0 for only when needed
+  int full_interval{0};
+  // false: hash every array, for code that writes through kept references without touch()
+  bool trust_versions{true};
+  bool write_log{true};
+
+  struct Report {
+    bool full{false};
+    size_t bytes_total{0};
+    size_t bytes_written{0};
+    int arrays_skipped{0};
+    int arrays_partial{0};
+    int arrays_written{0};
+  };
+
+  // write the next checkpoint of container to path
+  bool write(const std::string& path, const DataContainer& container);
+  const Report& last_report() const { return report_; }
+
+  /*
+   * restore the arrays of tags from paths = {full checkpoint, deltas...} in write order
+   * arrays are adopted from the mapped full checkpoint, delta pages are copied over
+   */
+  template<typename... Types>
+  static bool restore(DataContainer& container, const std::vector<std::string>& paths,
+                      const TypeTag<Types>&... tags) {
+    if (paths.empty()) return false;
+    ParticleFile base;
+    if (!base.open(paths[0])) return false;
+    if (!(... && (base.load(container, tags) != nullptr))) return false;
+    for (size_t i = 1; i < paths.size(); i++) {
+      if (!apply_delta(paths[i], container)) return false;
+    }
+    return true;
+  }
+
+  // apply one delta checkpoint to the arrays of container it names
+  static bool apply_delta(const std::string& path, DataContainer& container);
+
+private:
+  struct ArrayState {
+    const DataArrayBase* array;
+    uint64_t version;
+    ParticleSection layout;
+    std::vector<uint64_t> page_hashes;
+  };
+
+  std::vector<uint64_t> hash_pages(const DataArrayBase& array) const;
+  bool write_delta(const std::string& path, const std::vector<const DataArrayBase*>& arrays);
+
+  std::unordered_map<std::string, ArrayState> previous_;
+  int count_{0};
+  Report report_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_CHECKPOINT_HPP
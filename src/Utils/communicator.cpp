@@ -0,0 +1,131 @@
+#include "Utils/communicator.hpp"
+#include <algorithm>
+#include <cstring>
+#ifdef METASIM_WITH_MPI
+#include <mpi.h>
+#endif
+
+namespace MS {
+
+Communicator& Communicator::world() {
+  static Communicator communicator;
+  return communicator;
+}
+
+#ifdef METASIM_WITH_MPI
+
+Communicator::Communicator() {
+  int initialized = 0;
+  MPI_Initialized(&initialized);
+  if (!initialized) {
+    int provided;
+    // TBB workers never call MPI, only the thread that initialized it
+    MPI_Init_thread(nullptr, nullptr, MPI_THREAD_FUNNELED, &provided);
+    initialized_here_ = true;
+  }
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank_);
+  MPI_Comm_size(MPI_COMM_WORLD, &size_);
+}
+
+Communicator::~Communicator() {
+  int finalized = 0;
+  MPI_Finalized(&finalized);
+  if (initialized_here_ && !finalized) MPI_Finalize();
+}
+
+std::vector<std::vector<char>> Communicator::exchange(
+  const std::vector<std::vector<char>>& send) {
+  std::vector<int> send_counts(size_), receive_counts(size_);
+  std::vector<int> send_offsets(size_ + 1, 0), receive_offsets(size_ + 1, 0);
+  for (int r = 0; r < size_; r++) {
+    send_counts[r] = int(send[r].size());
+    send_offsets[r + 1] = send_offsets[r] + send_counts[r];
+  }
+  MPI_Alltoall(send_counts.data(), 1, MPI_INT, receive_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+  for (int r = 0; r < size_; r++) receive_offsets[r + 1] = receive_offsets[r] + receive_counts[r];
+
+  std::vector<char> send_buffer(send_offsets[size_]), receive_buffer(receive_offsets[size_]);
+  for (int r = 0; r < size_; r++) {
+    std::copy(send[r].begin(), send[r].end(), send_buffer.begin() + send_offsets[r]);
+  }
+  MPI_Alltoallv(send_buffer.data(),
+                send_counts.data(),
+                send_offsets.data(),
+                MPI_BYTE,
+                receive_buffer.data(),
+                receive_counts.data(),
+                receive_offsets.data(),
+                MPI_BYTE,
+                MPI_COMM_WORLD);
+
+  std::vector<std::vector<char>> received(size_);
+  for (int r = 0; r < size_; r++) {
+    received[r].assign(receive_buffer.begin() + receive_offsets[r],
+                       receive_buffer.begin() + receive_offsets[r + 1]);
+  }
+  return received;
+}
+
+void Communicator::sendrecv(const void* send, size_t send_bytes, int to, void* receive,
+                            size_t receive_bytes, int from) {
+  MPI_Sendrecv(send,
+               int(send_bytes),
+               MPI_BYTE,
+               to < 0 ? MPI_PROC_NULL : to,
+               0,
+               receive,
+               int(receive_bytes),
+               MPI_BYTE,
+               from < 0 ? MPI_PROC_NULL : from,
+               0,
+               MPI_COMM_WORLD,
+               MPI_STATUS_IGNORE);
+}
+
+void Communicator::sum(std::vector<double>& values) {
+  MPI_Allreduce(
+    MPI_IN_PLACE, values.data(), int(values.size()), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+}
+
+double Communicator::sum(double value) {
+  MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  return value;
+}
+
+double Communicator::max(double value) {
+  MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  return value;
+}
+
+void Communicator::barrier() {
+  MPI_Barrier(MPI_COMM_WORLD);
+}
+
+#else
+
+Communicator::Communicator() = default;
+Communicator::~Communicator() = default;
+
+std::vector<std::vector<char>> Communicator::exchange(
+  const std::vector<std::vector<char>>& send) {
+  return send;
+}
+
+void Communicator::sendrecv(const void* send, size_t send_bytes, int to, void* receive,
+                            size_t receive_bytes, int from) {
+  // the only rank can only talk to itself
+  if (to == 0 && from == 0) std::memcpy(receive, send, std::min(send_bytes, receive_bytes));
+}
+
+void Communicator::sum(std::vector<double>&) {}
+double Communicator::sum(double value) {
+  return value;
+}
+double Communicator::max(double value) {
+  return value;
+}
+void Communicator::barrier() {}
+
+#endif
+
+}   // namespace MS
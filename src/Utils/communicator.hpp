@@ -0,0 +1,51 @@
+#ifndef METASIM_COMMUNICATOR_HPP
+#define METASIM_COMMUNICATOR_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Ranks of a distributed run, MPI_COMM_WORLD when built with METASIM_WITH_MPI
+ *
+ * Without MPI (or under a plain launch) there is a single rank and every exchange is
+ * local, so code written against the communicator runs unchanged in one process.
+ * MPI is initialized by the first world() and finalized at exit.
+ */
+class Communicator {
+public:
+  static Communicator& world();
+
+  int rank() const { return rank_; }
+  int size() const { return size_; }
+  bool distributed() const { return size_ > 1; }
+
+  // send[r] goes to rank r, returns the buffers every rank sent here (alltoallv)
+  std::vector<std::vector<char>> exchange(const std::vector<std::vector<char>>& send);
+
+  // send bytes to rank to while receiving bytes from rank from, -1 for none of either
+  void sendrecv(const void* send, size_t send_bytes, int to, void* receive, size_t receive_bytes,
+                int from);
+
+  // element wise sum over all ranks, in place
+  void sum(std::vector<double>& values);
+  double sum(double value);
+  double max(double value);
+  void barrier();
+
+  ~Communicator();
+  Communicator(const Communicator&) = delete;
+  Communicator& operator=(const Communicator&) = delete;
+
+private:
+  Communicator();
+
+  int rank_{0};
+  int size_{1};
+  bool initialized_here_{false};
+};
+
+}   // namespace MS
+
+#endif   // METASIM_COMMUNICATOR_HPP
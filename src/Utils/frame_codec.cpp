@@ -0,0 +1,458 @@
+#include "Utils/frame_codec.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/tick_count.h>
+
+namespace MS {
+
+namespace {
+
+constexpr char magic[8] = {'M', 'S', 'F', 'R', 'A', 'M', 'E', 'Z'};
+constexpr uint32_t version = 1;
+
+enum Mode : uint8_t { lossless = 0, quantized = 1 };
+
+// scalar width of an ElementType name, "f8x3" -> 8, opaque bytes -> 1
+size_t scalar_size(const std::string& element_type) {
+  if (element_type.empty() || element_type[0] == 'b') return 1;
+  return size_t(std::atoi(element_type.c_str() + 1));
+}
+
+bool is_float(const std::string& element_type) {
+  return !element_type.empty() && element_type[0] == 'f' &&
+         (scalar_size(element_type) == 4 || scalar_size(element_type) == 8);
+}
+
+void put_bytes(std::vector<char>& out, const void* p, size_t n) {
+  auto c = static_cast<const char*>(p);
+  out.insert(out.end(), c, c + n);
+}
+
+template<typename POD>
+void put(std::vector<char>& out, const POD& value) {
+  put_bytes(out, &value, sizeof(POD));
+}
+
+void put(std::vector<char>& out, const std::string& s) {
+  put(out, uint32_t(s.size()));
+  put_bytes(out, s.data(), s.size());
+}
+
+struct Reader {
+  const char* p;
+  const char* end;
+
+  bool get_bytes(void* value, size_t n) {
+    if (size_t(end - p) < n) return false;
+    std::memcpy(value, p, n);
+    p += n;
+    return true;
+  }
+  template<typename POD>
+  bool get(POD& value) {
+    return get_bytes(&value, sizeof(POD));
+  }
+  bool get(std::string& s) {
+    uint32_t length;
+    if (!get(length) || size_t(end - p) < length) return false;
+    s.assign(p, length);
+    p += length;
+    return true;
+  }
+};
+
+void put_varint(std::vector<char>& out, size_t x) {
+  while (x >= 0x80) {
+    out.push_back(char(x | 0x80));
+    x >>= 7;
+  }
+  out.push_back(char(x));
+}
+
+bool get_varint(Reader& in, size_t& x) {
+  x = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte;
+    if (!in.get(byte)) return false;
+    x |= size_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+// (zero run, literal run, literals)*, literal runs end at three zeros in a row
+void rle_encode(const uint8_t* data, size_t n, std::vector<char>& out) {
+  size_t i = 0;
+  while (i < n) {
+    size_t zeros = 0;
+    while (i + zeros < n && data[i + zeros] == 0) zeros++;
+    i += zeros;
+    size_t literal = 0;
+    while (i + literal < n) {
+      if (data[i + literal] == 0 && i + literal + 2 < n && data[i + literal + 1] == 0 &&
+          data[i + literal + 2] == 0)
+        break;
+      literal++;
+    }
+    // a trailing zero tail shorter than three bytes stays in the literal run
+    put_varint(out, zeros);
+    put_varint(out, literal);
+    put_bytes(out, data + i, literal);
+    i += literal;
+  }
+}
+
+bool rle_decode(Reader& in, uint8_t* data, size_t n) {
+  size_t i = 0;
+  while (i < n) {
+    size_t zeros, literal;
+    if (!get_varint(in, zeros) || !get_varint(in, literal) || zeros + literal > n - i) return false;
+    std::memset(data + i, 0, zeros);
+    i += zeros;
+    if (!in.get_bytes(data + i, literal)) return false;
+    i += literal;
+  }
+  return true;
+}
+
+// words of width bytes into byte planes: plane b holds byte b of every word
+void shuffle(const uint8_t* words, size_t n, size_t width, uint8_t* planes) {
+  for (size_t b = 0; b < width; b++) {
+    for (size_t i = 0; i < n; i++) planes[b * n + i] = words[i * width + b];
+  }
+}
+
+void unshuffle(const uint8_t* planes, size_t n, size_t width, uint8_t* words) {
+  for (size_t b = 0; b < width; b++) {
+    for (size_t i = 0; i < n; i++) words[i * width + b] = planes[b * n + i];
+  }
+}
+
+uint64_t zigzag(int64_t x) { return (uint64_t(x) << 1) ^ uint64_t(x >> 63); }
+int64_t unzigzag(uint64_t x) { return int64_t(x >> 1) ^ -int64_t(x & 1); }
+
+// whether all n values are finite and round to multiples of quantum whose deltas fit int64
+template<typename Scalar>
+bool quantizable(const char* values, size_t n, double quantum) {
+  auto v = reinterpret_cast<const Scalar*>(values);
+  double limit = std::ldexp(quantum, 62);
+  return tbb::parallel_reduce(
+    tbb::blocked_range<size_t>(0, n),
+    true,
+    [&](const tbb::blocked_range<size_t>& r, bool fits) {
+      for (size_t i = r.begin(); fits && i != r.end(); i++) fits = std::abs(double(v[i])) < limit;
+      return fits;
+    },
+    std::logical_and<>());
+}
+
+template<typename Scalar>
+void quantize(const char* values, size_t n, double quantum, int64_t* q) {
+  auto v = reinterpret_cast<const Scalar*>(values);
+  for (size_t i = 0; i < n; i++) q[i] = std::llround(double(v[i]) / quantum);
+}
+
+template<typename Scalar>
+void dequantize(const int64_t* q, size_t n, double quantum, char* values) {
+  auto v = reinterpret_cast<Scalar*>(values);
+  for (size_t i = 0; i < n; i++) v[i] = Scalar(q[i] * quantum);
+}
+
+struct SectionLayout {
+  const ParticleSection* section;
+  FrameCodec::Reference* reference;
+  uint8_t mode;
+  bool has_reference;
+  double quantum;
+  size_t scalar_size, components, chunk_scalars, chunk_count;
+};
+
+// one chunk of scalars [first, first + n) of a section
+struct ChunkTask {
+  size_t section, first, n;
+};
+
+}   // namespace
+
+std::vector<char> FrameCodec::encode(const FrameSnapshot& snapshot, Report* report) {
+  auto timer = tbb::tick_count::now();
+  if (frames_since_keyframe_ == 0 || frames_since_keyframe_ >= keyframe_interval) {
+    references_.clear();
+    frames_since_keyframe_ = 0;
+  }
+  frames_since_keyframe_++;
+
+  std::vector<SectionLayout> layouts;
+  std::vector<ChunkTask> tasks;
+  for (size_t i = 0; i < snapshot.sections.size(); i++) {
+    auto& section = snapshot.sections[i];
+    SectionLayout layout;
+    layout.section = &section;
+    layout.scalar_size = scalar_size(section.element_type);
+    layout.components = section.element_size / layout.scalar_size;
+    size_t scalars = section.element_count * layout.components;
+    layout.mode = lossless;
+    layout.quantum = 0;
+    auto tolerance = tolerances.find(section.name);
+    if (tolerance != tolerances.end() && is_float(section.element_type)) {
+      layout.quantum = 2 * tolerance->second;
+      auto values = snapshot.payloads[i].data();
+      bool fits = layout.quantum > 0 && std::isfinite(layout.quantum) &&
+                  (layout.scalar_size == 4 ? quantizable<float>(values, scalars, layout.quantum)
+                                           : quantizable<double>(values, scalars, layout.quantum));
+      if (fits) {
+        layout.mode = quantized;
+      } else {
+        META_WARN("frame {}: {} stored lossless, cannot quantize it at tolerance {}",
+                  snapshot.frame,
+                  section.name,
+                  tolerance->second);
+        layout.quantum = 0;
+      }
+    }
+    size_t word = layout.mode == quantized ? sizeof(int64_t) : layout.scalar_size;
+    auto& reference = references_[section.name];
+    layout.reference = &reference;
+    layout.has_reference = reference.element_count == section.element_count &&
+                           reference.ranges.ranges == section.ranges.ranges &&
+                           reference.words.size() == scalars * word &&
+                           reference.quantized == (layout.mode == quantized) && scalars > 0;
+    reference.element_count = section.element_count;
+    reference.ranges = section.ranges;
+    reference.quantized = layout.mode == quantized;
+    reference.words.resize(scalars * word);
+
+    layout.chunk_scalars = std::max<size_t>(chunk_elements, 1) * layout.components;
+    layout.chunk_count = 0;
+    for (size_t first = 0; first < scalars; first += layout.chunk_scalars) {
+      tasks.push_back({i, first, std::min(layout.chunk_scalars, scalars - first)});
+      layout.chunk_count++;
+    }
+    layouts.push_back(layout);
+  }
+
+  std::vector<std::vector<char>> encoded(tasks.size());
+  tbb::parallel_for(size_t(0), tasks.size(), [&](size_t t) {
+    auto& task = tasks[t];
+    auto& layout = layouts[task.section];
+    auto& reference = *layout.reference;
+    auto values = snapshot.payloads[task.section].data() + task.first * layout.scalar_size;
+
+    std::vector<uint8_t> words, planes;
+    size_t word;
+    if (layout.mode == quantized) {
+      word = sizeof(int64_t);
+      auto q = reinterpret_cast<int64_t*>(reference.words.data()) + task.first;
+      std::vector<int64_t> previous;
+      if (layout.has_reference) previous.assign(q, q + task.n);
+      if (layout.scalar_size == 4) {
+        quantize<float>(values, task.n, layout.quantum, q);
+      } else {
+        quantize<double>(values, task.n, layout.quantum, q);
+      }
+      words.resize(task.n * word);
+      auto delta = reinterpret_cast<uint64_t*>(words.data());
+      for (size_t i = 0; i < task.n; i++) {
+        delta[i] = zigzag(layout.has_reference ? q[i] - previous[i] : q[i]);
+      }
+    } else {
+      word = layout.scalar_size;
+      auto bytes = task.n * word;
+      auto ref = reference.words.data() + task.first * word;
+      words.resize(bytes);
+      for (size_t i = 0; i < bytes; i++) {
+        words[i] = uint8_t(values[i] ^ (layout.has_reference ? ref[i] : 0));
+      }
+      std::memcpy(ref, values, bytes);
+    }
+    planes.resize(words.size());
+    shuffle(words.data(), task.n, word, planes.data());
+    rle_encode(planes.data(), planes.size(), encoded[t]);
+  });
+
+  std::vector<char> out;
+  put_bytes(out, magic, sizeof(magic));
+  put(out, version);
+  put(out, int32_t(snapshot.frame));
+  put(out, uint32_t(layouts.size()));
+  size_t t = 0;
+  for (auto& layout : layouts) {
+    auto& section = *layout.section;
+    put(out, section.name);
+    put(out, section.element_type);
+    put(out, uint64_t(section.element_size));
+    put(out, uint64_t(section.element_count));
+    put(out, uint32_t(section.ranges.ranges.size()));
+    for (auto& range : section.ranges) {
+      put(out, int32_t(range.lower));
+      put(out, int32_t(range.upper));
+    }
+    put(out, layout.mode);
+    put(out, uint8_t(layout.has_reference));
+    put(out, layout.quantum);
+    put(out, uint64_t(layout.chunk_scalars));
+    put(out, uint32_t(layout.chunk_count));
+    for (size_t c = 0; c < layout.chunk_count; c++) put(out, uint64_t(encoded[t + c].size()));
+    for (size_t c = 0; c < layout.chunk_count; c++, t++) {
+      put_bytes(out, encoded[t].data(), encoded[t].size());
+    }
+  }
+
+  if (report) {
+    report->raw_bytes = 0;
+    for (auto& section : snapshot.sections) report->raw_bytes += section.bytes;
+    report->encoded_bytes = out.size();
+    report->seconds = (tbb::tick_count::now() - timer).seconds();
+  }
+  return out;
+}
+
+FrameWriter::sink_t FrameCodec::sink(const std::string& output_dir) {
+  std::filesystem::create_directories(output_dir);
+  return [this, output_dir](const FrameSnapshot& snapshot) {
+    Report report;
+    auto bytes = encode(snapshot, &report);
+    char name[32];
+    snprintf(name, sizeof(name), "/frame_%05d.msz", snapshot.frame);
+    std::ofstream out(output_dir + name, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+    if (write_log) {
+      META_INFO("frame {}: {:.1f} MB -> {:.1f} MB, ratio {:.2f}, {:.0f} MB/s",
+                snapshot.frame,
+                report.raw_bytes / 1e6,
+                report.encoded_bytes / 1e6,
+                report.ratio(),
+                report.throughput());
+    }
+    return bool(out);
+  };
+}
+
+bool FrameDecoder::read_file(const std::string& path, std::vector<char>& bytes) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) return false;
+  bytes.resize(size_t(in.tellg()));
+  in.seekg(0);
+  return bool(in.read(bytes.data(), bytes.size()));
+}
+
+bool FrameDecoder::decode(const std::vector<char>& bytes, FrameSnapshot& snapshot) {
+  Reader in{bytes.data(), bytes.data() + bytes.size()};
+  char file_magic[sizeof(magic)];
+  uint32_t file_version, count;
+  int32_t frame;
+  if (!in.get(file_magic) || std::memcmp(file_magic, magic, sizeof(magic)) != 0 ||
+      !in.get(file_version) || file_version != version || !in.get(frame) || !in.get(count)) {
+    META_ERROR("not a compressed frame");
+    return false;
+  }
+  snapshot.frame = frame;
+  snapshot.sections.resize(count);
+  snapshot.payloads.resize(count);
+
+  for (uint32_t s = 0; s < count; s++) {
+    auto& section = snapshot.sections[s];
+    uint64_t element_size, element_count, chunk_scalars;
+    uint32_t range_count, chunk_count;
+    uint8_t mode, has_reference;
+    double quantum;
+    bool ok = in.get(section.name) && in.get(section.element_type) && in.get(element_size) &&
+              in.get(element_count) && in.get(range_count);
+    section.ranges.ranges.clear();
+    for (uint32_t r = 0; ok && r < range_count; r++) {
+      int32_t lower, upper;
+      ok = in.get(lower) && in.get(upper);
+      section.ranges.ranges.push_back({lower, upper});
+    }
+    ok = ok && in.get(mode) && in.get(has_reference) && in.get(quantum) && in.get(chunk_scalars) &&
+         in.get(chunk_count);
+    std::vector<uint64_t> chunk_bytes(ok ? chunk_count : 0);
+    for (auto& b : chunk_bytes) ok = ok && in.get(b);
+    if (!ok) {
+      META_ERROR("compressed frame {} is truncated", frame);
+      return false;
+    }
+    section.element_size = element_size;
+    section.element_count = element_count;
+    section.offset = 0;
+    section.bytes = element_size * element_count;
+
+    // the chunks must cover the section exactly, quantized sections need a usable quantum
+    size_t scalar = scalar_size(section.element_type);
+    size_t components = scalar ? element_size / scalar : 0;
+    size_t scalars = element_count * components;
+    size_t chunks = chunk_scalars ? (scalars + chunk_scalars - 1) / chunk_scalars : 0;
+    bool valid = scalar && components * scalar == element_size && mode <= quantized &&
+                 (scalars == 0 || chunk_scalars > 0) && chunk_count == chunks &&
+                 (mode == lossless || (is_float(section.element_type) && quantum > 0 &&
+                                       std::isfinite(quantum)));
+    std::vector<const char*> chunk_begin(chunk_count);
+    for (uint32_t c = 0; valid && c < chunk_count; c++) {
+      valid = size_t(in.end - in.p) >= chunk_bytes[c];
+      chunk_begin[c] = in.p;
+      if (valid) in.p += chunk_bytes[c];
+    }
+    if (!valid) {
+      META_ERROR("compressed frame {} is corrupted", frame);
+      return false;
+    }
+
+    size_t word = mode == quantized ? sizeof(int64_t) : scalar;
+    auto& reference = references_[section.name];
+    if (has_reference && (reference.element_count != element_count ||
+                          reference.words.size() != scalars * word ||
+                          reference.quantized != (mode == quantized))) {
+      META_ERROR("frame {} refers to a frame that was not decoded, start at a keyframe", frame);
+      return false;
+    }
+    reference.element_count = element_count;
+    reference.ranges = section.ranges;
+    reference.quantized = mode == quantized;
+    reference.words.resize(scalars * word);
+
+    auto& payload = snapshot.payloads[s];
+    payload.resize(section.bytes);
+    std::atomic<bool> failed{false};
+    tbb::parallel_for(uint32_t(0), chunk_count, [&](uint32_t c) {
+      size_t first = c * chunk_scalars;
+      size_t n = c + 1 == chunk_count ? scalars - first : chunk_scalars;
+      Reader chunk{chunk_begin[c], chunk_begin[c] + chunk_bytes[c]};
+      std::vector<uint8_t> planes(n * word), words(n * word);
+      if (!rle_decode(chunk, planes.data(), planes.size())) {
+        failed = true;
+        return;
+      }
+      unshuffle(planes.data(), n, word, words.data());
+      auto values = payload.data() + first * scalar;
+      if (mode == quantized) {
+        auto q = reinterpret_cast<int64_t*>(reference.words.data()) + first;
+        auto delta = reinterpret_cast<const uint64_t*>(words.data());
+        for (size_t i = 0; i < n; i++) q[i] = (has_reference ? q[i] : 0) + unzigzag(delta[i]);
+        if (scalar == 4) {
+          dequantize<float>(q, n, quantum, values);
+        } else {
+          dequantize<double>(q, n, quantum, values);
+        }
+      } else {
+        auto ref = reference.words.data() + first * word;
+        for (size_t i = 0; i < n * word; i++) {
+          values[i] = char(words[i] ^ (has_reference ? uint8_t(ref[i]) : 0));
+        }
+        std::memcpy(ref, values, n * word);
+      }
+    });
+    if (failed) {
+      META_ERROR("compressed frame {} is corrupted", frame);
+      return false;
+    }
+  }
+  return true;
+}
+
+}   // namespace MS
@@ -0,0 +1,72 @@
+#ifndef METASIM_FRAME_CODEC_HPP
+#define METASIM_FRAME_CODEC_HPP
+
+#include "Utils/frame_writer.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Compression of frame snapshots, without external dependencies
+ *
+ * Every attribute is cut into chunks of chunk_elements entries, encoded in parallel:
+ *   lossless:  scalar words XOR the previous frame, bytes shuffled by significance
+ *   quantized: float attributes named in tolerances, scalars rounded to multiples of
+ *              twice their tolerance, zigzag delta to the previous frame, shuffled
+ * and the shuffled bytes zero run-length coded. Slowly changing attributes leave
+ * long zero runs in the high bytes. Frames reference the previous one except every
+ * keyframe_interval frames and when an attribute changed layout, so a stream decodes
+ * from its last keyframe on.
+ */
+class FrameCodec {
+public:
+  // max absolute error per float attribute, e.g. {"x", 1e-3 * dx}; other attributes, and
+  // attributes too large to quantize at their tolerance, are stored lossless
+  std::unordered_map<std::string, double> tolerances;
+  int keyframe_interval{30};
+  size_t chunk_elements{size_t(1) << 16};
+  bool write_log{true};
+
+  struct Report {
+    size_t raw_bytes{0};
+    size_t encoded_bytes{0};
+    double seconds{0};
+    double ratio() const { return encoded_bytes ? double(raw_bytes) / encoded_bytes : 0; }
+    // MB/s of raw data
+    double throughput() const { return seconds > 0 ? raw_bytes / seconds / 1e6 : 0; }
+  };
+
+  // encode snapshot as a self-contained byte stream, following the previous encode()
+  std::vector<char> encode(const FrameSnapshot& snapshot, Report* report = nullptr);
+
+  // FrameWriter sink writing frame_%05d.msz files into output_dir, reports every frame
+  FrameWriter::sink_t sink(const std::string& output_dir);
+
+  // the attribute state carried from frame to frame
+  struct Reference {
+    size_t element_count{0};
+    RangeSet ranges;
+    bool quantized{false};
+    std::vector<char> words;
+  };
+
+private:
+  std::unordered_map<std::string, Reference> references_;
+  int frames_since_keyframe_{0};
+};
+
+// decoder of FrameCodec streams, frames must be passed in order starting at a keyframe
+class FrameDecoder {
+public:
+  bool decode(const std::vector<char>& bytes, FrameSnapshot& snapshot);
+  static bool read_file(const std::string& path, std::vector<char>& bytes);
+
+private:
+  std::unordered_map<std::string, FrameCodec::Reference> references_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_FRAME_CODEC_HPP
@@ -0,0 +1,143 @@
+#include "Utils/frame_writer.hpp"
+#include <cstring>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/tick_count.h>
+
+namespace MS {
+
+FrameWriter::FrameWriter(size_t depth, sink_t sink, const std::string& output_dir)
+  : sink_(std::move(sink)) {
+  if (!sink_) {
+    std::filesystem::create_directories(output_dir);
+    sink_ = [output_dir](const FrameSnapshot& snapshot) {
+      char name[32];
+      snprintf(name, sizeof(name), "/frame_%05d.bin", snapshot.frame);
+      std::vector<const void*> payloads;
+      for (auto& payload : snapshot.payloads) payloads.push_back(payload.data());
+      return ParticleFile::write(output_dir + name, snapshot.sections, payloads);
+    };
+  }
+  for (size_t i = 0; i < std::max<size_t>(depth, 1); i++) {
+    pool_.push_back(std::make_unique<FrameSnapshot>());
+    free_.push_back(pool_.back().get());
+  }
+  thread_ = std::thread([this] { run(); });
+}
+
+FrameWriter::~FrameWriter() {
+  flush();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  changed_.notify_all();
+  thread_.join();
+
+  if (write_log && statistics_.frames) {
+    META_INFO("frame writer: {} frames, {:.1f} MB, copy {:.3f}s, write {:.3f}s, {} stalls ({:.3f}s)",
+              statistics_.frames,
+              statistics_.bytes / 1e6,
+              statistics_.copy_seconds,
+              statistics_.write_seconds,
+              statistics_.stalls,
+              statistics_.stall_seconds);
+  }
+}
+
+const DataArrayBase* FrameWriter::find_array(const DataContainer& container, size_t hash) {
+  auto iter = container.dataset.find(hash);
+  META_ASSERT(iter != container.dataset.end(), "frame writer: attribute not found");
+  return iter->second.get();
+}
+
+void FrameWriter::submit(int frame, std::vector<const DataArrayBase*> arrays) {
+  std::sort(arrays.begin(), arrays.end(), [](auto a, auto b) { return a->name < b->name; });
+
+  FrameSnapshot* snapshot;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+      auto timer = tbb::tick_count::now();
+      changed_.wait(lock, [this] { return !free_.empty(); });
+      double seconds = (tbb::tick_count::now() - timer).seconds();
+      statistics_.stalls++;
+      statistics_.stall_seconds += seconds;
+      if (write_log) {
+        META_WARN("frame writer: frame {} stalled {:.3f}s, output is slower than simulation",
+                  frame,
+                  seconds);
+      }
+    }
+    snapshot = free_.front();
+    free_.pop_front();
+  }
+
+  // copy outside the lock, large arrays in parallel chunks
+  auto timer = tbb::tick_count::now();
+  snapshot->frame = frame;
+  snapshot->sections.resize(arrays.size());
+  snapshot->payloads.resize(arrays.size());
+  size_t bytes = 0;
+  for (size_t i = 0; i < arrays.size(); i++) {
+    snapshot->sections[i] = ParticleFile::describe(*arrays[i]);
+    auto& payload = snapshot->payloads[i];
+    payload.resize(arrays[i]->raw_bytes());
+    auto source = static_cast<const char*>(arrays[i]->raw_data());
+    constexpr size_t chunk = size_t(1) << 20;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, payload.size(), chunk),
+                      [&](const tbb::blocked_range<size_t>& r) {
+                        std::memcpy(payload.data() + r.begin(), source + r.begin(), r.size());
+                      });
+    bytes += payload.size();
+  }
+  double seconds = (tbb::tick_count::now() - timer).seconds();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.copy_seconds += seconds;
+    statistics_.bytes += bytes;
+    queue_.push_back(snapshot);
+  }
+  changed_.notify_all();
+}
+
+void FrameWriter::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this] { return queue_.empty() && !busy_; });
+}
+
+FrameWriter::Statistics FrameWriter::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+void FrameWriter::run() {
+  while (true) {
+    FrameSnapshot* snapshot;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this] { return done_ || !queue_.empty(); });
+      if (queue_.empty()) return;
+      snapshot = queue_.front();
+      queue_.pop_front();
+      busy_ = true;
+    }
+
+    auto timer = tbb::tick_count::now();
+    bool ok = sink_(*snapshot);
+    double seconds = (tbb::tick_count::now() - timer).seconds();
+    if (!ok) META_ERROR("frame writer: failed to write frame {}", snapshot->frame);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      statistics_.frames++;
+      statistics_.write_seconds += seconds;
+      free_.push_back(snapshot);
+      busy_ = false;
+    }
+    changed_.notify_all();
+  }
+}
+
+}   // namespace MS
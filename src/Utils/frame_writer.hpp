@@ -0,0 +1,93 @@
+#ifndef METASIM_FRAME_WRITER_HPP
+#define METASIM_FRAME_WRITER_HPP
+
+#include "Core/data_container.hpp"
+#include "Utils/particle_file.hpp"
+#include "meta.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace MS {
+
+// attributes of one frame, copied out of the simulation
+struct FrameSnapshot {
+  int frame{0};
+  std::vector<ParticleSection> sections;
+  // payloads[i] holds sections[i].bytes, capacity is kept when the snapshot is recycled
+  // and resizing does not zero
+  std::vector<std::vector<char, StagingAllocator<char>>> payloads;
+};
+
+/*
+ * Asynchronous frame output
+ *
+ * submit() copies the selected attributes into one of depth staging snapshots and
+ * returns; a background thread passes queued snapshots to the sink and recycles
+ * them. When all snapshots are in flight (the sink is slower than the simulation)
+ * submit() blocks until one is free, such stalls are counted and reported.
+ */
+class FrameWriter {
+public:
+  // returns false on failure, called on the writer thread in frame order
+  using sink_t = std::function<bool(const FrameSnapshot&)>;
+
+  struct Statistics {
+    int frames{0};
+    size_t bytes{0};
+    int stalls{0};
+    double copy_seconds{0};
+    double stall_seconds{0};
+    double write_seconds{0};
+  };
+
+  bool write_log{true};
+
+  // the default sink writes frame_%05d.bin particle files into output_dir
+  explicit FrameWriter(size_t depth = 2, sink_t sink = {},
+                       const std::string& output_dir = context.output_dir);
+  ~FrameWriter();
+
+  FrameWriter(const FrameWriter&) = delete;
+  FrameWriter& operator=(const FrameWriter&) = delete;
+
+  // queue the arrays of tags, or all arrays of container without tags
+  template<typename... Types>
+  void submit(int frame, const DataContainer& container, const TypeTag<Types>&... tags) {
+    std::vector<const DataArrayBase*> arrays;
+    if constexpr (sizeof...(Types) == 0) {
+      for (auto& [hash, array] : container.dataset) arrays.push_back(array.get());
+    } else {
+      (arrays.push_back(find_array(container, tags.type_hash)), ...);
+    }
+    submit(frame, arrays);
+  }
+
+  void submit(int frame, std::vector<const DataArrayBase*> arrays);
+
+  // block until every queued frame went through the sink
+  void flush();
+
+  Statistics statistics() const;
+
+private:
+  static const DataArrayBase* find_array(const DataContainer& container, size_t hash);
+  void run();
+
+  sink_t sink_;
+  std::vector<std::unique_ptr<FrameSnapshot>> pool_;
+  std::deque<FrameSnapshot*> free_, queue_;
+  bool busy_{false};
+  bool done_{false};
+  Statistics statistics_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  std::thread thread_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_FRAME_WRITER_HPP
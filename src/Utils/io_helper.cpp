@@ -0,0 +1,9 @@
+//
+// Created by Metal on 2021/5/14.
+//
+
+#include "Utils/io_helper.hpp"
+
+bool IOHelper::WriteParticles(const char* file_path, const MS::DataContainer& container) {
+    return MS::ParticleFile::write(file_path, container);
+}
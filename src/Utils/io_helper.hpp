@@ -5,9 +5,22 @@
 #ifndef METASIM_IO_HELPER_HPP
 #define METASIM_IO_HELPER_HPP
 
+#include "Utils/particle_file.hpp"
+
 class IOHelper {
-    static bool ReadParticles(const char* file_path);
-    static bool WriteParticles(const char* file_path);
+public:
+    // map a columnar particle file (see MS::ParticleFile) and adopt the sections of tags
+    // as the storage of their arrays in container, nothing is copied or parsed
+    template<typename... Types>
+    static bool ReadParticles(const char* file_path, MS::DataContainer& container,
+                              const MS::TypeTag<Types>&... tags) {
+        MS::ParticleFile file;
+        if (!file.open(file_path)) return false;
+        return (... && (file.load(container, tags) != nullptr));
+    }
+
+    // stream every array of container into a columnar particle file
+    static bool WriteParticles(const char* file_path, const MS::DataContainer& container);
 };
 
 #endif //METASIM_IO_HELPER_HPP
@@ -1,11 +1,43 @@
 #include "Utils/logger.hpp"
+#include "spdlog/async.h"
 
 namespace MS {
 
+namespace {
+// declared before s_logger, so it is destroyed after it and drains the queue on exit
+std::shared_ptr<spdlog::details::thread_pool> s_thread_pool;
+}   // namespace
+
 std::shared_ptr<spdlog::logger> MetaLog::s_logger;
-void MetaLog::init() {
-  s_logger = spdlog::stdout_color_mt("Sim");
+void MetaLog::init() { init(Options()); }
+
+void MetaLog::init(const Options& options) {
+  if (s_logger) {
+    s_logger->flush();
+    spdlog::drop(s_logger->name());
+  }
+  auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+  if (options.async) {
+    s_thread_pool = std::make_shared<spdlog::details::thread_pool>(options.queue_size, 1);
+    s_logger = std::make_shared<spdlog::async_logger>(
+      "Sim",
+      sink,
+      s_thread_pool,
+      options.block_on_overflow ? spdlog::async_overflow_policy::block
+                                : spdlog::async_overflow_policy::overrun_oldest);
+  } else {
+    s_logger = std::make_shared<spdlog::logger>("Sim", sink);
+  }
   s_logger->set_pattern("[%^%l%$]\t%v");
   s_logger->set_level(spdlog::level::level_enum::trace);
+  s_logger->flush_on(spdlog::level::level_enum::warn);
+  spdlog::register_logger(s_logger);
+  if (options.flush_interval_seconds > 0) {
+    spdlog::flush_every(std::chrono::seconds(options.flush_interval_seconds));
+  }
+}
+
+void MetaLog::flush() {
+  if (s_logger) s_logger->flush();
 }
-}   // namespace MS
\ No newline at end of file
+}   // namespace MS
@@ -3,13 +3,29 @@
 // #include "spdlog/fmt/ostr.h"
 // #include "spdlog/sinks/stdout_color_sinks.h"
 // #include "spdlog/spdlog.h"
+#include <atomic>
+#include <cassert>
+#include <chrono>
 
 namespace MS {
 
 // define logger
 class MetaLog {
 public:
+  struct Options {
+    // messages go through a bounded queue to a background thread
+    bool async{true};
+    size_t queue_size{8192};
+    // a full queue blocks the caller, otherwise the oldest message is dropped
+    bool block_on_overflow{true};
+    // warnings and errors are flushed right away, the rest periodically
+    int flush_interval_seconds{1};
+  };
+
+  // (re)create the logger, init() with default options runs on first use
   static void init();
+  static void init(const Options& options);
+  static void flush();
   MetaLog() = default;
   virtual ~MetaLog() = default;
 
@@ -22,33 +38,128 @@ private:
   static std::shared_ptr<spdlog::logger> s_logger;
 };
 
+/*
+ * Per call site limiter for messages that may fire for every particle (NaN checks),
+ * lets one message through per interval and counts the ones it swallowed.
+ */
+class LogRateLimiter {
+public:
+  explicit LogRateLimiter(std::chrono::milliseconds interval)
+    : interval_(std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count()) {}
+
+  // on true, suppressed holds the number of messages dropped since the last one
+  bool allow(uint64_t& suppressed) {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count();
+    int64_t next = next_.load(std::memory_order_relaxed);
+    if (now < next || !next_.compare_exchange_strong(next, now + interval_)) {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+
+private:
+  int64_t interval_;
+  std::atomic<int64_t> next_{0};
+  std::atomic<uint64_t> suppressed_{0};
+};
+
 }   // namespace MS
 
-#ifndef META_NO_DEBUG
+// compile-time minimum level, calls below it expand to nothing and their arguments
+// are not evaluated. defaults to info in release builds, trace otherwise
+#define META_LEVEL_TRACE 0
+#define META_LEVEL_DEBUG 1
+#define META_LEVEL_INFO 2
+#define META_LEVEL_WARN 3
+#define META_LEVEL_ERROR 4
+#define META_LEVEL_FATAL 5
+#define META_LEVEL_OFF 6
+
+#ifndef META_LOG_LEVEL
+#  if defined(META_NO_DEBUG)
+#    define META_LOG_LEVEL META_LEVEL_OFF
+#  elif defined(NDEBUG)
+#    define META_LOG_LEVEL META_LEVEL_INFO
+#  else
+#    define META_LOG_LEVEL META_LEVEL_TRACE
+#  endif
+#endif
 
 // Client log macros
-#  define META_FATAL(...) ::MS::MetaLog::get_logger()->fatal(__VA_ARGS__)
-#  define META_ERROR(...) ::MS::MetaLog::get_logger()->error(__VA_ARGS__)
-#  define META_WARN(...) ::MS::MetaLog::get_logger()->warn(__VA_ARGS__)
-#  define META_INFO(...) ::MS::MetaLog::get_logger()->info(__VA_ARGS__)
-#  define META_TRACE(...) ::MS::MetaLog::get_logger()->trace(__VA_ARGS__)
+#if META_LOG_LEVEL <= META_LEVEL_FATAL
+#  define META_FATAL(...) ::MS::MetaLog::get_logger()->critical(__VA_ARGS__)
+#else
+#  define META_FATAL(...) (void)0
+#endif
 
+#if META_LOG_LEVEL <= META_LEVEL_ERROR
+#  define META_ERROR(...) ::MS::MetaLog::get_logger()->error(__VA_ARGS__)
 #  define META_ASSERT(condition, ...) \
     do {                              \
       if (!(condition)) {             \
         META_ERROR(__VA_ARGS__);      \
+        ::MS::MetaLog::flush();       \
         assert(condition);            \
       }                               \
     } while (false)
+#else
+#  define META_ERROR(...) (void)0
+#  define META_ASSERT(condition, ...) (void)0
+#endif
 
+#if META_LOG_LEVEL <= META_LEVEL_WARN
+#  define META_WARN(...) ::MS::MetaLog::get_logger()->warn(__VA_ARGS__)
+#else
+#  define META_WARN(...) (void)0
+#endif
+
+#if META_LOG_LEVEL <= META_LEVEL_INFO
+#  define META_INFO(...) ::MS::MetaLog::get_logger()->info(__VA_ARGS__)
 #else
+#  define META_INFO(...) (void)0
+#endif
+
+#if META_LOG_LEVEL <= META_LEVEL_DEBUG
+#  define META_DEBUG(...) ::MS::MetaLog::get_logger()->debug(__VA_ARGS__)
+#else
+#  define META_DEBUG(...) (void)0
+#endif
+
+#if META_LOG_LEVEL <= META_LEVEL_TRACE
+#  define META_TRACE(...) ::MS::MetaLog::get_logger()->trace(__VA_ARGS__)
+#else
+#  define META_TRACE(...) (void)0
+#endif
+
+// rate limited logging, one counter / limiter per call site and safe in parallel loops
+// META_LOG_EVERY_N(META_WARN, 1000, "nan at particle {}", p);
+#define META_LOG_EVERY_N(LOG, n, ...)                                                      \
+  do {                                                                                     \
+    static std::atomic<uint64_t> meta_log_count_{0};                                       \
+    if (meta_log_count_.fetch_add(1, std::memory_order_relaxed) % (n) == 0) LOG(__VA_ARGS__); \
+  } while (false)
 
-#  define META_FATAL(...)
-#  define META_ERROR(...)
-#  define META_WARN(...)
-#  define META_INFO(...)
-#  define META_TRACE(...)
+#define META_LOG_ONCE(LOG, ...)                                              \
+  do {                                                                       \
+    static std::atomic<bool> meta_log_done_{false};                          \
+    if (!meta_log_done_.exchange(true, std::memory_order_relaxed)) LOG(__VA_ARGS__); \
+  } while (false)
 
-#  define META_ASSERT(condition, ...)
+// at most one message per interval_ms, followed by how many were suppressed before it
+#define META_LOG_THROTTLED(LOG, interval_ms, ...)                                   \
+  do {                                                                              \
+    static ::MS::LogRateLimiter meta_log_limiter_{std::chrono::milliseconds(interval_ms)}; \
+    uint64_t meta_log_suppressed_;                                                  \
+    if (meta_log_limiter_.allow(meta_log_suppressed_)) {                            \
+      LOG(__VA_ARGS__);                                                             \
+      if (meta_log_suppressed_) LOG("({} similar messages suppressed)", meta_log_suppressed_); \
+    }                                                                               \
+  } while (false)
 
-#endif
\ No newline at end of file
+#define META_WARN_ONCE(...) META_LOG_ONCE(META_WARN, __VA_ARGS__)
+#define META_WARN_EVERY_N(n, ...) META_LOG_EVERY_N(META_WARN, n, __VA_ARGS__)
+#define META_WARN_THROTTLED(interval_ms, ...) META_LOG_THROTTLED(META_WARN, interval_ms, __VA_ARGS__)
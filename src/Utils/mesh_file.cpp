@@ -0,0 +1,138 @@
+#include "Utils/mesh_file.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+namespace MS {
+
+namespace {
+
+constexpr char magic[8] = {'M', 'S', 'M', 'E', 'S', 'H', '\0', '\0'};
+
+template<typename POD>
+void put(std::ostream& out, const POD& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(POD));
+}
+
+template<typename POD>
+bool get(std::istream& in, POD& value) {
+  return bool(in.read(reinterpret_cast<char*>(&value), sizeof(POD)));
+}
+
+}   // namespace
+
+bool MeshFile::write(std::ostream& out, const SurfaceMesh& mesh, bool quantize) {
+  std::array<float, 3> lower, upper;
+  lower.fill(mesh.vertices.empty() ? 0 : std::numeric_limits<float>::max());
+  upper.fill(mesh.vertices.empty() ? 0 : std::numeric_limits<float>::lowest());
+  for (auto& vertex : mesh.vertices) {
+    for (int d = 0; d < 3; d++) {
+      lower[d] = std::min(lower[d], vertex[d]);
+      upper[d] = std::max(upper[d], vertex[d]);
+    }
+  }
+
+  out.write(magic, sizeof(magic));
+  put(out, version);
+  put(out, int32_t(mesh.frame));
+  put(out, uint32_t(quantize ? quantized : 0));
+  put(out, uint64_t(mesh.vertices.size()));
+  put(out, uint64_t(mesh.triangles.size()));
+  put(out, lower);
+  put(out, upper);
+  if (quantize) {
+    std::array<float, 3> scale;
+    for (int d = 0; d < 3; d++) {
+      scale[d] = upper[d] > lower[d] ? 65535 / (upper[d] - lower[d]) : 0;
+    }
+    std::vector<std::array<uint16_t, 3>> packed(mesh.vertices.size());
+    for (size_t v = 0; v < packed.size(); v++) {
+      for (int d = 0; d < 3; d++) {
+        packed[v][d] = uint16_t(std::lround((mesh.vertices[v][d] - lower[d]) * scale[d]));
+      }
+    }
+    out.write(reinterpret_cast<const char*>(packed.data()), packed.size() * sizeof(packed[0]));
+  } else {
+    out.write(reinterpret_cast<const char*>(mesh.vertices.data()),
+              mesh.vertices.size() * sizeof(mesh.vertices[0]));
+  }
+  out.write(reinterpret_cast<const char*>(mesh.triangles.data()),
+            mesh.triangles.size() * sizeof(mesh.triangles[0]));
+  return bool(out);
+}
+
+bool MeshFile::write(const std::string& path, const SurfaceMesh& mesh, bool quantize) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    META_ERROR("cannot open {} for writing", path);
+    return false;
+  }
+  if (!write(out, mesh, quantize)) {
+    META_ERROR("failed writing {}", path);
+    return false;
+  }
+  return true;
+}
+
+bool MeshFile::write_frame(const std::string& output_dir, const SurfaceMesh& mesh,
+                           bool quantize) {
+  std::filesystem::create_directories(output_dir);
+  char name[32];
+  snprintf(name, sizeof(name), "/mesh_%05d.msm", mesh.frame);
+  return write(output_dir + name, mesh, quantize);
+}
+
+bool MeshFile::read(std::istream& in, SurfaceMesh& mesh) {
+  char file_magic[sizeof(magic)];
+  uint32_t file_version, flags;
+  int32_t frame;
+  uint64_t vertex_count, triangle_count;
+  std::array<float, 3> lower, upper;
+  if (!in.read(file_magic, sizeof(file_magic))) return false;
+  if (std::memcmp(file_magic, magic, sizeof(magic)) != 0 || !get(in, file_version) ||
+      file_version != version || !get(in, frame) || !get(in, flags) || !get(in, vertex_count) ||
+      !get(in, triangle_count) || !get(in, lower) || !get(in, upper)) {
+    META_ERROR("not a mesh frame");
+    return false;
+  }
+  mesh.frame = frame;
+  mesh.vertices.resize(vertex_count);
+  mesh.triangles.resize(triangle_count);
+  if (flags & quantized) {
+    std::vector<std::array<uint16_t, 3>> packed(vertex_count);
+    if (!in.read(reinterpret_cast<char*>(packed.data()), packed.size() * sizeof(packed[0]))) {
+      META_ERROR("mesh frame {} is truncated", frame);
+      return false;
+    }
+    for (size_t v = 0; v < packed.size(); v++) {
+      for (int d = 0; d < 3; d++) {
+        mesh.vertices[v][d] = lower[d] + packed[v][d] * ((upper[d] - lower[d]) / 65535);
+      }
+    }
+  } else if (!in.read(reinterpret_cast<char*>(mesh.vertices.data()),
+                      mesh.vertices.size() * sizeof(mesh.vertices[0]))) {
+    META_ERROR("mesh frame {} is truncated", frame);
+    return false;
+  }
+  if (!in.read(reinterpret_cast<char*>(mesh.triangles.data()),
+               mesh.triangles.size() * sizeof(mesh.triangles[0]))) {
+    META_ERROR("mesh frame {} is truncated", frame);
+    return false;
+  }
+  return true;
+}
+
+bool MeshFile::read(const std::string& path, SurfaceMesh& mesh) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    META_ERROR("cannot open {}", path);
+    return false;
+  }
+  return read(in, mesh);
+}
+
+}   // namespace MS
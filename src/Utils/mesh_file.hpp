@@ -0,0 +1,51 @@
+#ifndef METASIM_MESH_FILE_HPP
+#define METASIM_MESH_FILE_HPP
+
+#include "Utils/logger.hpp"
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace MS {
+
+// indexed triangle mesh of one frame, triangles counterclockwise seen from outside
+struct SurfaceMesh {
+  int frame{0};
+  std::vector<std::array<float, 3>> vertices;
+  std::vector<std::array<uint32_t, 3>> triangles;
+};
+
+/*
+ * Binary mesh frames
+ *
+ *   magic "MSMESH\0\0", u32 version, i32 frame, u32 flags, u64 vertex count,
+ *   u64 triangle count, f32 lower[3], f32 upper[3]
+ *   vertices as f32 x3, or with flags & quantized as u16 x3 over [lower, upper]
+ *   triangles as u32 x3
+ *   (everything little endian)
+ *
+ * A frame is self-contained, frames written one after another into a stream are read
+ * back in order, so a sequence goes into one file as well as into one file per frame.
+ * Quantized vertices take 6 instead of 12 bytes, off by at most (upper - lower) / 131070.
+ */
+class MeshFile {
+public:
+  constexpr static uint32_t version = 1;
+  constexpr static uint32_t quantized = 1;
+
+  static bool write(std::ostream& out, const SurfaceMesh& mesh, bool quantize = false);
+  static bool write(const std::string& path, const SurfaceMesh& mesh, bool quantize = false);
+  // output_dir/mesh_%05d.msm of mesh.frame
+  static bool write_frame(const std::string& output_dir, const SurfaceMesh& mesh,
+                          bool quantize = false);
+
+  // next frame of in, false at the end of the stream or on a malformed frame
+  static bool read(std::istream& in, SurfaceMesh& mesh);
+  static bool read(const std::string& path, SurfaceMesh& mesh);
+};
+
+}   // namespace MS
+
+#endif   // METASIM_MESH_FILE_HPP
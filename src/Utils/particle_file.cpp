@@ -0,0 +1,266 @@
+#include "Utils/particle_file.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace MS {
+
+namespace {
+
+constexpr char magic[8] = {'M', 'S', 'P', 'A', 'R', 'T', 'S', '\0'};
+
+size_t align_up(size_t x, size_t alignment) { return (x + alignment - 1) / alignment * alignment; }
+
+class HeaderWriter {
+public:
+  template<typename POD>
+  void put(const POD& value) {
+    auto p = reinterpret_cast<const char*>(&value);
+    bytes.insert(bytes.end(), p, p + sizeof(POD));
+  }
+  void put(const std::string& s) {
+    put(uint32_t(s.size()));
+    bytes.insert(bytes.end(), s.begin(), s.end());
+  }
+  std::vector<char> bytes;
+};
+
+class HeaderReader {
+public:
+  HeaderReader(const char* begin, const char* end)
+    : p(begin)
+    , end(end) {}
+
+  template<typename POD>
+  bool get(POD& value) {
+    if (size_t(end - p) < sizeof(POD)) return false;
+    std::memcpy(&value, p, sizeof(POD));
+    p += sizeof(POD);
+    return true;
+  }
+  bool get(std::string& s) {
+    uint32_t length;
+    if (!get(length) || size_t(end - p) < length) return false;
+    s.assign(p, length);
+    p += length;
+    return true;
+  }
+
+private:
+  const char* p;
+  const char* end;
+};
+
+void serialize(HeaderWriter& out, const std::vector<ParticleSection>& sections) {
+  out.put(magic);
+  out.put(ParticleFile::version);
+  out.put(uint32_t(sections.size()));
+  out.put(uint64_t(0));   // header bytes, patched by the caller
+  for (auto& section : sections) {
+    out.put(section.name);
+    out.put(section.element_type);
+    out.put(uint64_t(section.element_size));
+    out.put(uint64_t(section.element_count));
+    out.put(uint32_t(section.ranges.ranges.size()));
+    for (auto& range : section.ranges) {
+      out.put(int32_t(range.lower));
+      out.put(int32_t(range.upper));
+    }
+    out.put(uint64_t(section.offset));
+    out.put(uint64_t(section.bytes));
+  }
+}
+
+}   // namespace
+
+struct ParticleFile::Mapping {
+  char* data{nullptr};
+  size_t bytes{0};
+  ~Mapping() {
+    if (data) munmap(data, bytes);
+  }
+};
+
+// hands out the mapped section once, for the DataArray adopting it; later growth goes to the heap
+class MappedSectionResource : public MemoryResource {
+public:
+  MappedSectionResource(std::shared_ptr<const void> mapping, void* data, size_t bytes)
+    : mapping_(std::move(mapping))
+    , data_(data)
+    , bytes_(bytes) {}
+
+  void* allocate(size_t bytes, size_t alignment) override {
+    if (!handed_out_ && bytes <= bytes_) {
+      handed_out_ = true;
+      return data_;
+    }
+    return ::operator new(bytes, std::align_val_t(alignment));
+  }
+
+  void deallocate(void* p, size_t, size_t alignment) override {
+    if (p == data_) {
+      handed_out_ = false;
+    } else {
+      ::operator delete(p, std::align_val_t(alignment));
+    }
+  }
+
+  // the section is adopted with its values, storage grown later is initialized
+  std::pair<const void*, size_t> held_values() const override { return {data_, bytes_}; }
+
+private:
+  std::shared_ptr<const void> mapping_;
+  void* data_;
+  size_t bytes_;
+  bool handed_out_{false};
+};
+
+ParticleSection ParticleFile::describe(const DataArrayBase& array) {
+  ParticleSection section;
+  section.name = array.name;
+  section.element_type = array.element_type();
+  section.element_size = array.element_size();
+  section.element_count = array.element_count();
+  section.ranges = array.ranges;
+  section.bytes = array.raw_bytes();
+  return section;
+}
+
+bool ParticleFile::write(const std::string& path, const DataContainer& container) {
+  std::vector<const DataArrayBase*> arrays;
+  for (auto& [hash, array] : container.dataset) arrays.push_back(array.get());
+  std::sort(arrays.begin(), arrays.end(), [](auto a, auto b) { return a->name < b->name; });
+
+  std::vector<ParticleSection> sections;
+  std::vector<const void*> payloads;
+  for (auto array : arrays) {
+    sections.push_back(describe(*array));
+    payloads.push_back(array->raw_data());
+  }
+  return write(path, std::move(sections), payloads);
+}
+
+bool ParticleFile::write(const std::string& path, std::vector<ParticleSection> sections,
+                         const std::vector<const void*>& payloads) {
+  // offsets do not change the header size, so lay out once with zeros and again for real
+  HeaderWriter header;
+  serialize(header, sections);
+  size_t offset = align_up(header.bytes.size(), page_size);
+  for (auto& section : sections) {
+    section.offset = offset;
+    offset = align_up(offset + section.bytes, page_size);
+  }
+  header = HeaderWriter();
+  serialize(header, sections);
+  uint64_t header_bytes = header.bytes.size();
+  std::memcpy(header.bytes.data() + sizeof(magic) + 2 * sizeof(uint32_t),
+              &header_bytes,
+              sizeof(header_bytes));
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    META_ERROR("cannot open {} for writing", path);
+    return false;
+  }
+  out.write(header.bytes.data(), header.bytes.size());
+  size_t written = header.bytes.size();
+  const std::vector<char> zeros(page_size, 0);
+  for (size_t i = 0; i < sections.size(); i++) {
+    out.write(zeros.data(), sections[i].offset - written);
+    out.write(static_cast<const char*>(payloads[i]), sections[i].bytes);
+    written = sections[i].offset + sections[i].bytes;
+  }
+  // pad the last section, so every section can be mapped as whole pages
+  out.write(zeros.data(), align_up(written, page_size) - written);
+  if (!out) {
+    META_ERROR("failed writing {}", path);
+    return false;
+  }
+  return true;
+}
+
+bool ParticleFile::open(const std::string& path) {
+  mapping_.reset();
+  sections_.clear();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    META_ERROR("cannot open {}", path);
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    META_ERROR("cannot stat {} or it is empty", path);
+    ::close(fd);
+    return false;
+  }
+  auto mapping = std::make_shared<Mapping>();
+  mapping->bytes = size_t(info.st_size);
+  void* data = mmap(nullptr, mapping->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    META_ERROR("cannot map {}", path);
+    return false;
+  }
+  mapping->data = static_cast<char*>(data);
+
+  HeaderReader in(mapping->data, mapping->data + mapping->bytes);
+  char file_magic[sizeof(magic)];
+  uint32_t file_version, count;
+  uint64_t header_bytes;
+  if (!in.get(file_magic) || std::memcmp(file_magic, magic, sizeof(magic)) != 0 ||
+      !in.get(file_version) || !in.get(count) || !in.get(header_bytes)) {
+    META_ERROR("{} is not a particle file", path);
+    return false;
+  }
+  if (file_version != version) {
+    META_ERROR("{} has version {}, expected {}", path, file_version, version);
+    return false;
+  }
+
+  std::vector<ParticleSection> sections(count);
+  for (auto& section : sections) {
+    uint64_t element_size, element_count, offset, bytes;
+    uint32_t range_count;
+    bool ok = in.get(section.name) && in.get(section.element_type) && in.get(element_size) &&
+              in.get(element_count) && in.get(range_count);
+    for (uint32_t r = 0; ok && r < range_count; r++) {
+      int32_t lower, upper;
+      ok = in.get(lower) && in.get(upper);
+      section.ranges.ranges.push_back({lower, upper});
+    }
+    ok = ok && in.get(offset) && in.get(bytes);
+    if (!ok || offset % page_size != 0 || offset + bytes > mapping->bytes ||
+        bytes != element_size * element_count) {
+      META_ERROR("{} has a corrupted header", path);
+      return false;
+    }
+    section.element_size = element_size;
+    section.element_count = element_count;
+    section.offset = offset;
+    section.bytes = bytes;
+  }
+
+  mapping_ = std::move(mapping);
+  sections_ = std::move(sections);
+  return true;
+}
+
+const ParticleSection* ParticleFile::find(const std::string& name) const {
+  for (auto& section : sections_) {
+    if (section.name == name) return &section;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<MemoryResource> ParticleFile::section_resource(
+  const ParticleSection& section) const {
+  return std::make_shared<MappedSectionResource>(
+    mapping_, mapping_->data + section.offset, section.bytes);
+}
+
+}   // namespace MS
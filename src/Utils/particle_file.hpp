@@ -0,0 +1,91 @@
+#ifndef METASIM_PARTICLE_FILE_HPP
+#define METASIM_PARTICLE_FILE_HPP
+
+#include "Core/data_container.hpp"
+#include "Utils/logger.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace MS {
+
+/*
+ * Columnar binary particle file
+ *
+ *   magic "MSPARTS\0", u32 version, u32 section count, u64 header bytes
+ *   per section: name, element type, u64 element size, u64 element count,
+ *                u32 range count, ranges as i32 pairs, u64 offset, u64 bytes
+ *   (strings are u32 length + bytes, everything little endian)
+ *   section payloads, each starting on a page_size boundary
+ *
+ * A payload is the raw DataArray storage, so writing streams each array as is and
+ * reading maps the file and hands the sections to DataArrays without copying.
+ * The mapping is private: arrays may be modified in memory, the file stays untouched,
+ * and arrays that grow move to the heap.
+ */
+struct ParticleSection {
+  std::string name;
+  std::string element_type;
+  size_t element_size{0};
+  size_t element_count{0};
+  RangeSet ranges;
+  size_t offset{0};
+  size_t bytes{0};
+};
+
+class ParticleFile {
+public:
+  constexpr static uint32_t version = 1;
+  constexpr static size_t page_size = 4096;
+
+  // write every array of container, sections sorted by name
+  static bool write(const std::string& path, const DataContainer& container);
+
+  // write sections with payloads[i] holding sections[i].bytes, offsets are assigned here
+  static bool write(const std::string& path, std::vector<ParticleSection> sections,
+                    const std::vector<const void*>& payloads);
+
+  // section layout of an array, without offset
+  static ParticleSection describe(const DataArrayBase& array);
+
+  // map path and read its header, payloads are paged in on first access
+  bool open(const std::string& path);
+
+  const std::vector<ParticleSection>& sections() const { return sections_; }
+  const ParticleSection* find(const std::string& name) const;
+
+  /*
+   * put the section named attr_tag.type_name into container as DataArray storage
+   * returns nullptr if the section is missing or its element type differs from Type
+   */
+  template<typename Type>
+  DataArray<Type>* load(DataContainer& container, const TypeTag<Type>& attr_tag) const {
+    auto section = find(attr_tag.type_name);
+    if (!section) {
+      META_ERROR("particle file has no attribute '{}'", attr_tag.type_name);
+      return nullptr;
+    }
+    if (section->element_type != ElementType<Type>::name() ||
+        section->element_size != sizeof(Type)) {
+      META_ERROR("attribute '{}' is stored as {}, requested {}",
+                 section->name,
+                 section->element_type,
+                 ElementType<Type>::name());
+      return nullptr;
+    }
+    auto array = std::make_unique<DataArray<Type>>(
+      section->name, section->ranges, section_resource(*section), section->element_count);
+    return &container.insert(attr_tag, std::move(array));
+  }
+
+private:
+  struct Mapping;
+  std::shared_ptr<MemoryResource> section_resource(const ParticleSection& section) const;
+
+  std::shared_ptr<Mapping> mapping_;
+  std::vector<ParticleSection> sections_;
+};
+
+}   // namespace MS
+
+#endif   // METASIM_PARTICLE_FILE_HPP
@@ -0,0 +1,198 @@
+#include "Utils/perf_counters.hpp"
+#include "Utils/logger.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <sys/syscall.h>
+#include <tbb/task_scheduler_observer.h>
+#include <unistd.h>
+#include <vector>
+
+namespace MS {
+
+std::atomic<bool> PerfCounters::enabled_{false};
+
+namespace {
+
+struct CounterConfig {
+  uint32_t type;
+  uint64_t config;
+};
+
+// cycles, instructions, LLC misses, branch misses
+const CounterConfig configs[PerfCounters::counter_count] = {
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+struct ThreadCounters {
+  std::array<int, PerfCounters::counter_count> fds;
+};
+
+std::mutex counters_mutex;
+std::vector<ThreadCounters> threads;
+// bumped by disable(), threads open their counters again after the next enable()
+unsigned generation{0};
+std::array<bool, PerfCounters::counter_count> opened{};
+std::chrono::steady_clock::time_point start_time;
+
+std::mutex phases_mutex;
+std::vector<std::pair<const char*, PerfCounters::Values>> phases;
+
+int open_counter(const CounterConfig& config) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = config.type;
+  attr.config = config.config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // this thread on any cpu
+  return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+void close_counters(const ThreadCounters& counters) {
+  for (int fd : counters.fds) {
+    if (fd >= 0) ::close(fd);
+  }
+}
+
+void open_thread() {
+  thread_local unsigned opened_generation = ~0u;
+  unsigned current;
+  {
+    std::lock_guard<std::mutex> lock(counters_mutex);
+    current = generation;
+  }
+  if (!PerfCounters::enabled() || opened_generation == current) return;
+  ThreadCounters counters;
+  for (int c = 0; c < PerfCounters::counter_count; c++) counters.fds[c] = open_counter(configs[c]);
+
+  std::lock_guard<std::mutex> lock(counters_mutex);
+  // disabled while opening, the counters belong to no generation
+  if (!PerfCounters::enabled() || generation != current) {
+    close_counters(counters);
+    return;
+  }
+  opened_generation = current;
+  for (int c = 0; c < PerfCounters::counter_count; c++) {
+    opened[c] = opened[c] || counters.fds[c] >= 0;
+  }
+  threads.push_back(counters);
+}
+
+// value * time enabled / time running, 0 when the counter never ran
+bool read_scaled(int fd, uint64_t& count) {
+  uint64_t data[3];
+  if (::read(fd, data, sizeof(data)) != sizeof(data)) return false;
+  count = data[2] > 0 ? uint64_t(double(data[0]) * double(data[1]) / double(data[2])) : 0;
+  return true;
+}
+
+class WorkerObserver : public tbb::task_scheduler_observer {
+public:
+  WorkerObserver() { observe(true); }
+  void on_scheduler_entry(bool) override { open_thread(); }
+};
+
+}   // namespace
+
+bool PerfCounters::enable() {
+  static WorkerObserver observer;
+  static bool registered = false;
+  if (!registered) {
+    registered = true;
+    std::atexit(disable);
+  }
+  if (!enabled_) start_time = std::chrono::steady_clock::now();
+  enabled_ = true;
+  open_thread();
+
+  bool any = false;
+  for (int c = 0; c < counter_count; c++) any = any || available(Counter(c));
+  if (!any) META_WARN("perf counters unavailable (see perf_event_paranoid), phases are timed only");
+  return any;
+}
+
+void PerfCounters::disable() {
+  std::lock_guard<std::mutex> lock(counters_mutex);
+  enabled_ = false;
+  for (auto& thread : threads) close_counters(thread);
+  threads.clear();
+  opened = {};
+  generation++;
+}
+
+bool PerfCounters::available(Counter counter) {
+  std::lock_guard<std::mutex> lock(counters_mutex);
+  return opened[counter];
+}
+
+PerfCounters::Values PerfCounters::read() {
+  Values values;
+  values.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  std::lock_guard<std::mutex> lock(counters_mutex);
+  for (auto& thread : threads) {
+    for (int c = 0; c < counter_count; c++) {
+      uint64_t count;
+      if (thread.fds[c] >= 0 && read_scaled(thread.fds[c], count)) {
+        values.counts[c] += count;
+      }
+    }
+  }
+  return values;
+}
+
+void PerfCounters::add_phase(const char* name, const Values& delta) {
+  std::lock_guard<std::mutex> lock(phases_mutex);
+  for (auto& [phase, values] : phases) {
+    if (std::strcmp(phase, name) == 0) {
+      values += delta;
+      return;
+    }
+  }
+  phases.push_back({name, delta});
+}
+
+void PerfCounters::report_frame(int frame, size_t items) {
+  std::lock_guard<std::mutex> lock(phases_mutex);
+  if (phases.empty()) return;
+  auto counter = [](const Values& values, Counter c) {
+    return available(c) ? fmt::format("{:.3g}", double(values.counts[c])) : std::string("n/a");
+  };
+  auto ratio = [](const Values& values, Counter a, Counter b, double scale, size_t n) {
+    if (!available(a) || (b != counter_count && !available(b)) || n == 0) return std::string("n/a");
+    double denominator = b == counter_count ? double(n) : double(values.counts[b]);
+    return denominator > 0 ? fmt::format("{:.3g}", values.counts[a] * scale / denominator)
+                           : std::string("n/a");
+  };
+
+  META_INFO("frame {} phases{}", frame, items ? fmt::format(", {} items", items) : "");
+  META_INFO("{:<20}{:>10}{:>10}{:>8}{:>12}{:>12}{:>12}{:>14}",
+            "phase",
+            "ms",
+            "cycles",
+            "IPC",
+            "LLC miss",
+            "miss/item",
+            "bytes/item",
+            "br miss/item");
+  for (auto& [name, values] : phases) {
+    META_INFO("{:<20}{:>10.3f}{:>10}{:>8}{:>12}{:>12}{:>12}{:>14}",
+              name,
+              values.seconds * 1e3,
+              counter(values, cycles),
+              ratio(values, instructions, cycles, 1, 1),
+              counter(values, llc_misses),
+              ratio(values, llc_misses, counter_count, 1, items),
+              ratio(values, llc_misses, counter_count, 64, items),
+              ratio(values, branch_misses, counter_count, 1, items));
+  }
+  phases.clear();
+}
+
+}   // namespace MS
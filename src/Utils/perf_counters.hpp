@@ -0,0 +1,102 @@
+#ifndef METASIM_PERF_COUNTERS_HPP
+#define METASIM_PERF_COUNTERS_HPP
+
+#include "Utils/profiler.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace MS {
+
+/*
+ * Hardware counters per simulation phase (Linux perf_event_open)
+ *
+ * enable() opens cycles, instructions, LLC misses and branch misses for the calling
+ * thread and, through a task scheduler observer, for every TBB worker that joins.
+ * A PerfPhase reads the sum over all threads when it opens and closes, so phases are
+ * meant for the simulation thread, around parallel loops (p2g, grid update, g2p).
+ * Counters the kernel refuses (perf_event_paranoid, containers, VMs) read as missing
+ * and phases keep their wall time. Counts are scaled by time enabled / time running,
+ * so counters multiplexed by the kernel estimate the full phase.
+ * disable() closes the counters of all threads, it also runs at exit.
+ */
+class PerfCounters {
+public:
+  enum Counter { cycles = 0, instructions, llc_misses, branch_misses, counter_count };
+
+  struct Values {
+    std::array<uint64_t, counter_count> counts{};
+    double seconds{0};
+
+    // scaled counts are estimates, a delta never goes below zero
+    Values operator-(const Values& rhs) const {
+      Values result;
+      for (int c = 0; c < counter_count; c++) {
+        result.counts[c] = counts[c] > rhs.counts[c] ? counts[c] - rhs.counts[c] : 0;
+      }
+      result.seconds = seconds - rhs.seconds;
+      return result;
+    }
+    Values& operator+=(const Values& rhs) {
+      for (int c = 0; c < counter_count; c++) counts[c] += rhs.counts[c];
+      seconds += rhs.seconds;
+      return *this;
+    }
+  };
+
+  // returns whether any hardware counter could be opened, phases are timed either way
+  static bool enable();
+  static void disable();
+  static bool enabled() { return enabled_; }
+  static bool available(Counter counter);
+
+  // sum of all threads, and wall time since enable()
+  static Values read();
+
+  static void add_phase(const char* name, const Values& delta);
+
+  /*
+   * log every phase of the frame and reset them
+   * items (e.g. particles) > 0 adds misses and DRAM bytes (LLC misses * 64) per item
+   */
+  static void report_frame(int frame, size_t items);
+
+private:
+  static std::atomic<bool> enabled_;
+};
+
+class PerfPhase {
+public:
+  explicit PerfPhase(const char* name)
+    : name_(name) {
+    if (PerfCounters::enabled()) begin_ = PerfCounters::read();
+  }
+  ~PerfPhase() {
+    if (PerfCounters::enabled()) PerfCounters::add_phase(name_, PerfCounters::read() - begin_);
+  }
+
+  PerfPhase(const PerfPhase&) = delete;
+  PerfPhase& operator=(const PerfPhase&) = delete;
+
+private:
+  const char* name_;
+  PerfCounters::Values begin_;
+};
+
+}   // namespace MS
+
+#ifndef META_NO_PROFILE
+
+// profiler zone plus hardware counters of a step phase
+#  define META_PROFILE_PHASE(name) \
+    META_PROFILE_SCOPE(name);      \
+    ::MS::PerfPhase META_PROFILE_CONCAT(meta_perf_phase_, __LINE__)(name)
+
+#else
+
+#  define META_PROFILE_PHASE(name)
+
+#endif
+
+#endif   // METASIM_PERF_COUNTERS_HPP
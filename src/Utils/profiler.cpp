@@ -0,0 +1,224 @@
+#include "Utils/profiler.hpp"
+#include "Utils/logger.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace MS {
+
+std::atomic<bool> Profiler::enabled_{false};
+
+namespace {
+
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<Profiler::ThreadBuffer>> registry;
+
+uint64_t steady_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+// reference point for converting ticks to nanoseconds, taken at startup
+const uint64_t start_ticks = Profiler::now();
+const uint64_t start_ns = steady_ns();
+
+double ns_per_tick() {
+#if defined(__x86_64__) || defined(_M_X64)
+  // the longer since startup the better the estimate, wait for at least 10 ms
+  while (steady_ns() - start_ns < 10000000) std::this_thread::yield();
+  return double(steady_ns() - start_ns) / double(Profiler::now() - start_ticks);
+#else
+  return 1.0;
+#endif
+}
+
+// the process wide trace file of export_chrome_trace
+std::mutex trace_mutex;
+FILE* trace_file{nullptr};
+size_t trace_events{0};
+
+void close_trace() {
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  std::fprintf(trace_file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+  std::fclose(trace_file);
+  trace_file = nullptr;
+}
+
+std::string json_escape(const char* s) {
+  std::string escaped;
+  for (; *s; s++) {
+    auto c = static_cast<unsigned char>(*s);
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += char(c);
+    } else if (c < 0x20) {
+      char code[8];
+      std::snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+    } else {
+      escaped += char(c);
+    }
+  }
+  return escaped;
+}
+
+struct ZoneNode {
+  const char* name;
+  int parent, depth;
+  std::vector<uint64_t> durations;
+  std::vector<int> children;
+};
+
+// events of every thread, sorted so parents come before their children
+std::vector<std::vector<Profiler::Event>> collect_events() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  std::vector<std::vector<Profiler::Event>> threads;
+  for (auto& buffer : registry) {
+    std::vector<Profiler::Event> events;
+    for (size_t c = 0; c < buffer->chunks.size(); c++) {
+      size_t n = c + 1 == buffer->chunks.size() ? buffer->used : Profiler::chunk_size;
+      events.insert(events.end(), buffer->chunks[c].get(), buffer->chunks[c].get() + n);
+    }
+    std::sort(events.begin(), events.end(), [](const auto& a, const auto& b) {
+      return a.begin != b.begin ? a.begin < b.begin : a.depth < b.depth;
+    });
+    threads.push_back(std::move(events));
+  }
+  return threads;
+}
+
+}   // namespace
+
+bool Profiler::ThreadBuffer::grow() {
+  if (chunks.size() == max_chunks) return false;
+  chunks.push_back(std::make_unique<Event[]>(chunk_size));
+  used = 0;
+  return true;
+}
+
+Profiler::ThreadBuffer* Profiler::register_thread() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  registry.push_back(std::make_unique<ThreadBuffer>());
+  registry.back()->thread_index = uint32_t(registry.size() - 1);
+  return registry.back().get();
+}
+
+void Profiler::clear() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (auto& buffer : registry) {
+    buffer->chunks.clear();
+    buffer->used = chunk_size;
+    buffer->dropped = 0;
+  }
+}
+
+std::vector<Profiler::ZoneStatistics> Profiler::statistics() {
+  // node 0 is the root above all threads
+  std::vector<ZoneNode> nodes{{"", -1, -1, {}, {}}};
+  std::map<std::pair<int, std::string>, int> lookup;
+
+  for (auto& events : collect_events()) {
+    std::vector<int> stack;
+    for (auto& event : events) {
+      stack.resize(std::min<size_t>(stack.size(), event.depth));
+      int parent = stack.empty() ? 0 : stack.back();
+      auto [iter, inserted] = lookup.try_emplace({parent, event.name}, int(nodes.size()));
+      if (inserted) {
+        nodes.push_back({event.name, parent, nodes[parent].depth + 1, {}, {}});
+        nodes[parent].children.push_back(iter->second);
+      }
+      nodes[iter->second].durations.push_back(event.end - event.begin);
+      stack.push_back(iter->second);
+    }
+  }
+
+  double scale = ns_per_tick();
+  std::vector<ZoneStatistics> result;
+  std::vector<std::pair<int, std::string>> pending{{0, ""}};
+  while (!pending.empty()) {
+    auto [id, path] = pending.back();
+    pending.pop_back();
+    auto& node = nodes[id];
+    if (id != 0) {
+      auto& d = node.durations;
+      uint64_t total = 0;
+      for (auto t : d) total += t;
+      auto percentile = [&](double p) {
+        auto nth = d.begin() + std::min(d.size() - 1, size_t(p * d.size()));
+        std::nth_element(d.begin(), nth, d.end());
+        return *nth * scale * 1e-3;
+      };
+      result.push_back({path,
+                        node.depth,
+                        d.size(),
+                        total * scale * 1e-6,
+                        total * scale * 1e-3 / d.size(),
+                        percentile(0.5),
+                        percentile(0.99)});
+    }
+    for (auto c = node.children.rbegin(); c != node.children.rend(); ++c) {
+      pending.push_back({*c, id == 0 ? nodes[*c].name : path + "/" + nodes[*c].name});
+    }
+  }
+  return result;
+}
+
+void Profiler::report() {
+  META_INFO("{:<40}{:>10}{:>12}{:>12}{:>12}{:>12}",
+            "zone",
+            "count",
+            "total ms",
+            "mean us",
+            "p50 us",
+            "p99 us");
+  for (auto& zone : statistics()) {
+    auto name = zone.path.substr(zone.path.find_last_of('/') + 1);
+    META_INFO("{:<40}{:>10}{:>12.3f}{:>12.3f}{:>12.3f}{:>12.3f}",
+              std::string(2 * zone.depth, ' ') + name,
+              zone.count,
+              zone.total_ms,
+              zone.mean_us,
+              zone.p50_us,
+              zone.p99_us);
+  }
+  size_t dropped = 0;
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto& buffer : registry) dropped += buffer->dropped;
+  }
+  if (dropped) META_WARN("profiler: {} zones past the buffer capacity were dropped", dropped);
+}
+
+bool Profiler::export_chrome_trace(const std::string& path) {
+  auto threads = collect_events();
+  double scale = ns_per_tick() * 1e-3;
+
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  if (!trace_file) {
+    trace_file = std::fopen(path.c_str(), "w");
+    if (!trace_file) {
+      META_ERROR("cannot open {} for writing", path);
+      return false;
+    }
+    std::fprintf(trace_file, "{\"traceEvents\":[\n");
+    std::atexit(close_trace);
+  }
+  for (size_t t = 0; t < threads.size(); t++) {
+    for (auto& event : threads[t]) {
+      std::fprintf(trace_file,
+                   "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+                   trace_events++ ? ",\n" : "",
+                   json_escape(event.name).c_str(),
+                   t,
+                   (event.begin - start_ticks) * scale,
+                   (event.end - event.begin) * scale);
+    }
+  }
+  return std::fflush(trace_file) == 0;
+}
+
+}   // namespace MS
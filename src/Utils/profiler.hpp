@@ -0,0 +1,147 @@
+#ifndef METASIM_PROFILER_HPP
+#define METASIM_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(_M_X64)
+#  include <x86intrin.h>
+#endif
+
+namespace MS {
+
+/*
+ * Scoped zone profiler
+ *
+ * Zones are recorded into per-thread chunked buffers, so recording takes no lock and
+ * never moves existing events. Timestamps are TSC ticks where available (steady_clock
+ * nanoseconds elsewhere), converted to nanoseconds when events are read.
+ * statistics() rebuilds the zone tree (e.g. frame > step > p2g) from the nesting of
+ * each thread; zones opened on worker threads become roots of their own.
+ * Recording is off until set_enabled(true). A thread keeps at most max_chunks chunks,
+ * zones past them are dropped and counted; clear() after reading bounds the buffers.
+ * Reading (statistics, report, export) expects no zone to be running.
+ */
+class Profiler {
+public:
+  struct Event {
+    const char* name;
+    uint64_t begin, end;
+    uint32_t depth;
+  };
+
+  constexpr static size_t chunk_size = 1 << 14;
+  constexpr static size_t max_chunks = 16;
+
+  struct ThreadBuffer {
+    uint32_t thread_index{0};
+    uint32_t depth{0};
+    size_t used{chunk_size};
+    size_t dropped{0};
+    std::vector<std::unique_ptr<Event[]>> chunks;
+
+    void push(const Event& event) {
+      if (used == chunk_size && !grow()) {
+        dropped++;
+        return;
+      }
+      chunks.back()[used++] = event;
+    }
+    bool grow();
+  };
+
+  struct ZoneStatistics {
+    // "frame/step/p2g"
+    std::string path;
+    int depth;
+    size_t count;
+    double total_ms, mean_us, p50_us, p99_us;
+  };
+
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+  static void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+  static uint64_t now() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+  }
+
+  static ThreadBuffer& local() {
+    // constant initialized, so access needs no TLS guard
+    if (!buffer_) buffer_ = register_thread();
+    return *buffer_;
+  }
+
+  // zones in depth first order of the zone tree
+  static std::vector<ZoneStatistics> statistics();
+  static void report();
+  // append the events to a Chrome trace event JSON, open in Perfetto or chrome://tracing;
+  // the first call of the process creates the file at path and it is completed at exit,
+  // later calls add to that file
+  static bool export_chrome_trace(const std::string& path);
+  // drop the recorded events
+  static void clear();
+
+private:
+  static ThreadBuffer* register_thread();
+  static std::atomic<bool> enabled_;
+  static inline thread_local ThreadBuffer* buffer_{nullptr};
+};
+
+class ProfileZone {
+public:
+  explicit ProfileZone(const char* name)
+    : name_(name) {
+    if (Profiler::enabled()) {
+      buffer_ = &Profiler::local();
+      depth_ = buffer_->depth++;
+      begin_ = Profiler::now();
+    }
+  }
+
+  ~ProfileZone() {
+    if (buffer_) {
+      uint64_t end = Profiler::now();
+      buffer_->depth--;
+      buffer_->push({name_, begin_, end, depth_});
+    }
+  }
+
+  ProfileZone(const ProfileZone&) = delete;
+  ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+  const char* name_;
+  Profiler::ThreadBuffer* buffer_{nullptr};
+  uint64_t begin_{0};
+  uint32_t depth_{0};
+};
+
+}   // namespace MS
+
+#define META_PROFILE_CONCAT_IMPL(a, b) a##b
+#define META_PROFILE_CONCAT(a, b) META_PROFILE_CONCAT_IMPL(a, b)
+
+#ifndef META_NO_PROFILE
+
+// name must outlive the profiler, i.e. a string literal
+#  define META_PROFILE_SCOPE(name) \
+    ::MS::ProfileZone META_PROFILE_CONCAT(meta_profile_zone_, __LINE__)(name)
+#  define META_PROFILE_FUNCTION() META_PROFILE_SCOPE(__func__)
+
+#else
+
+#  define META_PROFILE_SCOPE(name)
+#  define META_PROFILE_FUNCTION()
+
+#endif
+
+#endif   // METASIM_PROFILER_HPP
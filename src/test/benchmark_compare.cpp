@@ -0,0 +1,45 @@
+#include "Utils/benchmark.hpp"
+#include "Utils/logger.hpp"
+
+// usage: benchmark_compare baseline.json current.json [threshold]
+// threshold is the relative slowdown flagged as regression (default 0.1 = 10%)
+// returns 1 when any benchmark regressed, 2 on bad input
+
+using namespace MS;
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    META_ERROR("usage: benchmark_compare baseline.json current.json [threshold]");
+    return 2;
+  }
+  double threshold = argc > 3 ? std::atof(argv[3]) : 0.1;
+  std::vector<Benchmark::Result> baseline, current;
+  if (!Benchmark::read_json(argv[1], baseline) || !Benchmark::read_json(argv[2], current)) {
+    return 2;
+  }
+
+  auto comparisons = Benchmark::compare(baseline, current, threshold);
+  int regressions = 0;
+  META_INFO("{:<48}{:>14}{:>14}{:>11}", "benchmark", "baseline ns", "current ns", "change");
+  for (auto& c : comparisons) {
+    auto line = fmt::format("{:<48}{:>14.1f}{:>14.1f}{:>+10.1f}%",
+                            c.name,
+                            c.baseline_ns,
+                            c.current_ns,
+                            c.change * 100);
+    if (c.regression) {
+      META_WARN("{}  REGRESSION", line);
+      regressions++;
+    } else {
+      META_INFO("{}", line);
+    }
+  }
+  if (comparisons.size() != current.size()) {
+    META_INFO("{} benchmarks have no baseline", current.size() - comparisons.size());
+  }
+  META_INFO("{} of {} benchmarks regressed by more than {:.0f}%",
+            regressions,
+            comparisons.size(),
+            threshold * 100);
+  return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,349 @@
+#include "Core/data_container.hpp"
+#include "Core/grid.hpp"
+#include "Math/interpolation.hpp"
+#include "Math/neighbor_search.hpp"
+#include "Math/surface_reconstruction.hpp"
+#include "Utils/benchmark.hpp"
+#include <random>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <thread>
+
+// micro benchmarks of the core containers and kernels, plus a transfer step at 1..N threads
+// usage: benchmark_suite [--out result.json] [--filter name] [--threads N] [--min-time s]
+// compare two runs with benchmark_compare baseline.json result.json
+
+using namespace MS;
+
+// `fragments` ranges of equal length spread over [0, 2 * length)
+RangeSet fragmented(int length, int fragments, int shift = 0) {
+  RangeSet set;
+  int piece = length / fragments;
+  for (int f = 0; f < fragments; f++) {
+    set.ranges.push_back({2 * f * piece + shift, 2 * f * piece + shift + piece});
+  }
+  return set;
+}
+
+void bench_range_set(Benchmark& bench) {
+  constexpr int length = 1 << 20;
+  for (int fragments : {1, 64, 4096}) {
+    auto name = [&](const char* op) {
+      return fmt::format("range_set/{}/fragments:{}", op, fragments);
+    };
+    auto a = fragmented(length, fragments);
+    auto b = fragmented(length, fragments, length / fragments / 2);
+
+    bench.run(name("length"), fragments, [&] { do_not_optimize(a.length()); });
+    bench.run(name("query_offset"), 1, [&] { do_not_optimize(a.query_offset(length - 1)); });
+    bench.run(name("intersect_set"), fragments, [&] {
+      RangeSet c = a;
+      c.intersect(b);
+      do_not_optimize(c.ranges.data());
+    });
+    bench.run(name("intersect_range"), fragments, [&] {
+      RangeSet c = a;
+      c.intersect(Range{length / 2, length});
+      do_not_optimize(c.ranges.data());
+    });
+    bench.run(name("merge_set"), fragments, [&] {
+      RangeSet c = a;
+      c.merge(b);
+      do_not_optimize(c.ranges.data());
+    });
+    bench.run(name("split"), fragments, [&] {
+      RangeSet c = a;
+      c.lg2_grain_size = 7;
+      int pieces = 0;
+      std::vector<RangeSet> pending{c};
+      while (!pending.empty()) {
+        auto set = std::move(pending.back());
+        pending.pop_back();
+        if (set.is_divisible() && pieces < 64) {
+          pending.emplace_back(set, tbb::split{});
+          pending.push_back(std::move(set));
+          pieces++;
+        }
+      }
+      do_not_optimize(pieces);
+    });
+  }
+}
+
+void bench_data_subset(Benchmark& bench) {
+  constexpr int length = 1 << 20;
+  auto rho_tag = TypeTag<float>("rho");
+  auto mass_tag = TypeTag<float>("mass");
+  auto pf_tag = TypeTag<float>("pf");
+
+  std::vector<float> rho(length, 1.0f), mass(length, 2.0f), pf(length, 3.0f);
+  bench.run("data_subset/raw_vectors", length, [&] {
+    float sum = 0;
+    for (int i = 0; i < length; i++) sum += rho[i] * mass[i] + pf[i];
+    do_not_optimize(sum);
+  });
+
+  for (int fragments : {1, 64, 4096}) {
+    DataContainer container;
+    for (auto& range : fragmented(length, fragments)) {
+      container.append(rho_tag, range, 1.0f);
+      container.append(mass_tag, range, 2.0f);
+      container.append(pf_tag, range, 3.0f);
+    }
+    auto subset = container.Subset(rho_tag, mass_tag, pf_tag);
+
+    bench.run(fmt::format("data_subset/iterator/fragments:{}", fragments), length, [&] {
+      float sum = 0;
+      for (auto it = subset.begin(); it != subset.end(); ++it) {
+        auto&& [r, m, p] = *it;
+        sum += r * m + p;
+      }
+      do_not_optimize(sum);
+    });
+    bench.run(fmt::format("data_subset/foreach_element/fragments:{}", fragments), length, [&] {
+      float sum = 0;
+      subset.foreach_element([&](float& r, float& m, float& p) { sum += r * m + p; });
+      do_not_optimize(sum);
+    });
+  }
+}
+
+template<typename Kernel>
+void bench_kernel(Benchmark& bench, const char* name) {
+  using TV = Vec<3, float>;
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> uniform(2.0f, 62.0f);
+  std::vector<TV> xs(4096);
+  for (auto& x : xs) x = TV(uniform(rng), uniform(rng), uniform(rng));
+
+  bench.run(fmt::format("kernel/{}/o_w", name), xs.size(), [&] {
+    float sum = 0;
+    for (auto& x : xs) {
+      auto [o, w] = Kernel::calc_o_w(x);
+      sum += w(0, 0) + w(1, 1) + w(2, 2) + o(0);
+    }
+    do_not_optimize(sum);
+  });
+  bench.run(fmt::format("kernel/{}/o_w_dw", name), xs.size(), [&] {
+    float sum = 0;
+    for (auto& x : xs) {
+      auto [o, w, dw] = Kernel::calc_o_w_dw(x);
+      sum += w(0, 0) + dw(1, 1) + w(2, 2) + o(0);
+    }
+    do_not_optimize(sum);
+  });
+}
+
+void bench_grid(Benchmark& bench, int threads) {
+  Grid<Vec<4, float>, 3, float> grid;
+  grid.InitializeGrid({64, 64, 64}, Vec<4, float>::Zero());
+  double nodes = grid.TotalSize();
+  tbb::task_arena arena(threads);
+  arena.execute([&] {
+    bench.run("grid/iterate_all", nodes, [&] {
+      grid.IterateAllGrid([](auto& node, auto&, int i) { node(0) += float(i & 1); });
+    }, threads);
+    bench.run("grid/iterate_all_with_check", nodes, [&] {
+      grid.IterateAllGridWithCheck([](auto& node, auto& xi, int) {
+        node(3) = float(xi(0));
+        return xi(0) < 32;
+      });
+    }, threads);
+    bench.run("grid/iterate_active", grid.ActiveIndices().size(), [&] {
+      grid.IterateActiveGrid([](auto& node, auto&, int) { node(1) += 1.0f; });
+    }, threads);
+  });
+}
+
+// particles as many as step/transfer, so a rebuild compares against one step
+void bench_neighbor_search(Benchmark& bench, int threads) {
+  using TV = Vec<3, float>;
+  constexpr int count = 1 << 18;
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> uniform(0, 1);
+  std::vector<TV> x(count);
+  for (auto& p : x) p = TV(uniform(rng), uniform(rng), uniform(rng));
+  // about 8 particles per cell
+  NeighborSearch<3, float> search(0.03f, TV::Zero(), TV::Ones());
+  tbb::task_arena arena(threads);
+  arena.execute([&] {
+    bench.run("neighbor_search/build", count, [&] { search.build(x.data(), count); }, threads);
+    // 1% of the particles cross into the next cell and back
+    int step = 0;
+    bench.run("neighbor_search/update", count, [&] {
+      float shift = (step++ & 1) ? -0.03f : 0.03f;
+      for (int i = 0; i < count; i += 100) x[i](0) += shift;
+      search.update(x.data(), count);
+    }, threads);
+    bench.run("neighbor_search/query_all", count, [&] {
+      search.query_all([](int, const auto& neighbors) { do_not_optimize(neighbors.size()); });
+    }, threads);
+  });
+}
+
+// a ball of 2^18 particles meshed at half the particle spacing
+void bench_surface(Benchmark& bench, int threads) {
+  using TV = Vec<3, float>;
+  constexpr float spacing = 1.0f / 80;
+  std::vector<TV> x;
+  for (int i = -40; i < 40; i++)
+    for (int j = -40; j < 40; j++)
+      for (int k = -40; k < 40; k++) {
+        TV p = TV(i, j, k) * spacing;
+        if (p.norm() < 0.5f) x.push_back(p);
+      }
+  SurfaceReconstruction<float> reconstruction(spacing / 2, spacing);
+  SurfaceMesh mesh;
+  tbb::task_arena arena(threads);
+  arena.execute([&] {
+    bench.run("surface/reconstruct", x.size(), [&] {
+      reconstruction.reconstruct(x.data(), x.size(), mesh);
+      do_not_optimize(mesh.triangles.size());
+    }, threads);
+  });
+}
+
+/*
+ * one explicit transfer step on particle attributes of a DataContainer:
+ * P2G of mass and momentum into per-thread grids, reduction, grid update with gravity
+ * and walls, G2P with APIC affine velocities, advection
+ */
+class TransferStep {
+public:
+  using Kernel = QuadraticKernel<3, float>;
+  using TV = Vec<3, float>;
+  using TM = Mat<3, 3, float>;
+  using TV4 = Vec<4, float>;
+  constexpr static int n = 64;
+
+  TypeTag<TV> x_tag{"x"}, v_tag{"v"};
+  TypeTag<TM> C_tag{"C"};
+  DataContainer particles;
+  std::vector<TV4> grid = std::vector<TV4>(n * n * n);
+  tbb::enumerable_thread_specific<std::vector<TV4>> local_grids;
+  float dx = 1.0f / n, dt = 1e-4f;
+  int count;
+
+  explicit TransferStep(int count)
+    : count(count) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> uniform(0.2f, 0.8f);
+    std::vector<TV> x(count);
+    for (auto& xp : x) xp = TV(uniform(rng), uniform(rng), uniform(rng));
+    particles.append(x_tag, {0, count}, std::move(x));
+    particles.append(v_tag, {0, count}, TV(TV::Zero()));
+    particles.append(C_tag, {0, count}, TM(TM::Zero()));
+  }
+
+  static int index(const Vec<3, int>& node) { return (node(0) * n + node(1)) * n + node(2); }
+
+  void advance() {
+    auto& x = particles.get_array(x_tag).data;
+    auto& v = particles.get_array(v_tag).data;
+    auto& C = particles.get_array(C_tag).data;
+    float inv_dx = 1.0f / dx;
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, count, 1024), [&](const auto& range) {
+      auto& local = local_grids.local();
+      if (local.empty()) local.assign(grid.size(), TV4::Zero());
+      for (int p = range.begin(); p < range.end(); p++) {
+        auto [base, w] = Kernel::calc_o_w(TV(x[p] * inv_dx));
+        for (int i = 0; i < 3; i++)
+          for (int j = 0; j < 3; j++)
+            for (int k = 0; k < 3; k++) {
+              Vec<3, int> offset(i, j, k);
+              float weight = w(i, 0) * w(j, 1) * w(k, 2);
+              TV dpos = (offset.cast<float>() + base.cast<float>()) * dx - x[p];
+              TV momentum = weight * (v[p] + C[p] * dpos);
+              local[index(base + offset)] += TV4(momentum(0), momentum(1), momentum(2), weight);
+            }
+      }
+    });
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, grid.size()), [&](const auto& range) {
+      for (size_t g = range.begin(); g < range.end(); g++) {
+        TV4 sum = TV4::Zero();
+        for (auto& local : local_grids) {
+          sum += local[g];
+          local[g].setZero();
+        }
+        if (sum(3) > 0) {
+          TV velocity = sum.head<3>() / sum(3) + dt * TV(0, -9.8f, 0);
+          int i = int(g / (n * n)), j = int(g / n % n), k = int(g % n);
+          if (i < 3 || i >= n - 3) velocity(0) = 0;
+          if (j < 3 || j >= n - 3) velocity(1) = 0;
+          if (k < 3 || k >= n - 3) velocity(2) = 0;
+          sum.head<3>() = velocity;
+        }
+        grid[g] = sum;
+      }
+    });
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, count, 1024), [&](const auto& range) {
+      for (int p = range.begin(); p < range.end(); p++) {
+        auto [base, w] = Kernel::calc_o_w(TV(x[p] * inv_dx));
+        TV velocity = TV::Zero();
+        TM affine = TM::Zero();
+        for (int i = 0; i < 3; i++)
+          for (int j = 0; j < 3; j++)
+            for (int k = 0; k < 3; k++) {
+              Vec<3, int> offset(i, j, k);
+              float weight = w(i, 0) * w(j, 1) * w(k, 2);
+              TV dpos = (offset.cast<float>() + base.cast<float>()) * dx - x[p];
+              TV grid_v = grid[index(base + offset)].head<3>();
+              velocity += weight * grid_v;
+              affine += 4 * inv_dx * inv_dx * weight * grid_v * dpos.transpose();
+            }
+        v[p] = velocity;
+        C[p] = affine;
+        x[p] += dt * velocity;
+      }
+    });
+  }
+};
+
+void bench_step(Benchmark& bench, int max_threads) {
+  constexpr int count = 1 << 18;
+  for (int threads = 1;; threads = std::min(2 * threads, max_threads)) {
+    auto name = fmt::format("step/transfer/threads:{}", threads);
+    if (bench.selected(name)) {
+      // fresh particles and thread local grids for every thread count
+      TransferStep step(count);
+      tbb::task_arena arena(threads);
+      arena.execute([&] { bench.run(name, count, [&] { step.advance(); }, threads); });
+    }
+    if (threads == max_threads) break;
+  }
+}
+
+int main(int argc, char** argv) {
+  Benchmark bench;
+  std::string out = "benchmark.json";
+  int max_threads = int(std::max(1u, std::thread::hardware_concurrency()));
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string option = argv[i];
+    if (option == "--out") {
+      out = argv[i + 1];
+    } else if (option == "--filter") {
+      bench.filter = argv[i + 1];
+    } else if (option == "--threads") {
+      max_threads = std::max(1, std::atoi(argv[i + 1]));
+    } else if (option == "--min-time") {
+      bench.min_time = std::atof(argv[i + 1]);
+    } else {
+      META_ERROR("unknown option {}", option);
+      return 1;
+    }
+  }
+
+  bench_range_set(bench);
+  bench_data_subset(bench);
+  bench_kernel<QuadraticKernel<3, float>>(bench, "quadratic");
+  bench_kernel<CubicKernel<3, float>>(bench, "cubic");
+  bench_grid(bench, max_threads);
+  bench_neighbor_search(bench, max_threads);
+  bench_surface(bench, max_threads);
+  bench_step(bench, max_threads);
+  return bench.write_json(out) ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#include "Utils/checkpoint.hpp"
+#include "meta.hpp"
+#include <cstdio>
+
+// a full checkpoint and a delta restore the container; arrays only read between them are
+// skipped, deltas also apply to arrays holding uniform ranges
+int main() {
+  using namespace MS;
+  using TV = Vec<3, double>;
+  const int n = 100000;
+  auto x_tag = TypeTag<TV>("x");
+  auto mass_tag = TypeTag<float>("mass");
+  auto id_tag = TypeTag<int>("id");
+  std::filesystem::create_directories(context.output_dir);
+  std::vector<std::string> paths{context.output_dir + "/checkpoint_test_0.bin",
+                                 context.output_dir + "/checkpoint_test_1.bin"};
+
+  DataContainer container;
+  auto x = container.allocate(x_tag, Range{0, n});
+  auto id = container.allocate(id_tag, Range{0, n});
+  for (int i = 0; i < n; i++) {
+    x[i] = TV(i, 2 * i, 3 * i);
+    id[i] = i;
+  }
+  container.append(mass_tag, Range{0, n / 2}, 1.0f);
+  container.append(mass_tag, Range{n / 2, n}, 2.0f);
+
+  // the state of the full checkpoint, masses as uniform ranges
+  DataContainer uniform;
+  uniform.append(x_tag, Range{0, n}, std::vector<TV>(x, x + n));
+  uniform.append(id_tag, Range{0, n}, std::vector<int>(id, id + n));
+  uniform.append(mass_tag, Range{0, n / 2}, 1.0f);
+  uniform.append_uniform(mass_tag, Range{n / 2, n}, 2.0f);
+
+  Checkpointer checkpointer;
+  bool ok = checkpointer.write(paths[0], container) && checkpointer.last_report().full;
+
+  // a few positions written, particles emitted, ids only read
+  for (auto [xi] : container.Subset(RangeSet(Range{0, 10}), x_tag)) xi = TV(-1, -1, -1);
+  container.append(mass_tag, Range{n, n + 100}, 3.0f);
+  long sum = 0;
+  for (auto i : container.get_array(id_tag).data) sum += i;
+  ok = ok && sum == long(n) * (n - 1) / 2 && checkpointer.write(paths[1], container);
+  auto& report = checkpointer.last_report();
+  bool delta = !report.full && report.arrays_skipped == 1 && report.arrays_partial == 1 &&
+               report.arrays_written == 1 && report.bytes_written < report.bytes_total / 2;
+  META_INFO("delta: {:.1f} of {:.1f} kB, skipped {}, partial {}, whole {}",
+            report.bytes_written / 1e3,
+            report.bytes_total / 1e3,
+            report.arrays_skipped,
+            report.arrays_partial,
+            report.arrays_written);
+
+  auto same = [&](DataContainer& other) {
+    auto& mass = other.get_array(mass_tag);
+    return other.get_array(x_tag).data == container.get_array(x_tag).data &&
+           other.get_array(id_tag).data == container.get_array(id_tag).data &&
+           mass.data == container.get_array(mass_tag).data &&
+           mass.ranges.ranges == container.get_array(mass_tag).ranges.ranges;
+  };
+  DataContainer restored;
+  bool restore = Checkpointer::restore(restored, paths, x_tag, mass_tag, id_tag) &&
+                 same(restored);
+  bool applied = Checkpointer::apply_delta(paths[1], uniform) && same(uniform);
+  for (auto& path : paths) std::remove(path.c_str());
+
+  META_INFO("delta {}, restore {}, delta over uniform ranges {}", delta, restore, applied);
+  return ok && delta && restore && applied ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+#include "Math/mesh_collider.hpp"
+#include <random>
+
+// closest points of the BVH accelerated MeshCollider against a brute force search over
+// all faces, signs against the box the mesh encloses, and queries bounded to a band
+
+using namespace MS;
+
+namespace {
+
+// surface of [-0.5, 0.5]^3, every side cut into 2 k^2 triangles, faces oriented outwards
+TriangleMesh<double> box_mesh(int k) {
+  TriangleMesh<double> mesh;
+  for (int axis = 0; axis < 3; axis++) {
+    for (int side = -1; side <= 1; side += 2) {
+      int u = (axis + 1) % 3, v = (axis + 2) % 3;
+      int first = int(mesh.vertices.size());
+      for (int i = 0; i <= k; i++) {
+        for (int j = 0; j <= k; j++) {
+          Vec<3, double> p;
+          p(axis) = 0.5 * side;
+          p(u) = double(i) / k - 0.5;
+          p(v) = double(j) / k - 0.5;
+          mesh.vertices.push_back(p);
+        }
+      }
+      for (int i = 0; i < k; i++) {
+        for (int j = 0; j < k; j++) {
+          int a = first + i * (k + 1) + j, b = a + k + 1, c = b + 1, d = a + 1;
+          if (side > 0) {
+            mesh.faces.push_back({a, b, c});
+            mesh.faces.push_back({a, c, d});
+          } else {
+            mesh.faces.push_back({a, c, b});
+            mesh.faces.push_back({a, d, c});
+          }
+        }
+      }
+    }
+  }
+  // the sides share their border vertices, merge them so the mesh is closed
+  std::vector<int> merged(mesh.vertices.size());
+  std::vector<Vec<3, double>> vertices;
+  for (size_t i = 0; i < mesh.vertices.size(); i++) {
+    merged[i] = -1;
+    for (size_t j = 0; j < vertices.size() && merged[i] < 0; j++) {
+      if ((vertices[j] - mesh.vertices[i]).norm() < 1e-12) merged[i] = int(j);
+    }
+    if (merged[i] < 0) {
+      merged[i] = int(vertices.size());
+      vertices.push_back(mesh.vertices[i]);
+    }
+  }
+  mesh.vertices = vertices;
+  for (auto& face : mesh.faces) {
+    for (int e = 0; e < 3; e++) face(e) = merged[face(e)];
+  }
+  return mesh;
+}
+
+}   // namespace
+
+int main() {
+  using TV = Vec<3, double>;
+  MeshCollider<double> collider(box_mesh(6));
+  collider.translation = TV(0.1, -0.2, 0.3);
+  collider.rotation = Eigen::AngleAxis<double>(0.7, TV(1, 2, 3).normalized()).toRotationMatrix();
+  auto& mesh = collider.mesh();
+
+  std::mt19937 random(11);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+  const int n = 2000;
+  const double band = 0.15;
+  std::vector<TV> points(n);
+  for (auto& x : points) {
+    x = collider.translation + TV(uniform(random), uniform(random), uniform(random));
+  }
+  std::vector<MeshCollider<double>::Contact> banded(n);
+  collider.query(points.data(), n, banded.data(), band);
+
+  int distance_errors = 0, sign_errors = 0, band_errors = 0;
+  for (int i = 0; i < n; i++) {
+    TV local = collider.rotation.transpose() * (points[i] - collider.translation);
+    double brute = std::numeric_limits<double>::max();
+    for (auto& face : mesh.faces) {
+      int feature;
+      TV q = closest_point_on_triangle(
+        local, mesh.vertices[face(0)], mesh.vertices[face(1)], mesh.vertices[face(2)], feature);
+      brute = std::min(brute, (local - q).norm());
+    }
+    auto contact = collider.query(points[i]);
+    bool inside = (local.array().abs() < 0.5).all();
+    if (std::abs(std::abs(contact.phi) - brute) > 1e-12) distance_errors++;
+    if (brute > 1e-9 && (contact.phi < 0) != inside) sign_errors++;
+    // within the band the same answer, outside of it no face
+    auto& bounded = banded[i];
+    if (brute < band - 1e-9 ? bounded.face < 0 || bounded.phi != contact.phi
+                            : brute > band + 1e-9 && bounded.face >= 0)
+      band_errors++;
+  }
+
+  META_INFO("{} queries against {} faces: {} distance, {} sign, {} band errors",
+            n,
+            mesh.faces.size(),
+            distance_errors,
+            sign_errors,
+            band_errors);
+  return distance_errors == 0 && sign_errors == 0 && band_errors == 0 ? 0 : 1;
+}
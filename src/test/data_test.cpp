@@ -1,9 +1,70 @@
-
 #include "Core/data_container.hpp"
 
+// uniform ranges are stored once, read through iterators, value() and read only subsets
+// as they are, and get their own storage only where a Subset writes
+
+using namespace MS;
+
 int main() {
-  using namespace MS;
   auto rho_tag = TypeTag<float>("rho");
+  auto mass_tag = TypeTag<double>("mass");
+
+  DataContainer container;
+  container.append(rho_tag, Range{0, 300}, 1.0f);
+  container.append(mass_tag, Range{0, 100}, 2.0);
+  container.append_uniform(mass_tag, Range{100, 200}, 3.0);
+  container.append_uniform(mass_tag, Range{200, 300}, 4.0);
+  const auto& mass = std::as_const(container).get_array(mass_tag);
+
+  bool ok = true;
+  auto check = [&](bool passed, const char* what) {
+    if (!passed) META_ERROR("{}: FAILED", what);
+    ok = ok && passed;
+  };
+
+  check(mass.is_uniform() && mass.data.size() == 102 && mass.element_count() == 300,
+        "append_uniform stores a range once");
+  check(mass.value(50) == 2.0 && mass.value(150) == 3.0 && mass.value(299) == 4.0, "value()");
+
+  double sum = 0;
+  int count = 0;
+  for (auto& m : mass) {
+    sum += m;
+    count++;
+  }
+  check(count == 300 && sum == 100 * 2.0 + 100 * 3.0 + 100 * 4.0, "iteration");
+
+  // reading keeps storage, pointers into it and the version
+  auto version = mass.version;
+  auto stored = mass.data.data();
+  sum = 0;
+  for (auto [rho, m] : container.Subset(rho_tag, read_only(mass_tag))) sum += rho * m;
+  for (auto [m] : container.View(mass_tag)) sum += m;
+  static_assert(std::is_same_v<decltype(*container.View(mass_tag).begin()),
+                               std::tuple<const double&>>,
+                "views are read only");
+  check(sum == 2 * 900.0 && mass.data.size() == 102 && mass.data.data() == stored &&
+          mass.version == version,
+        "read only subsets leave uniform ranges");
+
+  // a write expands the uniform ranges it covers and no others
+  for (auto [m] : container.Subset(RangeSet(Range{150, 160}), mass_tag)) m = 5.0;
+  check(mass.data.size() == 201 && mass.version != version, "Subset materializes on write");
+  check(mass.value(149) == 3.0 && mass.value(155) == 5.0 && mass.value(160) == 3.0 &&
+          mass.value(250) == 4.0,
+        "values after a write");
+
+  // writing ranges already materialized copies nothing
+  stored = mass.data.data();
+  for (auto [m] : container.Subset(RangeSet(Range{0, 200}), mass_tag)) m += 1;
+  check(mass.data.data() == stored && mass.value(250) == 4.0 && mass.value(149) == 4.0,
+        "no copy without uniform ranges to expand");
+
+  // raw bytes are dense
+  auto raw = static_cast<const double*>(container.get_array(mass_tag).raw_data());
+  check(!mass.is_uniform() && raw[0] == 3.0 && raw[155] == 6.0 && raw[299] == 4.0,
+        "raw_data() materializes");
 
-  return 0;
-}
\ No newline at end of file
+  META_INFO("uniform ranges: {}", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
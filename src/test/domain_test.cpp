@@ -0,0 +1,145 @@
+#include "Core/domain_decomposition.hpp"
+#include "Math/interpolation.hpp"
+#include <random>
+
+// a 2D explicit MPM-like transfer in slabs over the ranks against the same scene in one
+// process, usage: mpirun -np 4 domain_test (with METASIM_WITH_MPI), or plain domain_test
+
+using namespace MS;
+
+using Kernel = QuadraticKernel<2, double>;
+using TV = Vec<2, double>;
+using TM = Mat<2, 2, double>;
+using TV3 = Vec<3, double>;
+
+constexpr int n = 64;
+constexpr int count = 20000;
+constexpr int steps = 60;
+constexpr double dx = 1.0 / n, dt = 1e-3;
+
+TypeTag<TV> x_tag{"x"}, v_tag{"v"};
+TypeTag<TM> C_tag{"C"};
+TypeTag<int> id_tag{"id"};
+
+// particles of ids [first, last), the whole scene is the same on every rank
+void emit(DataContainer& particles, int first, int last) {
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<double> uniform(0.1, 0.5);
+  std::vector<TV> x(count);
+  for (auto& xp : x) xp = TV(uniform(rng), uniform(rng));
+  std::vector<int> ids;
+  std::vector<TV> kept;
+  for (int p = first; p < last; p++) {
+    ids.push_back(p);
+    kept.push_back(x[p]);
+  }
+  int local = last - first;
+  particles.append(x_tag, {0, local}, std::move(kept));
+  particles.append(v_tag, {0, local}, TV(3.0, 0.0));
+  particles.append(C_tag, {0, local}, TM(TM::Zero()));
+  particles.append(id_tag, {0, local}, std::move(ids));
+}
+
+// grid nodes (momentum, mass) of the planes [offset, offset + planes)
+void advance(DataContainer& particles, std::vector<TV3>& grid, int offset,
+             DomainDecomposition<double, 2>* domain) {
+  auto& x = particles.get_array(x_tag).data;
+  auto& v = particles.get_array(v_tag).data;
+  auto& C = particles.get_array(C_tag).data;
+  int planes = int(grid.size() / n);
+  auto index = [&](int i, int j) { return size_t(i - offset) * n + j; };
+  for (auto& node : grid) node.setZero();
+
+  for (size_t p = 0; p < x.size(); p++) {
+    auto [base, w] = Kernel::calc_o_w(TV(x[p] / dx));
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++) {
+        double weight = w(i, 0) * w(j, 1);
+        TV dpos = (TV(i, j) + base.cast<double>()) * dx - x[p];
+        TV momentum = weight * (v[p] + C[p] * dpos);
+        grid[index(base(0) + i, base(1) + j)] += TV3(momentum(0), momentum(1), weight);
+      }
+  }
+  if (domain) domain->accumulate_halos(grid);
+
+  for (int i = offset; i < offset + planes; i++) {
+    for (int j = 0; j < n; j++) {
+      auto& node = grid[index(i, j)];
+      if (node(2) <= 0) continue;
+      TV velocity = node.head<2>() / node(2) + dt * TV(0, -9.8);
+      if (i < 3 || i >= n - 3) velocity(0) = 0;
+      if (j < 3 || j >= n - 3) velocity(1) = 0;
+      node.head<2>() = velocity;
+    }
+  }
+  if (domain) domain->update_halos(grid);
+
+  for (size_t p = 0; p < x.size(); p++) {
+    auto [base, w] = Kernel::calc_o_w(TV(x[p] / dx));
+    TV velocity = TV::Zero();
+    TM affine = TM::Zero();
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++) {
+        double weight = w(i, 0) * w(j, 1);
+        TV dpos = (TV(i, j) + base.cast<double>()) * dx - x[p];
+        TV node_velocity = grid[index(base(0) + i, base(1) + j)].head<2>();
+        velocity += weight * node_velocity;
+        affine += 4 / (dx * dx) * weight * node_velocity * dpos.transpose();
+      }
+    v[p] = velocity;
+    C[p] = affine;
+    x[p] += dt * velocity;
+  }
+}
+
+int main() {
+  auto& world = Communicator::world();
+
+  // reference: the whole scene in this process
+  DataContainer reference;
+  emit(reference, 0, count);
+  std::vector<TV3> full_grid(n * n);
+  for (int step = 0; step < steps; step++) advance(reference, full_grid, 0, nullptr);
+
+  DomainDecomposition<double, 2> domain(TV::Zero(), dx, {n, n});
+  domain.rebalance_interval = 10;
+  DataContainer particles;
+  emit(particles, count * world.rank() / world.size(), count * (world.rank() + 1) / world.size());
+  // start from the slabs, not from the emission order
+  if (!domain.rebalance(particles, x_tag)) return 1;
+  std::vector<TV3> grid;
+  int layout = -1;
+  for (int step = 0; step < steps; step++) {
+    if (layout != domain.layout_version()) {
+      auto shape = domain.local_shape();
+      grid.assign(shape[0] * shape[1], TV3::Zero());
+      layout = domain.layout_version();
+    }
+    advance(particles, grid, domain.local_offset(), &domain);
+    if (!domain.redistribute(particles, x_tag)) return 1;
+  }
+
+  // every particle against its reference by id
+  auto& x = particles.get_array(x_tag).data;
+  auto& ids = particles.get_array(id_tag).data;
+  auto& expected = reference.get_array(x_tag).data;
+  double error = 0;
+  int foreign = 0;
+  for (size_t p = 0; p < x.size(); p++) {
+    error = std::max(error, (x[p] - expected[ids[p]]).norm());
+    foreign += !domain.owns(x[p]);
+  }
+  error = world.max(error);
+  double total = world.sum(double(x.size()));
+  foreign = int(world.sum(foreign));
+  bool ok = error < 1e-9 && total == count && foreign == 0;
+  if (world.rank() == 0) {
+    META_INFO("{} ranks: {} particles, {} outside their slab, max deviation {:.3e}: {}",
+              world.size(),
+              total,
+              foreign,
+              error,
+              ok ? "ok" : "FAILED");
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+#include "Utils/frame_codec.hpp"
+#include "meta.hpp"
+#include <cmath>
+#include <cstring>
+
+// frames decode from their keyframe on, quantized attributes within their tolerance and all
+// others exactly; streams whose chunks do not cover a section are rejected
+
+using namespace MS;
+
+int main() {
+  using TV = Vec<3, double>;
+  const int n = 20000;
+  const double tolerance = 1e-4;
+  auto x_tag = TypeTag<TV>("x");
+  auto v_tag = TypeTag<Vec<3, float>>("v");
+  auto id_tag = TypeTag<int>("id");
+
+  DataContainer container;
+  auto x = container.allocate(x_tag, Range{0, n});
+  auto v = container.allocate(v_tag, Range{0, n});
+  auto id = container.allocate(id_tag, Range{0, n});
+  for (int i = 0; i < n; i++) id[i] = i;
+
+  auto take = [&](int frame) {
+    FrameSnapshot snapshot;
+    snapshot.frame = frame;
+    std::vector<const DataArrayBase*> arrays{&container.get_array(x_tag),
+                                             &container.get_array(v_tag),
+                                             &container.get_array(id_tag)};
+    for (auto array : arrays) {
+      snapshot.sections.push_back(ParticleFile::describe(*array));
+      auto data = static_cast<const char*>(array->raw_data());
+      snapshot.payloads.emplace_back(data, data + array->raw_bytes());
+    }
+    return snapshot;
+  };
+
+  bool ok = true;
+  auto check = [&](bool passed, const char* what) {
+    if (!passed) META_ERROR("{}: FAILED", what);
+    ok = ok && passed;
+  };
+
+  FrameCodec codec;
+  codec.tolerances["x"] = tolerance;
+  codec.keyframe_interval = 3;
+  codec.chunk_elements = 4096;
+  codec.write_log = false;
+  FrameDecoder decoder;
+  for (int frame = 0; frame < 7; frame++) {
+    for (int i = 0; i < n; i++) {
+      x[i] = TV(std::sin(i + 0.1 * frame), std::cos(i - 0.1 * frame), 1e-3 * i + frame);
+      v[i] = Vec<3, float>(1e-7f * i, frame, -1e-7f * i * frame);
+    }
+    // a value too large for the quantum, the frame keeps x lossless
+    if (frame == 4) x[7][0] = 1e300;
+
+    auto snapshot = take(frame);
+    FrameCodec::Report report;
+    auto bytes = codec.encode(snapshot, &report);
+    FrameSnapshot decoded;
+    if (!decoder.decode(bytes, decoded) || decoded.sections.size() != 3) {
+      check(false, "decode");
+      break;
+    }
+    auto original = reinterpret_cast<const double*>(snapshot.payloads[0].data());
+    auto result = reinterpret_cast<const double*>(decoded.payloads[0].data());
+    double error = 0;
+    for (int i = 0; i < 3 * n; i++) error = std::max(error, std::abs(result[i] - original[i]));
+    check(decoded.frame == frame && error <= tolerance * (1 + 1e-9) &&
+            (frame != 4 || error == 0),
+          "x within its tolerance");
+    check(decoded.payloads[1] == snapshot.payloads[1] &&
+            decoded.payloads[2] == snapshot.payloads[2],
+          "attributes without a tolerance are exact");
+    check(report.encoded_bytes < report.raw_bytes, "frames shrink");
+  }
+
+  // a section whose chunk count was cleared decodes to nothing
+  FrameSnapshot ids;
+  ids.sections.push_back(ParticleFile::describe(container.get_array(id_tag)));
+  ids.payloads.emplace_back(reinterpret_cast<const char*>(id),
+                            reinterpret_cast<const char*>(id + n));
+  FrameCodec keyframes;
+  auto bytes = keyframes.encode(ids);
+  auto& section = ids.sections[0];
+  size_t chunk_count = 8 + 3 * 4 + 4 + section.name.size() + 4 + section.element_type.size() +
+                       2 * 8 + 4 + 8 * section.ranges.ranges.size() + 2 + 2 * 8;
+  std::memset(bytes.data() + chunk_count, 0, sizeof(uint32_t));
+  FrameSnapshot corrupted;
+  check(!FrameDecoder().decode(bytes, corrupted), "missing chunks rejected");
+
+  META_INFO("frame codec: {}", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
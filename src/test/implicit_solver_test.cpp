@@ -0,0 +1,83 @@
+#include "mpm/mpm_constitutive.hpp"
+#include "mpm/mpm_implicit_solver.hpp"
+#include <random>
+
+// the matrix-free conjugate gradient of MPMImplicitSolver against a dense direct solve
+// of the assembled M + dt^2 H, with each preconditioner
+
+using namespace MS;
+
+int main() {
+  using Solver = MPMImplicitSolver<double, 2, QuadraticKernel<2, double>>;
+  using TV = Vec<2, double>;
+  using TM = Mat<2, 2, double>;
+  const double dx = 0.1, dt = 1e-2, particle_volume = dx * dx / 4;
+  NeoHookean<double, 2> model(1e5, 0.3);
+
+  // a block of particles at rest, F = I leaves no elastic force but a stiff H
+  std::mt19937 random(7);
+  std::uniform_real_distribution<double> uniform(0.25, 0.55);
+  std::vector<TV> positions(24);
+  for (auto& x : positions) x = TV(uniform(random), uniform(random));
+  std::vector<TM> deformation(positions.size(), TM::Identity());
+  std::vector<double> volumes(positions.size(), particle_volume);
+
+  MPMGrid<double, 2, double> grid;
+  grid.InitializeGrid({10, 10}, 0.0);
+  for (auto& x : positions) {
+    auto [base_node, w, dw] = QuadraticKernel<2, double>::calc_o_w_dw(TV(x / dx));
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++) {
+        grid.at(base_node + Vec<2, int>(i, j)) += 1000 * particle_volume * w(i, 0) * w(j, 1);
+      }
+  }
+  grid.IterateAllGridWithCheck([](double mass, const Vec<2, int>&, int) { return mass > 0; });
+  auto& active = grid.ActiveIndices();
+  std::vector<double> masses;
+  for (auto i : active) masses.push_back(grid.Nodes()[i]);
+  size_t n = active.size();
+
+  std::uniform_real_distribution<double> velocity(-1, 1);
+  std::vector<TV> v_star(n);
+  for (auto& v : v_star) v = TV(velocity(random), velocity(random));
+
+  bool ok = true;
+  for (auto preconditioner : {Solver::Preconditioner::None,
+                              Solver::Preconditioner::Jacobi,
+                              Solver::Preconditioner::BlockJacobi}) {
+    Solver solver;
+    solver.preconditioner = preconditioner;
+    solver.tolerance = 1e-12;
+    solver.max_iterations = 1000;
+    solver.write_log = false;
+    solver.build(grid, positions, dx);
+    auto v = v_star;
+    auto report = solver.solve(dt, masses, deformation, volumes, model, v);
+
+    // columns of A from products with unit vectors, rhs = M v* without elastic forces
+    Eigen::MatrixXd A(2 * n, 2 * n);
+    Eigen::VectorXd rhs(2 * n);
+    std::vector<TV> unit(n, TV::Zero()), column(n);
+    for (size_t j = 0; j < 2 * n; j++) {
+      unit[j / 2](j % 2) = 1;
+      solver.apply(dt, masses, model, unit, column);
+      unit[j / 2](j % 2) = 0;
+      for (size_t i = 0; i < n; i++) A.block<2, 1>(2 * i, j) = column[i];
+      rhs(j) = masses[j / 2] * v_star[j / 2](j % 2);
+    }
+    Eigen::VectorXd direct = A.ldlt().solve(rhs);
+    double error = 0;
+    for (size_t i = 0; i < n; i++) {
+      error = std::max(error, (v[i] - direct.segment<2>(2 * i)).norm());
+    }
+
+    bool passed = report.converged && error < 1e-8 * direct.lpNorm<Eigen::Infinity>();
+    META_INFO("preconditioner {}: {} iterations, error {:.3e} against the direct solve",
+              int(preconditioner),
+              report.iterations,
+              error);
+    if (!passed) META_ERROR("preconditioner {}: FAILED", int(preconditioner));
+    ok = ok && passed;
+  }
+  return ok ? 0 : 1;
+}
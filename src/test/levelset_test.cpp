@@ -0,0 +1,119 @@
+#include "Math/levelset.hpp"
+#include <cmath>
+
+// level sets of a closed box mesh and of a particle sphere against their analytic signed
+// distances: exact within the band from the mesh, first order from particles, and the
+// right sign everywhere
+
+using namespace MS;
+
+namespace {
+
+// surface of [-0.5, 0.5]^3, every side cut into 2 k^2 triangles, faces oriented outwards
+TriangleMesh<double> box_mesh(int k) {
+  TriangleMesh<double> mesh;
+  for (int axis = 0; axis < 3; axis++) {
+    for (int side = -1; side <= 1; side += 2) {
+      int u = (axis + 1) % 3, v = (axis + 2) % 3;
+      int first = int(mesh.vertices.size());
+      for (int i = 0; i <= k; i++) {
+        for (int j = 0; j <= k; j++) {
+          Vec<3, double> p;
+          p(axis) = 0.5 * side;
+          p(u) = double(i) / k - 0.5;
+          p(v) = double(j) / k - 0.5;
+          mesh.vertices.push_back(p);
+        }
+      }
+      for (int i = 0; i < k; i++) {
+        for (int j = 0; j < k; j++) {
+          int a = first + i * (k + 1) + j, b = a + k + 1, c = b + 1, d = a + 1;
+          if (side > 0) {
+            mesh.faces.push_back({a, b, c});
+            mesh.faces.push_back({a, c, d});
+          } else {
+            mesh.faces.push_back({a, c, b});
+            mesh.faces.push_back({a, d, c});
+          }
+        }
+      }
+    }
+  }
+  // the sides share their border vertices, merge them so the mesh is closed
+  std::vector<int> merged(mesh.vertices.size());
+  std::vector<Vec<3, double>> vertices;
+  for (size_t i = 0; i < mesh.vertices.size(); i++) {
+    merged[i] = -1;
+    for (size_t j = 0; j < vertices.size() && merged[i] < 0; j++) {
+      if ((vertices[j] - mesh.vertices[i]).norm() < 1e-12) merged[i] = int(j);
+    }
+    if (merged[i] < 0) {
+      merged[i] = int(vertices.size());
+      vertices.push_back(mesh.vertices[i]);
+    }
+  }
+  mesh.vertices = vertices;
+  for (auto& face : mesh.faces) {
+    for (int e = 0; e < 3; e++) face(e) = merged[face(e)];
+  }
+  return mesh;
+}
+
+}   // namespace
+
+int main() {
+  using TV = Vec<3, double>;
+  using TVI = Vec<3, int>;
+  const double dx = 0.05;
+  auto box_distance = [](const TV& x) {
+    TV q = x.array().abs() - 0.5;
+    return q.cwiseMax(0).norm() + std::min(q.maxCoeff(), 0.0);
+  };
+
+  bool ok = true;
+  auto check = [&](bool passed, const char* what) {
+    if (!passed) META_ERROR("{}: FAILED", what);
+    ok = ok && passed;
+  };
+
+  // every node of [-1, 1]^3 against distance, the clamped ones against sign only
+  auto compare = [&](const SparseLevelSet<double, 3>& levelset, auto distance, double tolerance,
+                     const char* what) {
+    int distance_errors = 0, sign_errors = 0;
+    double band = levelset.band();
+    for (int i = -20; i <= 20; i++)
+      for (int j = -20; j <= 20; j++)
+        for (int k = -20; k <= 20; k++) {
+          TVI node(i, j, k);
+          double exact = distance(TV(node.cast<double>() * dx));
+          double phi = levelset.node_value(node);
+          if (std::abs(exact) < band - dx) {
+            distance_errors += std::abs(phi - exact) > tolerance;
+          } else if (std::abs(exact) > band + dx) {
+            sign_errors += (phi < 0) != (exact < 0) || std::abs(phi) < band - 1e-9;
+          }
+        }
+    META_INFO("{}: {} blocks, {} distance errors, {} sign errors",
+              what,
+              levelset.num_blocks(),
+              distance_errors,
+              sign_errors);
+    check(distance_errors == 0 && sign_errors == 0, what);
+  };
+
+  auto mesh = box_mesh(5);
+  SparseLevelSet<double, 3> from_mesh(dx);
+  from_mesh.build_from_mesh(mesh);
+  compare(from_mesh, box_distance, 1e-9, "box mesh");
+
+  std::vector<TV> particle{TV(0.01, 0.02, 0.03)};
+  SparseLevelSet<double, 3> from_particles(dx);
+  from_particles.build_from_particles(particle, 0.3);
+  compare(
+    from_particles,
+    [&](const TV& x) { return (x - particle[0]).norm() - 0.3; },
+    0.5 * dx,
+    "particle sphere");
+
+  return ok ? 0 : 1;
+}
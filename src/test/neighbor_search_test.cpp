@@ -0,0 +1,96 @@
+#include "Math/neighbor_search.hpp"
+#include <random>
+
+// neighbors of query_all and query against a brute force search over all pairs, after a
+// build, an incremental update and an update that sorts again; particles outside of the
+// box fall into the border cells
+
+using namespace MS;
+
+int main() {
+  using TV = Vec<3, double>;
+  const int n = 3000;
+  const double radius = 0.08;
+  std::mt19937 random(5);
+  std::uniform_real_distribution<double> uniform(-0.05, 1.05);
+  std::vector<TV> x(n);
+  for (auto& xi : x) xi = TV(uniform(random), uniform(random), uniform(random));
+
+  bool ok = true;
+  auto check = [&](bool passed, const char* what) {
+    if (!passed) META_ERROR("{}: FAILED", what);
+    ok = ok && passed;
+  };
+
+  // sorted indices within radius of p, without skip
+  auto brute_force = [&](const TV& p, int skip) {
+    std::vector<int> result;
+    for (int j = 0; j < n; j++) {
+      if (j != skip && (x[j] - p).squaredNorm() <= radius * radius) result.push_back(j);
+    }
+    return result;
+  };
+  auto sorted_indices = [](const std::vector<NeighborSearch<3, double>::Neighbor>& neighbors) {
+    std::vector<int> indices;
+    for (auto& neighbor : neighbors) indices.push_back(neighbor.index);
+    std::sort(indices.begin(), indices.end());
+    return indices;
+  };
+
+  NeighborSearch<3, double> search(radius, TV::Zero(), TV::Ones());
+  auto compare = [&](const char* what) {
+    std::vector<std::vector<int>> found(n);
+    std::vector<int> visits(n, 0);
+    search.query_all([&](int i, const auto& neighbors) {
+      found[i] = sorted_indices(neighbors);
+      visits[i]++;
+    });
+    int errors = 0;
+    for (int i = 0; i < n; i++) {
+      if (visits[i] != 1 || found[i] != brute_force(x[i], i)) errors++;
+    }
+    // cells list their particles ascending
+    auto& sorted = search.sorted();
+    auto& start = search.cell_start();
+    for (size_t c = 0; c + 1 < start.size(); c++) {
+      for (int k = start[c]; k < start[c + 1]; k++) {
+        if (search.cell_of(sorted[k]) != int(c) || (k > start[c] && sorted[k - 1] > sorted[k]))
+          errors++;
+      }
+    }
+    if (errors) META_ERROR("{}: {} particles differ from brute force", what, errors);
+    check(errors == 0, what);
+  };
+
+  search.build(x.data(), n);
+  compare("build");
+
+  // a few particles move by up to a cell
+  std::uniform_real_distribution<double> step(-radius, radius);
+  for (int i = 0; i < n; i += 97) x[i] += TV(step(random), step(random), step(random));
+  search.update(x.data(), n);
+  check(search.last_incremental(), "small motion updates incrementally");
+  compare("incremental update");
+
+  // all particles move, update sorts again
+  for (auto& xi : x) xi += TV(step(random), step(random), step(random));
+  search.update(x.data(), n);
+  check(!search.last_incremental(), "large motion sorts again");
+  compare("full update");
+
+  // query points that are no particles
+  std::vector<TV> points(200);
+  for (auto& p : points) p = TV(uniform(random), uniform(random), uniform(random));
+  std::vector<std::vector<int>> found(points.size());
+  search.query(points.data(), points.size(), [&](size_t q, const auto& neighbors) {
+    found[q] = sorted_indices(neighbors);
+  });
+  int errors = 0;
+  for (size_t q = 0; q < points.size(); q++) {
+    if (found[q] != brute_force(points[q], -1)) errors++;
+  }
+  check(errors == 0, "query points");
+
+  META_INFO("neighbor search: {}", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#include "Utils/io_helper.hpp"
+#include "meta.hpp"
+#include <cstdio>
+#include <tbb/tick_count.h>
+
+// round trip of the columnar particle file, mapped arrays must match the written ones
+int main() {
+  using namespace MS;
+  const int n = 10000000;
+  auto x_tag = TypeTag<Vec<3, double>>("x");
+  auto mass_tag = TypeTag<float>("mass");
+  std::filesystem::create_directories(context.output_dir);
+  auto path = context.output_dir + "/particle_io_test.bin";
+
+  DataContainer written;
+  auto x = written.allocate(x_tag, Range{0, n});
+  for (int i = 0; i < n; i++) x[i] = Vec<3, double>(i, 2 * i, 3 * i);
+  written.append(mass_tag, Range{0, n / 2}, 1.0f);
+  written.append(mass_tag, Range{n / 2 + 10, n + 10}, 2.0f);
+
+  auto timer = tbb::tick_count::now();
+  if (!IOHelper::WriteParticles(path.c_str(), written)) return 1;
+  META_INFO("write {} particles: {:.3f}s", n, (tbb::tick_count::now() - timer).seconds());
+
+  DataContainer loaded;
+  timer = tbb::tick_count::now();
+  if (!IOHelper::ReadParticles(path.c_str(), loaded, x_tag, mass_tag)) return 1;
+  META_INFO("read {} particles: {:.6f}s", n, (tbb::tick_count::now() - timer).seconds());
+
+  auto& x_read = loaded.get_array(x_tag);
+  auto& mass_read = loaded.get_array(mass_tag);
+  bool same = x_read.data == written.get_array(x_tag).data &&
+              mass_read.data == written.get_array(mass_tag).data &&
+              mass_read.ranges.ranges == written.get_array(mass_tag).ranges.ranges &&
+              loaded.total_size == written.total_size;
+  // element types are checked against the header
+  bool rejected = !IOHelper::ReadParticles(path.c_str(), loaded, TypeTag<double>("mass"));
+  std::remove(path.c_str());
+
+  META_INFO("round trip {}, type mismatch rejected {}", same, rejected);
+  return same && rejected ? 0 : 1;
+}
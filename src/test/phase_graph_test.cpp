@@ -0,0 +1,70 @@
+#include "Core/phase_graph.hpp"
+#include "Utils/logger.hpp"
+#include <algorithm>
+#include <thread>
+
+// phases start after the phases they depend on, a deferred phase overlaps the next step
+// until a phase it is before, and the critical path follows the longest chain
+
+using namespace MS;
+
+int main() {
+  std::mutex mutex;
+  std::vector<std::string> log;
+  const size_t none = SIZE_MAX;
+  auto phase = [&](const std::string& name, int ms) {
+    return [&, name, ms] {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        log.push_back(name + "<");
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+      std::lock_guard<std::mutex> lock(mutex);
+      log.push_back(name + ">");
+    };
+  };
+  // index of the occurrence-th entry, none when there is none
+  auto position = [&](const std::string& entry, int occurrence) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = log.begin();
+    for (int i = 0; i <= occurrence && it != log.end(); i++) {
+      it = std::find(i ? it + 1 : it, log.end(), entry);
+    }
+    return it == log.end() ? none : size_t(it - log.begin());
+  };
+
+  bool ok = true;
+  auto check = [&](bool passed, const char* what) {
+    if (!passed) META_ERROR("{}: FAILED", what);
+    ok = ok && passed;
+  };
+
+  PhaseGraph graph;
+  graph.add("a", phase("a", 1));
+  graph.add("b", phase("b", 20), {"a"});
+  graph.add("c", phase("c", 1), {"a"});
+  graph.add("d", phase("d", 1), {"b", "c"});
+  graph.add_deferred("diagnostics", phase("diagnostics", 50), {"d"}, {"b"});
+
+  graph.run();
+  check(position("a>", 0) < position("b<", 0) && position("a>", 0) < position("c<", 0) &&
+          position("b>", 0) < position("d<", 0) && position("c>", 0) < position("d<", 0),
+        "dependency order");
+  check(position("diagnostics>", 0) == none, "run() leaves the deferred phase running");
+
+  graph.run();
+  check(position("a<", 1) < position("diagnostics>", 0), "deferred phase overlaps the next step");
+  check(position("diagnostics>", 0) < position("b<", 1), "deferred phase finishes before b");
+  graph.wait();
+  check(position("diagnostics>", 1) != none, "wait() finishes deferred phases");
+
+  auto path = graph.critical_path();
+  check(path == std::vector<std::string>{"a", "b", "d"}, "critical path");
+  auto statistics = graph.statistics();
+  check(statistics[1].critical && !statistics[2].critical && !statistics[4].critical &&
+          statistics[2].slack_ms > 10 && statistics[4].count == 2,
+        "phase statistics");
+
+  META_INFO("phase graph: {}", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+
+#include "Core/data_container.hpp"
+#include "Math/interpolation.hpp"
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+
+// accuracy report of single / mixed precision transfers against the double path
+// scene: a block of particles, P2G of mass and momentum with quadratic kernel
+// fails when mixed precision, or single precision near the origin, exceeds the tolerance
+
+using namespace MS;
+
+// rel-L2 of grid mass and momentum against double, float round-off with headroom
+const double tolerance = 1e-5;
+
+struct Scene {
+  const char* name;
+  Vec<3, double> origin;
+  double extent;
+  double dx;
+  int n_particles;
+  // single precision positions keep their accuracy, false where they lose it far from the origin
+  bool single_accurate;
+};
+
+struct Field {
+  std::unordered_map<int64_t, double> mass;
+  std::unordered_map<int64_t, Vec<3, double>> momentum;
+  double max_partition_error{0};
+};
+
+int64_t node_key(const Vec<3, int>& node) {
+  return (int64_t(node(0)) << 42) ^ (int64_t(node(1)) << 21) ^ int64_t(node(2));
+}
+
+struct Errors {
+  double mass;
+  double momentum;
+  double partition;
+  int missing;
+};
+
+// particle states stored with the tags of TPrecision, transfers in its grid scalar
+template<typename TPrecision>
+Field run_p2g(const Scene& scene, const std::vector<Vec<3, double>>& xs,
+              const std::vector<Vec<3, double>>& vs) {
+  using TP = typename TPrecision::particle_type;
+  using TG = typename TPrecision::grid_type;
+  using Tags = PrecisionTags<TPrecision, 3>;
+  using Kernel = QuadraticKernel<3, TG>;
+  DataContainer particles;
+  int n = int(xs.size());
+  auto x = particles.allocate(Tags::vector("x"), Range{0, n});
+  auto v = particles.allocate(Tags::vector("v"), Range{0, n});
+  for (int p = 0; p < n; p++) {
+    x[p] = xs[p].template cast<TP>();
+    v[p] = vs[p].template cast<TP>();
+  }
+
+  Field field;
+  std::unordered_map<int64_t, TG> mass;
+  std::unordered_map<int64_t, Vec<3, TG>> momentum;
+  TP inv_dx = TP(1) / TP(scene.dx);
+  TG mp = TG(1);
+
+  for (int p = 0; p < n; p++) {
+    Vec<3, TG> vp = v[p].template cast<TG>();
+    auto [base_node, w] = Kernel::calc_o_w(Vec<3, TP>(x[p] * inv_dx));
+    TG w_sum = 0;
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++)
+        for (int k = 0; k < 3; k++) {
+          TG wijk = w(i, 0) * w(j, 1) * w(k, 2);
+          auto key = node_key(base_node + Vec<3, int>(i, j, k));
+          mass[key] += wijk * mp;
+          auto it = momentum.try_emplace(key, Vec<3, TG>::Zero()).first;
+          it->second += wijk * mp * vp;
+          w_sum += wijk;
+        }
+    field.max_partition_error =
+      std::max(field.max_partition_error, std::abs(double(w_sum) - 1.0));
+  }
+  for (auto& [key, m] : mass) field.mass[key] = double(m);
+  for (auto& [key, mv] : momentum) field.momentum[key] = mv.template cast<double>();
+  return field;
+}
+
+Errors report(const char* mode, const Field& reference, const Field& field) {
+  double mass_err = 0, mass_norm = 0, mom_err = 0, mom_norm = 0, max_err = 0;
+  int missing = 0;
+  for (auto& [key, m] : reference.mass) {
+    auto it = field.mass.find(key);
+    double m_test = it == field.mass.end() ? (missing++, 0.0) : it->second;
+    mass_err += (m - m_test) * (m - m_test);
+    mass_norm += m * m;
+    max_err = std::max(max_err, std::abs(m - m_test));
+
+    auto& mv = reference.momentum.at(key);
+    auto jt = field.momentum.find(key);
+    Vec<3, double> mv_test = jt == field.momentum.end() ? Vec<3, double>::Zero() : jt->second;
+    mom_err += (mv - mv_test).squaredNorm();
+    mom_norm += mv.squaredNorm();
+  }
+  Errors errors{std::sqrt(mass_err / mass_norm),
+                std::sqrt(mom_err / mom_norm),
+                field.max_partition_error,
+                missing};
+  printf("  %-7s mass rel-L2 %.3e  mass max-abs %.3e  momentum rel-L2 %.3e  "
+         "partition-of-unity %.3e  missing nodes %d\n",
+         mode,
+         errors.mass,
+         max_err,
+         errors.momentum,
+         errors.partition,
+         errors.missing);
+  return errors;
+}
+
+bool within_tolerance(const Errors& errors) {
+  return errors.mass <= tolerance && errors.momentum <= tolerance &&
+         errors.partition <= tolerance && errors.missing == 0;
+}
+
+int main() {
+  std::vector<Scene> scenes = {
+    {"unit block near origin", {0.2, 0.2, 0.2}, 0.3, 1.0 / 128, 200000, true},
+    {"block far from origin", {1000.2, 1000.2, 1000.2}, 0.3, 1.0 / 128, 200000, false},
+  };
+
+  bool ok = true;
+  std::cout << "precision report: P2G with quadratic kernel, errors against double" << std::endl;
+  for (auto& scene : scenes) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<Vec<3, double>> xs(scene.n_particles), vs(scene.n_particles);
+    for (int p = 0; p < scene.n_particles; p++) {
+      xs[p] = scene.origin + scene.extent * Vec<3, double>(unit(rng), unit(rng), unit(rng));
+      vs[p] = Vec<3, double>(unit(rng) - 0.5, unit(rng) - 0.5, unit(rng) - 0.5);
+    }
+
+    auto reference = run_p2g<DoublePrecision>(scene, xs, vs);
+    printf("scene: %s (%d particles, dx = %g)\n", scene.name, scene.n_particles, scene.dx);
+    report("double", reference, reference);
+    auto mixed = report("mixed", reference, run_p2g<MixedPrecision>(scene, xs, vs));
+    auto single = report("single", reference, run_p2g<SinglePrecision>(scene, xs, vs));
+    if (!within_tolerance(mixed)) {
+      printf("  mixed precision exceeds rel-L2 %.0e: FAILED\n", tolerance);
+      ok = false;
+    }
+    if (scene.single_accurate && !within_tolerance(single)) {
+      printf("  single precision exceeds rel-L2 %.0e: FAILED\n", tolerance);
+      ok = false;
+    }
+  }
+  std::cout << "precision report: " << (ok ? "ok" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
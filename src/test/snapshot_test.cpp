@@ -0,0 +1,71 @@
+#include "Core/snapshot.hpp"
+#include "meta.hpp"
+
+// snapshots keep uniform ranges as stored, share arrays only read since the previous one,
+// copy only changed pages, and restore written and resized arrays
+
+using namespace MS;
+
+int main() {
+  using TV = Vec<3, double>;
+  const int n = 50000;
+  auto x_tag = TypeTag<TV>("x");
+  auto mass_tag = TypeTag<float>("mass");
+  auto id_tag = TypeTag<int>("id");
+
+  DataContainer container;
+  auto x = container.allocate(x_tag, Range{0, n});
+  auto id = container.allocate(id_tag, Range{0, n});
+  for (int i = 0; i < n; i++) {
+    x[i] = TV(i, 2 * i, 3 * i);
+    id[i] = i;
+  }
+  container.append(mass_tag, Range{0, n / 2}, 1.0f);
+  container.append_uniform(mass_tag, Range{n / 2, n}, 2.0f);
+  const auto& mass = std::as_const(container).get_array(mass_tag);
+  auto x0 = container.get_array(x_tag).data;
+  auto ranges0 = mass.ranges.ranges;
+
+  bool ok = true;
+  auto check = [&](bool passed, const char* what) {
+    if (!passed) META_ERROR("{}: FAILED", what);
+    ok = ok && passed;
+  };
+
+  SnapshotStore store;
+  store.page_bytes = 4096;
+  store.write_log = true;
+  int first = store.take(container);
+  check(mass.is_uniform() && mass.data.size() == n / 2 + 1, "take keeps uniform ranges");
+
+  // positions written on one page, particles emitted, ids only read
+  for (auto [xi] : container.Subset(RangeSet(Range{0, 10}), x_tag)) xi = TV(-1, -1, -1);
+  container.append(mass_tag, Range{n, n + 100}, 3.0f);
+  long sum = 0;
+  for (auto i : container.get_array(id_tag).data) sum += i;
+  store.take(container);
+  auto& report = store.last_report();
+  check(sum == long(n) * (n - 1) / 2 && report.arrays_shared == 1 &&
+          report.arrays_compared == 2 &&
+          report.bytes_copied <= store.page_bytes + mass.data.size() * sizeof(float),
+        "second take shares read arrays and copies changed pages");
+
+  auto snapshot = store.find(first);
+  std::vector<float> masses;
+  check(snapshot && snapshot->value(mass_tag, n - 1) == 2.0f &&
+          snapshot->value(mass_tag, 7) == 1.0f && snapshot->read(mass_tag, masses) &&
+          masses.size() == n && masses[n / 2] == 2.0f && masses[n / 2 - 1] == 1.0f,
+        "snapshot values");
+
+  // write the uniform range too, then go back to the first snapshot
+  for (auto [m] : container.Subset(RangeSet(Range{n / 2, n / 2 + 10}), mass_tag)) m = 5.0f;
+  check(!mass.is_uniform(), "written uniform range materialized");
+  check(store.restore(container, first), "restore");
+  check(container.get_array(x_tag).data == x0 && mass.element_count() == n &&
+          mass.ranges.ranges == ranges0 && mass.is_uniform() &&
+          mass.data.size() == n / 2 + 1 && mass.value(n / 2) == 2.0f && mass.value(0) == 1.0f,
+        "restored values, ranges and uniform storage");
+
+  META_INFO("snapshots: {}", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
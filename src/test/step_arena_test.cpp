@@ -0,0 +1,51 @@
+#include "Core/step_arena.hpp"
+#include "meta.hpp"
+
+// transient vectors of every step come from the arena: after the first steps grew it to
+// the high water mark, steps reuse its storage and chunk_allocations stops moving
+
+using namespace MS;
+
+int main() {
+  using TV = Vec<3, double>;
+  auto arena = std::make_shared<StepArena>(4096);
+  const size_t n = 20000;
+
+  bool ok = true;
+  auto check = [&](bool passed, const char* what) {
+    if (!passed) META_ERROR("{}: FAILED", what);
+    ok = ok && passed;
+  };
+
+  // the buffers of a grid collision step, positions and their contacts
+  std::vector<size_t> allocations;
+  std::vector<const void*> storage;
+  for (int step = 0; step < 10; step++) {
+    TransientVector<TV> x(n, TV::Zero(), Allocator<TV>(arena));
+    TransientVector<int> faces{Allocator<int>(arena)};
+    faces.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+      x[i] = TV(i, step, 0);
+      faces.push_back(int(i));
+    }
+    storage.push_back(x.data());
+    allocations.push_back(arena->statistics().chunk_allocations);
+    arena->reset();
+  }
+
+  auto statistics = arena->statistics();
+  check(allocations[0] > 1 && allocations[1] == allocations[0] + 1, "first steps grow the arena");
+  check(allocations.back() == allocations[1] && statistics.chunk_allocations == allocations[1],
+        "chunk_allocations stops moving");
+  check(storage.back() == storage[2] && storage[5] == storage[2], "steps reuse the storage");
+  check(statistics.chunks == 1, "a single chunk of the high water mark");
+  check(statistics.bytes_used >= n * (sizeof(TV) + sizeof(int)) &&
+          statistics.high_water >= statistics.bytes_used && statistics.steps == 10,
+        "step statistics");
+
+  META_INFO("step arena: {} chunk allocations, {:.1f} kB reserved, {}",
+            statistics.chunk_allocations,
+            statistics.bytes_reserved / 1e3,
+            ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+#include "Math/surface_reconstruction.hpp"
+#include <Eigen/Geometry>
+#include <map>
+#include <sstream>
+#include <tbb/task_arena.h>
+
+// meshes of a ball of particles must be closed, consistently oriented, of genus 0 and
+// enclose about the ball, independent of the thread count; mesh frames round trip
+
+using namespace MS;
+
+using TV = Vec<3, double>;
+
+// every edge in exactly two triangles, once in each direction
+bool closed(const SurfaceMesh& mesh) {
+  std::map<std::pair<uint32_t, uint32_t>, int> directed;
+  for (auto& triangle : mesh.triangles) {
+    for (int e = 0; e < 3; e++) directed[{triangle[e], triangle[(e + 1) % 3]}]++;
+  }
+  for (auto& [edge, uses] : directed) {
+    auto reverse = directed.find({edge.second, edge.first});
+    if (uses != 1 || reverse == directed.end() || reverse->second != 1) return false;
+  }
+  // V - E + F of a sphere
+  return long(mesh.vertices.size()) - long(directed.size() / 2) + long(mesh.triangles.size()) ==
+         2;
+}
+
+double volume(const SurfaceMesh& mesh) {
+  double sum = 0;
+  for (auto& triangle : mesh.triangles) {
+    auto p = [&](int e) {
+      auto& v = mesh.vertices[triangle[e]];
+      return TV(v[0], v[1], v[2]);
+    };
+    sum += p(0).dot(p(1).cross(p(2))) / 6;
+  }
+  return sum;
+}
+
+int main() {
+  const double spacing = 0.02, radius = 0.3;
+  std::vector<TV> x;
+  for (double i = -radius; i <= radius; i += spacing)
+    for (double j = -radius; j <= radius; j += spacing)
+      for (double k = -radius; k <= radius; k += spacing) {
+        if (TV(i, j, k).norm() <= radius) x.push_back(TV(i + 0.5, j + 0.5, k + 0.5));
+      }
+  // the surface passes about through the outer particles
+  double expected = 4.0 / 3 * 3.14159265358979 * std::pow(radius, 3);
+
+  bool ok = true;
+  using Reconstruction = SurfaceReconstruction<double>;
+  for (auto field : {Reconstruction::Field::density, Reconstruction::Field::level_set}) {
+    for (auto kernel : {Reconstruction::Kernel::cubic_spline, Reconstruction::Kernel::poly6}) {
+      Reconstruction reconstruction(spacing / 2, spacing);
+      reconstruction.field = field;
+      reconstruction.kernel = kernel;
+      reconstruction.write_log = true;
+      SurfaceMesh serial, parallel;
+      tbb::task_arena(1).execute([&] { reconstruction.reconstruct(x.data(), x.size(), serial); });
+      tbb::task_arena(4).execute([&] { reconstruction.reconstruct(x.data(), x.size(), parallel); });
+      bool same = serial.vertices == parallel.vertices && serial.triangles == parallel.triangles;
+      double error = volume(parallel) / expected - 1;
+      bool passed = same && closed(parallel) && std::abs(error) < 0.05;
+      META_INFO("{} {}: same {}, closed {}, volume error {:.3f}: {}",
+                field == Reconstruction::Field::density ? "density" : "level set",
+                kernel == Reconstruction::Kernel::poly6 ? "poly6" : "cubic spline",
+                same,
+                closed(parallel),
+                error,
+                passed ? "ok" : "FAILED");
+      ok = ok && passed;
+    }
+  }
+
+  // two frames through one stream, the second quantized
+  Reconstruction reconstruction(spacing / 2, spacing);
+  SurfaceMesh mesh, read;
+  reconstruction.reconstruct(x.data(), x.size(), mesh);
+  std::stringstream stream;
+  mesh.frame = 7;
+  MeshFile::write(stream, mesh);
+  MeshFile::write(stream, mesh, true);
+  bool exact = MeshFile::read(stream, read) && read.frame == 7 && read.vertices == mesh.vertices &&
+               read.triangles == mesh.triangles;
+  float deviation = 0;
+  bool quantized = MeshFile::read(stream, read) && read.triangles == mesh.triangles;
+  for (size_t v = 0; quantized && v < mesh.vertices.size(); v++) {
+    for (int d = 0; d < 3; d++) {
+      deviation = std::max(deviation, std::abs(read.vertices[v][d] - mesh.vertices[v][d]));
+    }
+  }
+  quantized = quantized && deviation < 1e-5f && !MeshFile::read(stream, read);
+  META_INFO("mesh frames: exact {}, quantized {} (max deviation {:.2e})",
+            exact,
+            quantized,
+            deviation);
+  return ok && exact && quantized ? 0 : 1;
+}